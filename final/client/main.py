@@ -1,6 +1,121 @@
+import random
 import socket
+import struct
 import sys
 
+# Binary command protocol, see wiflyClock/Project/proto.h
+PROTO_VERSION = 1
+OP_COLOR    = 0x01
+OP_TOGGLE   = 0x02
+OP_WRITE    = 0x03
+OP_CLEAR    = 0x04
+OP_TIME     = 0x05
+OP_SCHEDULE = 0x06
+EVENT_COLOR = 3
+
+STATUS = ["ok", "version not understood", "unknown opcode",
+          "bad arguments", "bad length", "schedule full"]
+
+ACK_TIMEOUT = 1.0 # Seconds to wait for an ack before sending again
+RETRIES     = 3   # All sent within the clock's 5 s PROTO_SEQ_HOLD_MS
+
+# crc16_ccitt as in lib_crc: polynomial 0x1021, initial value 0
+def crc16(data):
+   crc = 0
+   for byte in bytearray(data):
+      crc ^= byte << 8
+      for i in range(8):
+         if crc & 0x8000:
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+         else:
+            crc = (crc << 1) & 0xFFFF
+   return crc
+
+# Frames a payload as frame.c does: payload and crc, COBS encoded, between
+# zero delimiters
+def frame(payload):
+   data = bytearray(payload) + bytearray(struct.pack(">H", crc16(payload)))
+   out = bytearray([0])
+   block = bytearray()
+   for byte in data:
+      if byte:
+         block.append(byte)
+      if not byte or len(block) == 254:
+         out.append(len(block) + 1)
+         out += block
+         block = bytearray()
+   out.append(len(block) + 1)
+   out += block
+   out.append(0)
+   return str(out)
+
+# Undoes frame, returns the payload or None if it is malformed
+def unframe(data):
+   data = bytearray(data).strip(b"\0")
+   out = bytearray()
+   ndx = 0
+   while ndx < len(data):
+      code = data[ndx]
+      if code == 0 or ndx + code > len(data):
+         return None
+      out += data[ndx + 1:ndx + code]
+      ndx += code
+      if code != 0xFF and ndx < len(data):
+         out.append(0)
+   if len(out) < 2 or crc16(out) != 0:
+      return None
+   return out[:-2]
+
+# Payloads of the frames in a datagram; the clock may send several in one,
+# and a frame that was cut short or corrupted is left out
+def unframeAll(data):
+   frames = [unframe(part) for part in bytearray(data).split(b"\0") if part]
+   return [payload for payload in frames if payload is not None]
+
+def command(opcode, args=""):
+   return struct.pack("BB", len(args) + 1, opcode) + args
+
+# Protocol time from YYYYMMDDhhmmss
+def packTime(text):
+   return struct.pack(">HBBBBB", int(text[0:4]), int(text[4:6]),
+                      int(text[6:8]), int(text[8:10]), int(text[10:12]),
+                      int(text[12:14]))
+
+# Schedule command from the old ASCII form, YYYYMMDDhhmmss, event type, line,
+# number of data bytes and the data; a color's data is RRGGBB in hex
+def schedule(text):
+   evtype = int(text[14])
+   line = int(text[15])
+   data = text[17:17 + int(text[16], 16)]
+   if evtype == EVENT_COLOR:
+      data = data.decode("hex")
+   return command(OP_SCHEDULE, packTime(text) + struct.pack("BB", evtype, line)
+                  + data)
+
+# Sends the commands in one packet and waits for its ack, sending it again if
+# the ack does not come. The clock applies a repeated packet only once, so the
+# seq is random: a clock-derived one repeats exactly 25.6 s apart.
+def send(addr, commands):
+   seq = random.randrange(256)
+   packet = frame(struct.pack("BB", PROTO_VERSION, seq) + "".join(commands))
+   osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+   osock.settimeout(ACK_TIMEOUT)
+   try:
+      for attempt in range(RETRIES):
+         osock.sendto(packet, addr)
+         try:
+            while True:
+               for ack in unframeAll(osock.recvfrom(256)[0]):
+                  if len(ack) == 3 and ack[1] == seq:
+                     status = ack[2]
+                     print "ack:", STATUS[status] if status < len(STATUS) else status
+                     return
+         except socket.timeout:
+            pass
+      print "No ack from WiflyClock"
+   finally:
+      osock.close()
+
 # Parse arguments
 if len(sys.argv) > 1:
 
@@ -16,95 +131,63 @@ if len(sys.argv) > 1:
    print "Discovered WiflyClock!"
    print "ip:   ", listip
    print "port: ", port
+   clock = (listip, 2000)
 
    # Change screen color (TRY SENDING 0ACED0)
    if sys.argv[1] == 'Color':
       if len(sys.argv) == 3:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "COL" + sys.argv[2]
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [command(OP_COLOR, sys.argv[2].decode("hex"))])
       else:
          print "Insufficient arguments"
 
    # Toggle on/off
    elif sys.argv[1] == 'Toggle':
       if len(sys.argv) == 2:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "TOG"
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [command(OP_TOGGLE)])
       else:
          print "Insufficient arguments"
 
    # Write line
    elif sys.argv[1] == 'Write':
       if len(sys.argv) == 4:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "WRT" + sys.argv[2] + sys.argv[3]
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [command(OP_WRITE, chr(int(sys.argv[2][0]))
+                              + sys.argv[3][:16])])
       else:
          print "Insufficient arguments"
 
    # Clear Screen
    elif sys.argv[1] == 'Clear':
       if len(sys.argv) == 2:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "CLR"
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [command(OP_CLEAR)])
       else:
          print "Insufficient arguments"
 
    # Change Time
    elif sys.argv[1] == 'Time':
       if len(sys.argv) == 3:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "TIM" + sys.argv[2]
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [command(OP_TIME, packTime(sys.argv[2]))])
       else:
          print "Insufficient arguments"
 
    # Generic Schedule
    elif sys.argv[1] == 'Sched':
       if len(sys.argv) == 3:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "SCH" + sys.argv[2]
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [schedule(sys.argv[2])])
       else:
          print "Insufficient arguments"
 
    # 40sec color schedule
    elif sys.argv[1] == '40CSched':
       if len(sys.argv) == 2:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "SCH197001010000403060033FF"
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [schedule("197001010000403060033FF")])
       else:
          print "Insufficient arguments"
 
-   # 45sec print schedule
+   # 45sec print schedule, both events in one packet
    elif sys.argv[1] == '45WSched':
       if len(sys.argv) == 2:
-         osock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-         CONSTR = "SCH19700101000045205HELLO"
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         CONSTR = "SCH19700101000050215WORLD"
-         print CONSTR
-         osock.sendto(CONSTR, (listip, 2000))
-         osock.close();
+         send(clock, [schedule("19700101000045205HELLO"),
+                      schedule("19700101000050215WORLD")])
       else:
          print "Insufficient arguments"
 
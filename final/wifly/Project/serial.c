@@ -2,7 +2,12 @@
  * @file serial.c
  * @breif serial implementation for avr microcontroller. This file implements
  *        USART0, USART1, USART2, and USART3 with 8 bits, no parity, 1 stop bit
- *        configuration with a user supplied baudrate.
+ *        configuration with a user supplied baudrate. Each port is interrupt
+ *        driven: the rx complete interrupt fills an rx ring buffer and the data
+ *        register empty interrupt drains a tx ring buffer, waking any task
+ *        blocked on the port. The baud divisor and U2X setting are chosen for
+ *        the smallest baud error, and RTS/CTS flow control can be run on any
+ *        pair of spare GPIO pins.
  * @author Matt Zimmerer
  */
 
@@ -11,183 +16,430 @@
 #endif
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
 #include "serial.h"
 
-#define NUMATTEMPTS 3000
+#if (SERIAL_RXBUFF_SZ & (SERIAL_RXBUFF_SZ - 1)) || SERIAL_RXBUFF_SZ > 256
+#error SERIAL_RXBUFF_SZ must be a power of two no larger than 256
+#endif
+
+#if (SERIAL_TXBUFF_SZ & (SERIAL_TXBUFF_SZ - 1)) || SERIAL_TXBUFF_SZ > 256
+#error SERIAL_TXBUFF_SZ must be a power of two no larger than 256
+#endif
+
+#define NUMPORTS 4
+#define RXMASK   (SERIAL_RXBUFF_SZ - 1)
+#define TXMASK   (SERIAL_TXBUFF_SZ - 1)
+#define UBRRMAX  4095
+
+// GPIO registers of a port are laid out PINx, DDRx, PORTx
+#define DDR_OF(pin)  ((pin) + 1)
+#define PORT_OF(pin) ((pin) + 2)
+
+// The four USARTs share one register layout, so the USART0 bit names are
+// used for every port.
+struct serial_port {
+   volatile uint8_t *udr;
+   volatile uint8_t *ucsra;
+   volatile uint8_t *ucsrb;
+   volatile uint8_t *ucsrc;
+   volatile uint8_t *ubrrh;
+   volatile uint8_t *ubrrl;
+
+   char *rxbuff;
+   volatile uint8_t rxhead; // Written by the rx isr
+   volatile uint8_t rxtail; // Written by the reading task
+
+   char *txbuff;
+   volatile uint8_t txhead; // Written by the writing task
+   volatile uint8_t txtail; // Written by the udre isr
+
+   xSemaphoreHandle rxsem;  // Given by the rx isr for each received byte
+   xSemaphoreHandle txsem;  // Given by the udre isr for each sent byte
+   xSemaphoreHandle txlock; // Serializes writing tasks
+
+   volatile uint8_t *rts;   // PORTx of the rts output, NULL without flow control
+   uint8_t rtsmask;
+   volatile uint8_t *cts;   // PINx of the cts input, NULL without flow control
+   uint8_t ctsmask;
+
+   uint32_t baudrate;       // Rate actually achieved by the divisor
+   int16_t error;           // Baud error in hundredths of a percent
+};
+
+static struct serial_port ports[NUMPORTS] = {
+   {&UDR0, &UCSR0A, &UCSR0B, &UCSR0C, &UBRR0H, &UBRR0L},
+   {&UDR1, &UCSR1A, &UCSR1B, &UCSR1C, &UBRR1H, &UBRR1L},
+   {&UDR2, &UCSR2A, &UCSR2B, &UCSR2C, &UBRR2H, &UBRR2L},
+   {&UDR3, &UCSR3A, &UCSR3B, &UCSR3C, &UBRR3H, &UBRR3L}
+};
+
+static struct serial_port *getPort(uint8_t usartn)
+{
+   if (usartn >= NUMPORTS || !ports[usartn].rxbuff)
+      return NULL;
+
+   return &ports[usartn];
+}
 
-static char __readByte(uint8_t usartn)
+static portTickType toTicks(uint16_t timeout)
 {
-   switch (usartn) {
-      case USART0: return UDR0;
-      case USART1: return UDR1;
-      case USART2: return UDR2;
-      case USART3: return UDR3;
-      default: return -1;
+   if (timeout == SERIAL_WAIT_FOREVER)
+      return portMAX_DELAY;
+
+   return timeout / portTICK_RATE_MS;
+}
+
+static uint8_t rxCount(struct serial_port *port)
+{
+   return (port->rxhead - port->rxtail) & RXMASK;
+}
+
+// cts is active low: the far end pulls it low while it can take more data
+static int ctsBlocked(struct serial_port *port)
+{
+   return port->cts && (*port->cts & port->ctsmask);
+}
+
+static void rxInterrupt(struct serial_port *port)
+{
+   signed portBASE_TYPE woken = pdFALSE;
+   char byte = *port->udr;
+   uint8_t next = (port->rxhead + 1) & RXMASK;
+
+   // Drop the byte if the reader has fallen a whole buffer behind
+   if (next != port->rxtail) {
+      port->rxbuff[port->rxhead] = byte;
+      port->rxhead = next;
    }
+
+   // Ask the far end to pause before the buffer overflows
+   if (port->rts && rxCount(port) >= SERIAL_RTS_HIGH)
+      *port->rts |= port->rtsmask;
+
+   xSemaphoreGiveFromISR(port->rxsem, &woken);
+   if (woken != pdFALSE)
+      taskYIELD();
 }
 
-static void __writeByte(char byte, uint8_t usartn)
+static void udreInterrupt(struct serial_port *port)
 {
-   switch (usartn) {
-      case USART0:
-         UDR0 = byte;
-         break;
-      case USART1:
-         UDR1 = byte;
-         break;
-      case USART2:
-         UDR2 = byte;
-         break;
-      case USART3:
-         UDR3 = byte;
-         break;
-      default:
-         break;
+   signed portBASE_TYPE woken = pdFALSE;
+
+   if (port->txtail != port->txhead && !ctsBlocked(port)) {
+      *port->udr = port->txbuff[port->txtail];
+      port->txtail = (port->txtail + 1) & TXMASK;
+      xSemaphoreGiveFromISR(port->txsem, &woken);
+   } else {
+      // Nothing left to send, or the far end is not ready. serialCtsChanged
+      // or the next write restarts the interrupt.
+      *port->ucsrb &= ~(1 << UDRIE0);
+   }
+
+   if (woken != pdFALSE)
+      taskYIELD();
+}
+
+ISR(USART0_RX_vect) { rxInterrupt(&ports[USART0]); }
+ISR(USART1_RX_vect) { rxInterrupt(&ports[USART1]); }
+ISR(USART2_RX_vect) { rxInterrupt(&ports[USART2]); }
+ISR(USART3_RX_vect) { rxInterrupt(&ports[USART3]); }
+
+ISR(USART0_UDRE_vect) { udreInterrupt(&ports[USART0]); }
+ISR(USART1_UDRE_vect) { udreInterrupt(&ports[USART1]); }
+ISR(USART2_UDRE_vect) { udreInterrupt(&ports[USART2]); }
+ISR(USART3_UDRE_vect) { udreInterrupt(&ports[USART3]); }
+
+// Copies as many buffered bytes as are available, up to bytes
+static uint16_t ringRead(struct serial_port *port, char *dst, uint16_t bytes)
+{
+   uint16_t count = 0;
+   uint8_t tail = port->rxtail;
+
+   while (count < bytes && tail != port->rxhead) {
+      dst[count++] = port->rxbuff[tail];
+      tail = (tail + 1) & RXMASK;
+   }
+   port->rxtail = tail;
+
+   // Let the far end resume once the buffer has drained
+   if (port->rts && rxCount(port) <= SERIAL_RTS_LOW)
+      *port->rts &= ~port->rtsmask;
+
+   return count;
+}
+
+// Copies as many bytes as fit, up to bytes, and starts the transmitter
+static uint16_t ringWrite(struct serial_port *port, const char *src,
+                          uint16_t bytes)
+{
+   uint16_t count = 0;
+   uint8_t head = port->txhead;
+   uint8_t next = (head + 1) & TXMASK;
+
+   while (count < bytes && next != port->txtail) {
+      port->txbuff[head] = src[count++];
+      head = next;
+      next = (head + 1) & TXMASK;
+   }
+   port->txhead = head;
+
+   if (count)
+      *port->ucsrb |= (1 << UDRIE0);
+
+   return count;
+}
+
+// Picks the divisor and speed mode giving the rate closest to baudrate. Normal
+// speed wins ties since its receiver samples each bit more often.
+static void pickBaud(uint32_t baudrate, uint16_t *ubrr, uint8_t *u2x,
+                     uint32_t *actual)
+{
+   uint32_t div, rate, bestRate = 0, diff, bestDiff = 0xFFFFFFFFUL;
+   uint32_t reg;
+   uint8_t x2;
+
+   for (x2 = 0; x2 <= 1; x2++) {
+      div = (x2 ? 8UL : 16UL) * baudrate;
+
+      // Rounded rather than truncated divisor
+      reg = (F_CPU + div / 2) / div;
+      reg = reg ? reg - 1 : 0;
+      if (reg > UBRRMAX)
+         reg = UBRRMAX;
+
+      rate = F_CPU / ((x2 ? 8UL : 16UL) * (reg + 1));
+      diff = rate > baudrate ? rate - baudrate : baudrate - rate;
+      if (diff < bestDiff) {
+         bestDiff = diff;
+         bestRate = rate;
+         *ubrr = reg;
+         *u2x = x2;
+      }
+   }
+
+   *actual = bestRate;
+}
+
+static void setupPin(volatile uint8_t *pin, uint8_t bit, int output)
+{
+   if (output) {
+      *PORT_OF(pin) &= ~(1 << bit); // rts asserted, ready to receive
+      *DDR_OF(pin) |= (1 << bit);
+   } else {
+      *DDR_OF(pin) &= ~(1 << bit);
+      *PORT_OF(pin) |= (1 << bit); // pull up, so a missing cts reads not ready
    }
 }
 
 void setupSerial(uint32_t baudrate, uint8_t usartn)
 {
-   baudrate = (F_CPU / (16UL * baudrate)) - 1;
+   struct serial_config config = {baudrate, NULL, 0, NULL, 0};
+
+   setupSerialConfig(&config, usartn);
+}
+
+int setupSerialConfig(const struct serial_config *config, uint8_t usartn)
+{
+   struct serial_port *port;
+   uint16_t ubrr = 0;
+   uint8_t u2x = 0;
+   uint32_t actual, diff, error;
+
+   if (usartn >= NUMPORTS || !config->baudrate)
+      return -1;
+   port = &ports[usartn];
+
+   if (!port->rxbuff) {
+      port->rxbuff = (char *) pvPortMalloc(SERIAL_RXBUFF_SZ);
+      port->txbuff = (char *) pvPortMalloc(SERIAL_TXBUFF_SZ);
+      vSemaphoreCreateBinary(port->rxsem);
+      vSemaphoreCreateBinary(port->txsem);
+      port->txlock = xSemaphoreCreateMutex();
+
+      // The port stays disabled if it could not get its buffers
+      if (!port->rxbuff || !port->txbuff || !port->rxsem || !port->txsem
+            || !port->txlock) {
+         port->rxbuff = NULL;
+         return -1;
+      }
+   }
+
+   pickBaud(config->baudrate, &ubrr, &u2x, &actual);
+   port->baudrate = actual;
+
+   // Error in hundredths of a percent. The difference times 10000 fits in 32
+   // bits for any rate a port can run at, anything larger just saturates.
+   diff = actual > config->baudrate ? actual - config->baudrate
+                                    : config->baudrate - actual;
+   error = diff <= UINT32_MAX / 10000 ? diff * 10000 / config->baudrate
+                                      : INT16_MAX;
+   if (error > INT16_MAX)
+      error = INT16_MAX;
+   port->error = actual < config->baudrate ? -(int16_t) error
+                                           : (int16_t) error;
 
-   switch (usartn) {
-      case USART0:
-         UBRR0H = (char) baudrate >> 8; // set baud rate
-         UBRR0L = (char) baudrate;
-         UCSR0A &= ~(U2X0 | MPCM0); // 1x speed, disable multi mcu mode
-         UCSR0B = (1 << RXEN0) | (1 << TXEN0); // enable rx and tx
-         UCSR0C = (1 << UCSZ00) // 8 data bits
+   *port->ucsrb = 0; // stop the port while it is reconfigured
+   port->rxhead = port->rxtail = 0;
+   port->txhead = port->txtail = 0;
+
+   port->rts = NULL;
+   port->cts = NULL;
+   if (config->rts) {
+      setupPin(config->rts, config->rts_bit, 1);
+      port->rts = PORT_OF(config->rts);
+      port->rtsmask = 1 << config->rts_bit;
+   }
+   if (config->cts) {
+      setupPin(config->cts, config->cts_bit, 0);
+      port->cts = config->cts;
+      port->ctsmask = 1 << config->cts_bit;
+   }
+
+   *port->ubrrh = (char) (ubrr >> 8); // set baud rate
+   *port->ubrrl = (char) ubrr;
+   *port->ucsra = (u2x << U2X0); // speed mode, no multi mcu
+   *port->ucsrc = (1 << UCSZ00) // 8 data bits
                 | (1 << UCSZ01) // 8 data bits
                 | (0 << UPM00)  // no parity generation
                 | (0 << USBS0); // 1 stop bit
-         break;
+   *port->ucsrb = (1 << RXEN0) | (1 << TXEN0) // enable rx and tx
+                | (1 << RXCIE0);              // rx complete interrupt
 
-      case USART1:
-         UBRR1H = (char) baudrate >> 8; // set baud rate
-         UBRR1L = (char) baudrate;
-         UCSR1A &= ~(U2X1 | MPCM1); // 1x speed, disable multi mcu mode
-         UCSR1B = (1 << RXEN1) | (1 << TXEN1); // enable rx and tx
-         UCSR1C = (1 << UCSZ10) // 8 data bits
-                | (1 << UCSZ11) // 8 data bits
-                | (0 << UPM10)  // no parity generation
-                | (0 << USBS1); // 1 stop bit
-         break;
+   return 0;
+}
 
-      case USART2:
-         UBRR2H = (char) baudrate >> 8; // set baud rate
-         UBRR2L = (char) baudrate;
-         UCSR2A &= ~(U2X2 | MPCM2); // 1x speed, disable multi mcu mode
-         UCSR2B = (1 << RXEN2) | (1 << TXEN2); // enable rx and tx
-         UCSR2C = (1 << UCSZ20) // 8 data bits
-                | (1 << UCSZ21) // 8 data bits
-                | (0 << UPM20)  // no parity generation
-                | (0 << USBS2); // 1 stop bit
-         break;
+uint32_t getSerialBaud(uint8_t usartn, int16_t *error)
+{
+   struct serial_port *port = getPort(usartn);
 
-      case USART3:
-         UBRR3H = (char) baudrate >> 8; // set baud rate
-         UBRR3L = (char) baudrate;
-         UCSR3A &= ~(U2X3 | MPCM3); // 1x speed, disable multi mcu mode
-         UCSR3B = (1 << RXEN3) | (1 << TXEN3); // enable rx and tx
-         UCSR3C = (1 << UCSZ30) // 8 data bits
-                | (1 << UCSZ31) // 8 data bits
-                | (0 << UPM30)  // no parity generation
-                | (0 << USBS3); // 1 stop bit
-         break;
+   if (!port)
+      return 0;
 
-      default:
-         break;
-   }
+   if (error)
+      *error = port->error;
+
+   return port->baudrate;
+}
+
+void serialCtsChanged(uint8_t usartn)
+{
+   struct serial_port *port = getPort(usartn);
+
+   if (port && port->txhead != port->txtail && !ctsBlocked(port))
+      *port->ucsrb |= (1 << UDRIE0);
 }
 
 int canRead(uint8_t usartn)
 {
-   switch (usartn) {
-      case USART0: return UCSR0A & (1 << RXC0);
-      case USART1: return UCSR1A & (1 << RXC1);
-      case USART2: return UCSR2A & (1 << RXC2);
-      case USART3: return UCSR3A & (1 << RXC3);
-      default: return 0;
-   }
+   struct serial_port *port = getPort(usartn);
+
+   return port && port->rxhead != port->rxtail;
 }
 
 int canWrite(uint8_t usartn)
 {
-   switch (usartn) {
-      case USART0: return UCSR0A & (1 << UDRE0);
-      case USART1: return UCSR1A & (1 << UDRE1);
-      case USART2: return UCSR2A & (1 << UDRE2);
-      case USART3: return UCSR3A & (1 << UDRE3);
-      default: return 0;
-   }
+   struct serial_port *port = getPort(usartn);
+
+   return port && ((port->txhead + 1) & TXMASK) != port->txtail;
 }
 
 int readByte_nonblocking(char *dst, uint8_t usartn)
 {
-   if (canRead(usartn)) {
-      *dst = __readByte(usartn);
+   struct serial_port *port = getPort(usartn);
+
+   if (port && ringRead(port, dst, 1))
       return 0;
-   }
 
    return -1;
 }
 
 int writeByte_nonblocking(char byte, uint8_t usartn)
 {
-   if (canWrite(usartn)) {
-      __writeByte(byte, usartn);
+   struct serial_port *port = getPort(usartn);
+
+   if (port && ringWrite(port, &byte, 1))
       return 0;
-   }
 
    return -1;
 }
 
 void readByte_blocking(char *dst, uint8_t usartn)
 {
-   while (readByte_nonblocking(dst, usartn));
+   readBytes_timeout(dst, 1, SERIAL_WAIT_FOREVER, usartn);
 }
 
 void writeByte_blocking(char byte, uint8_t usartn)
 {
-   while (writeByte_nonblocking(byte, usartn));
+   writeBytes_timeout(&byte, 1, SERIAL_WAIT_FOREVER, usartn);
 }
 
 int readBytes(char *dst, uint16_t bytes, uint8_t usartn)
 {
+   return readBytes_timeout(dst, bytes, SERIAL_TIMEOUT, usartn);
+}
+
+int writeBytes(char *src, uint16_t bytes, uint8_t usartn)
+{
+   return writeBytes_timeout(src, bytes, SERIAL_TIMEOUT, usartn);
+}
+
+int readBytes_timeout(char *dst, uint16_t bytes, uint16_t timeout,
+                      uint8_t usartn)
+{
+   struct serial_port *port = getPort(usartn);
    uint16_t bytesRead = 0;
-   uint16_t attempts = 0;
+   uint16_t count;
 
-   while (bytes != 0 && ++attempts <= NUMATTEMPTS) {
-      if (!readByte_nonblocking(&dst[bytesRead], usartn)) {
-         attempts = 0;
-         bytes--;
-         bytesRead++;
-      }
+   if (!port)
+      return 0;
+
+   while (bytesRead < bytes) {
+      count = ringRead(port, &dst[bytesRead], bytes - bytesRead);
+      bytesRead += count;
+
+      // Sleep until the rx isr stores another byte. A give left over from
+      // bytes that were already copied only costs one more pass.
+      if (!count && (!timeout
+            || xSemaphoreTake(port->rxsem, toTicks(timeout)) != pdTRUE))
+         break;
    }
 
    return bytesRead;
 }
 
-int writeBytes(char *src, uint16_t bytes, uint8_t usartn)
+int writeBytes_timeout(const char *src, uint16_t bytes, uint16_t timeout,
+                       uint8_t usartn)
 {
+   struct serial_port *port = getPort(usartn);
    uint16_t bytesWritten = 0;
-   uint16_t attempts = 0;
+   uint16_t count;
 
-   while (bytes != 0 && ++attempts <= NUMATTEMPTS) {
-      if (!writeByte_nonblocking(src[bytesWritten], usartn)) {
-         attempts = 0;
-         bytes--;
-         bytesWritten++;
-      }
+   if (!port || xSemaphoreTake(port->txlock, toTicks(timeout)) != pdTRUE)
+      return 0;
+
+   while (bytesWritten < bytes) {
+      count = ringWrite(port, &src[bytesWritten], bytes - bytesWritten);
+      bytesWritten += count;
+
+      // Sleep until the udre isr frees some space
+      if (!count && (!timeout
+            || xSemaphoreTake(port->txsem, toTicks(timeout)) != pdTRUE))
+         break;
    }
 
+   xSemaphoreGive(port->txlock);
+
    return bytesWritten;
 }
 
 void flushSerial(uint8_t usartn)
 {
-   volatile char null;
+   struct serial_port *port = getPort(usartn);
 
-   while (canRead(usartn))
-      null = __readByte(usartn);
+   if (port)
+      port->rxtail = port->rxhead;
 }
@@ -13,8 +13,42 @@
 #define USART2 2
 #define USART3 3
 
+// Ring buffer sizes per port, powers of two no larger than 256
+#define SERIAL_RXBUFF_SZ 128
+#define SERIAL_TXBUFF_SZ 64
+
+// With rts flow control the far end is told to pause once this many bytes are
+// waiting in the rx buffer, and to resume once it has drained to
+// SERIAL_RTS_LOW
+#define SERIAL_RTS_HIGH (SERIAL_RXBUFF_SZ * 3 / 4)
+#define SERIAL_RTS_LOW  (SERIAL_RXBUFF_SZ / 4)
+
+// Inactivity timeout (ms) used by readBytes and writeBytes
+#define SERIAL_TIMEOUT 10
+
+// Timeout value that makes the _timeout calls wait indefinitely
+#define SERIAL_WAIT_FOREVER 0xFFFF
+
+/*
+ * Port settings for setupSerialConfig. Flow control pins are given by their
+ * PINx register and bit, e.g. &PINE and 4 for PE4, and are left unused when
+ * the register is NULL. Both lines are active low: rts is driven low while
+ * this end can receive and the far end pulls cts low while it can.
+ */
+struct serial_config {
+   uint32_t baudrate;
+   volatile uint8_t *rts;
+   uint8_t rts_bit;
+   volatile uint8_t *cts;
+   uint8_t cts_bit;
+};
+
 /*
- * @brief Sets up the serial interface for communication.
+ * @brief Sets up the serial interface for communication. The port is driven
+ * by its rx complete and data register empty interrupts, which move bytes
+ * between the hardware and a pair of ring buffers allocated from the FreeRTOS
+ * heap on the first call. Interrupts are enabled when the scheduler starts, so
+ * at most SERIAL_TXBUFF_SZ bytes may be written before that.
  *
  * @param baudrate - The baudrate the serial device will use for read/write.
  * @param usartn   - The enumerated usart port
@@ -22,7 +56,39 @@
 void setupSerial(uint32_t baudrate, uint8_t usartn);
 
 /*
- * @brief Checks if data can be read from the serial port.
+ * @brief Sets up the serial interface like setupSerial, with optional RTS/CTS
+ * flow control. The baud divisor is rounded and the double speed (U2X) mode
+ * used whenever that brings the rate closer to the one requested, so rates up
+ * to F_CPU / 8 can be asked for; check the result with getSerialBaud.
+ *
+ * @param config   - Baudrate and flow control pins
+ * @param usartn   - The enumerated usart port
+ * @return 0 on success, -1 if the port could not be set up.
+ */
+int setupSerialConfig(const struct serial_config *config, uint8_t usartn);
+
+/*
+ * @brief Reports the baudrate a port actually runs at. Receivers generally
+ * tolerate an error of about 2%.
+ *
+ * @param usartn   - The enumerated usart port
+ * @param error    - If not NULL, receives the error relative to the requested
+ *                   rate in hundredths of a percent
+ * @return the achieved baudrate, or 0 if the port is not set up.
+ */
+uint32_t getSerialBaud(uint8_t usartn, int16_t *error);
+
+/*
+ * @brief Restarts transmission held back by cts. Call it from the pin change
+ * interrupt of the cts pin, or periodically; a blocked transmitter otherwise
+ * only resumes on the next write to the port.
+ *
+ * @param usartn   - The enumerated usart port
+ */
+void serialCtsChanged(uint8_t usartn);
+
+/*
+ * @brief Checks if received data is waiting in the rx buffer.
  *
  * @param usartn   - The enumerated usart port
  * @return 1 if data can be read, 0 if not.
@@ -30,7 +96,7 @@ void setupSerial(uint32_t baudrate, uint8_t usartn);
 int canRead(uint8_t usartn);
 
 /*
- * @brief Checks if data can be written to the serial port.
+ * @brief Checks if the tx buffer has room for another byte.
  *
  * @param usartn   - The enumerated usart port
  * @return 1 if data can be written, 0 if not.
@@ -39,7 +105,7 @@ int canWrite(uint8_t usartn);
 
 /*
  * @brief Reads a byte into the 8 bit field pointed to by dst. This call may
- * fail if the serial port is unavailable.
+ * fail if no data has been received.
  *
  * @param dst - Pointer to destination of read byte.
  * @param usartn   - The enumerated usart port
@@ -49,7 +115,7 @@ int readByte_nonblocking(char *dst, uint8_t usartn);
 
 /*
  * @brief Writes a byte from the 8 bit parameter to the serial line. This call
- * may fail if the serial port is unavailable.
+ * may fail if the tx buffer is full.
  *
  * @param dst - Byte to write.
  * @param usartn   - The enumerated usart port
@@ -60,7 +126,7 @@ int writeByte_nonblocking(char byte, uint8_t usartn);
 /*
  * @brief Reads a byte into the 8 bit field pointed to by dst. This is a
  * blocking version of readBye_nonblocking. This function cannot fail, but may
- * block indefinitely.
+ * block indefinitely. The calling task sleeps until the rx interrupt wakes it.
  *
  * @param dst - Pointer to destination of read byte.
  * @param usartn   - The enumerated usart port
@@ -70,7 +136,7 @@ void readByte_blocking(char *dst, uint8_t usartn);
 /*
  * @brief Writes a byte from the 8 bit parameter to the serial line. This is a
  * blocking version of writeByte_nonblocking. This function cannot fail, but may
- * block indefinitely.
+ * block indefinitely. The calling task sleeps while the tx buffer is full.
  *
  * @param dst - Byte to write.
  * @param usartn   - The enumerated usart port
@@ -78,8 +144,8 @@ void readByte_blocking(char *dst, uint8_t usartn);
 void writeByte_blocking(char byte, uint8_t usartn);
 
 /*
- * @breif Reads an array of bytes from the serial line. This uses non blocking
- * read calls, and will fail if the resource becomes unavailable.
+ * @breif Reads an array of bytes from the serial line. Gives up once no byte
+ * has arrived for SERIAL_TIMEOUT ms.
  *
  * @param dst - Pointer to an destination array
  * @param bytes - The number of bytes to read
@@ -89,8 +155,8 @@ void writeByte_blocking(char byte, uint8_t usartn);
 int readBytes(char *dst, uint16_t bytes, uint8_t usartn);
 
 /*
- * @breif Write an array of bytes to the serial line. This uses non blocking
- * write calls, and will fail if the resource becomes unavailable.
+ * @breif Write an array of bytes to the serial line. Gives up once the tx
+ * buffer has stayed full for SERIAL_TIMEOUT ms.
  *
  * @param dst - Pointer to an source array
  * @param bytes - The number of bytes to write
@@ -100,7 +166,36 @@ int readBytes(char *dst, uint16_t bytes, uint8_t usartn);
 int writeBytes(char *src, uint16_t bytes, uint8_t usartn);
 
 /*
- * @brief Flushes the rx serial buffer
+ * @brief Reads up to bytes bytes, copying whole runs out of the rx buffer and
+ * sleeping while it is empty. Gives up once no byte has arrived for timeout
+ * ms. A timeout of 0 only copies what is already buffered.
+ *
+ * @param dst - Pointer to an destination array
+ * @param bytes - The number of bytes to read
+ * @param timeout - Inactivity timeout in ms, or SERIAL_WAIT_FOREVER
+ * @param usartn   - The enumerated usart port
+ * @return the number of bytes read
+ */
+int readBytes_timeout(char *dst, uint16_t bytes, uint16_t timeout,
+                      uint8_t usartn);
+
+/*
+ * @brief Writes up to bytes bytes, copying whole runs into the tx buffer and
+ * sleeping while it is full. Writers to the same port are serialized, so the
+ * bytes of one call are never interleaved with another task's. Gives up once
+ * the buffer has stayed full for timeout ms.
+ *
+ * @param src - Pointer to an source array
+ * @param bytes - The number of bytes to write
+ * @param timeout - Inactivity timeout in ms, or SERIAL_WAIT_FOREVER
+ * @param usartn   - The enumerated usart port
+ * @return the number of bytes written
+ */
+int writeBytes_timeout(const char *src, uint16_t bytes, uint16_t timeout,
+                       uint8_t usartn);
+
+/*
+ * @brief Discards all received bytes that have not been read yet
  *
  * @param usartn   - The enumerated usart port
  */
@@ -0,0 +1,162 @@
+/*
+ * @file frame.c
+ * @brief COBS framing with a crc16_ccitt check, see frame.h.
+ *
+ * COBS replaces every zero in the data with the distance to the next one: a
+ * code byte n is followed by n - 1 data bytes and then an implied zero, except
+ * that code 0xFF has no implied zero and the zero implied at the very end of
+ * the frame is dropped. The crc is sent high byte first, so running
+ * crc16_ccitt over payload and crc together gives 0 for a good frame.
+ */
+
+#include <stdint.h>
+#include <lib_crc.h>
+#include "frame.h"
+
+#define MAX_BLOCK 0xFF
+
+static void resetRx(struct frame_rx *rx)
+{
+   rx->len = 0;
+   rx->code = 0;
+   rx->zero = 0;
+   rx->overflow = 0;
+}
+
+static void putRx(struct frame_rx *rx, uint8_t byte)
+{
+   if (rx->len < rx->size)
+      rx->buff[rx->len++] = byte;
+   else
+      rx->overflow = 1;
+}
+
+void frame_rx_init(struct frame_rx *rx, uint8_t *buff, uint16_t size,
+                   frame_callback callback, void *arg)
+{
+   rx->buff = buff;
+   rx->size = size;
+   rx->callback = callback;
+   rx->arg = arg;
+   rx->frames = 0;
+   rx->errors = 0;
+   resetRx(rx);
+}
+
+int frame_rx_byte(struct frame_rx *rx, uint8_t byte)
+{
+   uint16_t len;
+
+   if (byte != FRAME_DELIM) {
+      if (rx->code) {
+         putRx(rx, byte);
+         rx->code--;
+      } else {
+         // Start of a block, emit the zero the previous block implied
+         if (rx->zero)
+            putRx(rx, 0);
+         rx->code = byte - 1;
+         rx->zero = (byte != MAX_BLOCK);
+      }
+      return 0;
+   }
+
+   // Back to back delimiters are idle fill, not empty frames
+   if (!rx->len && !rx->code && !rx->zero)
+      return 0;
+
+   len = rx->len;
+   if (rx->code || rx->overflow || len < FRAME_CRC_SZ
+         || crc16_ccitt(rx->buff, len) != 0) {
+      rx->errors++;
+      resetRx(rx);
+      return -1;
+   }
+
+   len -= FRAME_CRC_SZ;
+   rx->frames++;
+   resetRx(rx);
+   if (rx->callback)
+      rx->callback(rx->buff, len, rx->arg);
+
+   return len;
+}
+
+uint8_t frame_rx_bytes(struct frame_rx *rx, const uint8_t *data,
+                       uint16_t bytes)
+{
+   uint8_t count = 0;
+
+   while (bytes--) {
+      if (frame_rx_byte(rx, *data++) > 0)
+         count++;
+   }
+
+   return count;
+}
+
+int frame_decode(uint8_t *buff, uint16_t bytes)
+{
+   uint16_t src = 0, dst = 0;
+   uint8_t code, zero = 0;
+
+   if (bytes && buff[bytes - 1] == FRAME_DELIM)
+      bytes--;
+
+   // The decoded data never overtakes the encoded data, so decode in place
+   while (src < bytes) {
+      if (zero)
+         buff[dst++] = 0;
+
+      code = buff[src++];
+      if (code == FRAME_DELIM || src + code - 1 > bytes)
+         return -1;
+
+      zero = (code != MAX_BLOCK);
+      while (--code)
+         buff[dst++] = buff[src++];
+   }
+
+   if (dst < FRAME_CRC_SZ || crc16_ccitt(buff, dst) != 0)
+      return -1;
+
+   return dst - FRAME_CRC_SZ;
+}
+
+uint16_t frame_encode(const uint8_t *payload, uint16_t len, uint8_t *dst,
+                      uint16_t size)
+{
+   uint16_t crc = crc16_ccitt(payload, len);
+   uint16_t ndx, out = 1, codeAt = 0;
+   uint8_t byte, code = 1;
+
+   if (size < FRAME_ENCODED_SZ(len))
+      return 0;
+
+   // Payload then crc, high byte first
+   for (ndx = 0; ndx < len + FRAME_CRC_SZ; ndx++) {
+      if (ndx < len)
+         byte = payload[ndx];
+      else if (ndx == len)
+         byte = crc >> 8;
+      else
+         byte = crc & 0xFF;
+
+      if (byte) {
+         dst[out++] = byte;
+         code++;
+      }
+
+      // Close the block on a zero, or when it is as long as a block can be
+      if (!byte || code == MAX_BLOCK) {
+         dst[codeAt] = code;
+         codeAt = out++;
+         code = 1;
+      }
+   }
+
+   dst[codeAt] = code;
+   dst[out++] = FRAME_DELIM;
+
+   return out;
+}
@@ -0,0 +1,103 @@
+/*
+ * @file frame.h
+ * @brief packet framing for byte streams such as a usart. Each frame carries
+ * a payload followed by its crc16_ccitt, is COBS encoded so that it contains
+ * no zero bytes, and ends with a single zero byte. A receiver that loses or
+ * corrupts a byte discards one frame and is back in step at the next zero.
+ */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+#include <stdint.h>
+
+// Frame delimiter, never present inside an encoded frame
+#define FRAME_DELIM 0x00
+
+// Bytes of crc carried after the payload
+#define FRAME_CRC_SZ 2
+
+// Encoded size of a payload of n bytes, including crc and delimiter
+#define FRAME_ENCODED_SZ(n) ((n) + FRAME_CRC_SZ + ((n) + FRAME_CRC_SZ) / 254 + 2)
+
+/*
+ * @brief Called with each frame that decoded and passed its crc check. The
+ * payload is in the buffer given to frame_rx_init and is only valid until the
+ * callback returns.
+ */
+typedef void (*frame_callback)(uint8_t *payload, uint16_t len, void *arg);
+
+// Decoder state, one per byte stream
+struct frame_rx {
+   uint8_t *buff;           // Caller buffer the payload is decoded into
+   uint16_t size;           // Size of buff, payload plus FRAME_CRC_SZ
+   uint16_t len;            // Bytes decoded into buff so far
+   uint8_t code;            // Data bytes left in the current COBS block
+   uint8_t zero;            // A zero follows the current block
+   uint8_t overflow;        // The frame did not fit in buff
+   frame_callback callback;
+   void *arg;
+   uint16_t frames;         // Good frames delivered
+   uint16_t errors;         // Frames dropped for overflow, truncation or crc
+};
+
+/*
+ * @brief Prepares a decoder. Frames are decoded straight into buff as bytes
+ * arrive, without an intermediate copy.
+ *
+ * @param rx       - Decoder state
+ * @param buff     - Buffer for the largest payload plus FRAME_CRC_SZ bytes
+ * @param size     - Size of buff
+ * @param callback - Receives each good frame, may be NULL when frame_rx_byte
+ *                   is polled instead
+ * @param arg      - Passed through to callback
+ */
+void frame_rx_init(struct frame_rx *rx, uint8_t *buff, uint16_t size,
+                   frame_callback callback, void *arg);
+
+/*
+ * @brief Feeds one received byte to a decoder. When the byte completes a good
+ * frame the callback, if any, is called before this returns.
+ *
+ * @param rx   - Decoder state
+ * @param byte - Received byte
+ * @return the payload length when a good frame completed, 0 while a frame is
+ * in progress, -1 when a bad frame was dropped.
+ */
+int frame_rx_byte(struct frame_rx *rx, uint8_t byte);
+
+/*
+ * @brief Feeds a run of received bytes to a decoder, e.g. everything a
+ * readBytes call returned, calling the callback for each good frame in it.
+ *
+ * @param rx    - Decoder state
+ * @param data  - Received bytes
+ * @param bytes - Number of bytes
+ * @return the number of good frames completed.
+ */
+uint8_t frame_rx_bytes(struct frame_rx *rx, const uint8_t *data,
+                       uint16_t bytes);
+
+/*
+ * @brief Decodes and checks a whole received frame in place, for transports
+ * that already deliver one frame at a time (e.g. a UDP datagram).
+ *
+ * @param buff  - Encoded frame, with or without its trailing delimiter
+ * @param bytes - Number of encoded bytes
+ * @return the payload length, left at the start of buff, or -1 if the frame is
+ * malformed or fails its crc check.
+ */
+int frame_decode(uint8_t *buff, uint16_t bytes);
+
+/*
+ * @brief Encodes a payload into a frame, ready to be written out as is.
+ *
+ * @param payload - Payload bytes
+ * @param len     - Payload length
+ * @param dst     - Destination, FRAME_ENCODED_SZ(len) bytes is always enough
+ * @param size    - Size of dst
+ * @return the number of bytes to send, or 0 if dst is too small.
+ */
+uint16_t frame_encode(const uint8_t *payload, uint16_t len, uint8_t *dst,
+                      uint16_t size);
+
+#endif
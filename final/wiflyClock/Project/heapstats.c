@@ -0,0 +1,105 @@
+/*
+ * @file heapstats.c
+ * @brief serial report of the FreeRTOS heap instrumentation. Requires a heap
+ *        built with configUSE_HEAP_STATS set to 1.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "heapstats.h"
+#include "serial.h"
+
+#if (configUSE_HEAP_STATS != 1)
+#error configUSE_HEAP_STATS must be set to 1 to compile heapstats.c
+#endif
+
+#define LINE_SZ 48
+
+static void writeLine(const char *line, uint8_t usartn)
+{
+   writeBytes((char *) line, strlen(line), usartn);
+}
+
+void heapstats_dump(uint8_t usartn)
+{
+   xHeapStats stats;
+   char line[LINE_SZ];
+   uint16_t limit = 8;
+   uint8_t ndx;
+
+   vPortGetHeapStats(&stats);
+
+   snprintf(line, LINE_SZ, "heap - free %u min %u\r\n",
+            (unsigned) stats.xFreeBytesRemaining,
+            (unsigned) stats.xMinimumEverFreeBytesRemaining);
+   writeLine(line, usartn);
+   snprintf(line, LINE_SZ, "heap - largest %u blocks %u\r\n",
+            (unsigned) stats.xLargestFreeBlock,
+            (unsigned) stats.xFreeBlockCount);
+   writeLine(line, usartn);
+   snprintf(line, LINE_SZ, "heap - mallocs %lu frees %lu failed %lu\r\n",
+            stats.ulAllocations, stats.ulFrees, stats.ulFailedAllocations);
+   writeLine(line, usartn);
+
+   // Size histogram, the last class has no upper limit
+   for (ndx = 0; ndx < portHEAP_SIZE_CLASSES; ndx++, limit <<= 1) {
+      if (ndx < portHEAP_SIZE_CLASSES - 1)
+         snprintf(line, LINE_SZ, "heap - <=%u: %u\r\n", limit,
+                  stats.usSizeClass[ndx]);
+      else
+         snprintf(line, LINE_SZ, "heap - >%u: %u\r\n", limit >> 1,
+                  stats.usSizeClass[ndx]);
+      writeLine(line, usartn);
+   }
+
+#if (configHEAP_DEBUG == 1)
+   {
+      xHeapSiteStats sites[configHEAP_DEBUG_SITES];
+      unsigned portBASE_TYPE count;
+
+      count = uxPortGetHeapSiteStats(sites, configHEAP_DEBUG_SITES);
+      for (ndx = 0; ndx < count; ndx++) {
+         snprintf(line, LINE_SZ, "heap - site 0x%04x live %u mallocs %lu\r\n",
+                  (unsigned) sites[ndx].pvCaller,
+                  (unsigned) sites[ndx].xLiveBytes, sites[ndx].ulAllocations);
+         writeLine(line, usartn);
+      }
+   }
+#endif
+
+#if (configHEAP_TASK_STATS == 1)
+   {
+      // Static to keep it off the console task's stack
+      static xHeapTaskStats tasks[configHEAP_TASK_SLOTS];
+      const char *name;
+
+      vPortGetHeapTaskStats(tasks);
+      for (ndx = 0; ndx < configHEAP_TASK_SLOTS; ndx++) {
+         if (!tasks[ndx].xPeakBytes && !tasks[ndx].usRefused)
+            continue;
+
+         // Slot 0 is startup, the overflow slot has no task handle
+         if (ndx == 0)
+            name = "startup";
+         else if (tasks[ndx].pvTask == NULL)
+            name = "other";
+         else
+            name = (const char *) pcTaskGetTaskName(tasks[ndx].pvTask);
+
+         snprintf(line, LINE_SZ, "heap - %.8s live %u peak %u\r\n", name,
+                  (unsigned) tasks[ndx].xLiveBytes,
+                  (unsigned) tasks[ndx].xPeakBytes);
+         writeLine(line, usartn);
+
+         if (tasks[ndx].xQuota) {
+            snprintf(line, LINE_SZ, "heap - %.8s quota %u refused %u\r\n",
+                     name, (unsigned) tasks[ndx].xQuota,
+                     tasks[ndx].usRefused);
+            writeLine(line, usartn);
+         }
+      }
+   }
+#endif
+}
@@ -0,0 +1,24 @@
+/*
+ * @file heapstats.h
+ * @brief serial report of the FreeRTOS heap instrumentation
+ */
+
+#ifndef _HEAPSTATS_H
+#define _HEAPSTATS_H
+#include <stdint.h>
+
+/*
+ * @brief Writes the heap counters to a serial port: free bytes, the minimum
+ * ever free bytes, the largest free block, the free block count, allocation
+ * and free counts and the requested size histogram. When the heap is built
+ * with configHEAP_DEBUG the live bytes per pvPortMalloc call site are listed
+ * too. Call sites are return addresses, which are word addresses on the AVR;
+ * double them to look them up in the disassembly. With configHEAP_TASK_STATS
+ * the live and peak bytes of each task are listed, with any quota and the
+ * number of allocations it refused.
+ *
+ * @param usartn   - The enumerated usart port
+ */
+void heapstats_dump(uint8_t usartn);
+
+#endif
@@ -9,16 +9,17 @@
 #include "lcd.h"
 #include "wifly.h"
 #include "serial.h"
+#include "heapstats.h"
+#include "frame.h"
+#include "proto.h"
 
-// Definitions for event system
-#define EVENT_CLEAR    0
-#define EVENT_TOGGLE   1
-#define EVENT_WRITE    2
-#define EVENT_COLOR    3
+// Definitions for event system, event types are in proto.h
 #define COLOR_REDNDX   0
 #define COLOR_GREENNDX 1
 #define COLOR_BLUENDX  2
 #define DATSIZE        16
+#define RECEIVE_QUOTA  1024 // Heap bytes the receive task may hold (~30 events)
+#define DATAGRAM_GAP   5    // ms of quiet that ends a datagram's bytes
 
 typedef const signed char * cscp;
 
@@ -36,7 +37,7 @@ struct ScheduledEvent {
    uint8_t eventType;      // Type of event
    uint8_t line;           // [write events] line to write to
    uint8_t bytes;          // [write events] number of bytes to write
-   char eventdat[DATSIZE]; // [write] bytes to write, [color] colors
+   char eventdat[DATSIZE]; // [write] bytes to write, [color] red, green, blue
    struct ScheduledEvent *next; // Pointer to next node
 };
 
@@ -54,6 +55,12 @@ static xSemaphoreHandle clockStateSem;
 struct ClockState clockState;
 struct wifly wf;
 
+// Last packet applied, so that a retransmission is only acked again. Held
+// until the link has been quiet for PROTO_SEQ_HOLD_MS.
+static uint8_t haveSeq;
+static uint8_t lastSeq;
+static uint8_t lastStatus;
+
 // Change the LCD's color, protected by semaphore
 static void changeColor(uint8_t red, uint8_t green, uint8_t blue)
 {
@@ -124,57 +131,28 @@ static void setTime(uint16_t year, uint8_t month, uint8_t day,
    xSemaphoreGive(clockStateSem);
 }
 
-// Convert a single hexidecimal character to uint8_t
-static uint8_t ctoi(char src)
-{
-   if (src >= '0' && src <= '9')
-      return src - '0';
-   else if (src >= 'A' && src <= 'F')
-      return src - 'A' + 10;
-   else if (src >= 'a' && src <= 'f')
-      return src - 'a' + 10;
-   else return 0;
-}
-
-// Convert two digit hexidecimal value to uint8_t
-static uint8_t atoiX8(char *src)
+// Reads a protocol time, year (big endian), month, day, hour, min and sec.
+// Returns 0, or -1 if a field is out of range.
+static int readTime(struct Time *time, const uint8_t *src)
 {
-   uint8_t ans = 0;
-
-   ans += ctoi(src[1]);
-   ans += 16*ctoi(src[0]);
+   time->year = (uint16_t) src[0] << 8 | src[1];
+   time->month = src[2];
+   time->day = src[3];
+   time->hour = src[4];
+   time->min = src[5];
+   time->sec = src[6];
+
+   if (time->month < 1 || time->month > 12 || time->day < 1
+         || time->day > 31 || time->hour > 23 || time->min > 59
+         || time->sec > 59)
+      return -1;
 
-   return ans;
-}
-
-// Convert two digit decimal value to uint8_t
-static uint8_t atoiD8(char *src)
-{
-   uint8_t ans = 0;
-
-   ans += ctoi(src[1]);
-   ans += 10*ctoi(src[0]);
-
-   return ans;
-}
-
-// Convert two digit decimal value to uint8_t
-static uint16_t atoiD16(char *src)
-{
-   uint16_t ans = 0;
-
-
-
-   ans += ctoi(src[3]);
-   ans += 10*ctoi(src[2]);
-   ans += 10*10*ctoi(src[1]);
-   ans += 10*10*10*ctoi(src[0]);
-
-   return ans;
+   return 0;
 }
 
-// Time argument is in seconds since epoch
-static void addEvent(struct Time *time, uint8_t type, char *eventdat,
+// Time argument is in seconds since epoch. Returns 0, or -1 if the event
+// could not be stored.
+static int addEvent(struct Time *time, uint8_t type, char *eventdat,
                         uint8_t line, uint8_t bytes)
 {
    struct ScheduledEvent *newEvent;
@@ -182,6 +160,12 @@ static void addEvent(struct Time *time, uint8_t type, char *eventdat,
    newEvent = (struct ScheduledEvent *) pvPortMalloc(
                                                  sizeof(struct ScheduledEvent));
 
+   // Out of heap, or the receive task's quota is used up. Drop the event.
+   if (!newEvent) {
+      writeBytes("$SCH full\r\n", 11, USART0);
+      return -1;
+   }
+
    newEvent->time.sec = time->sec;
    newEvent->time.min = time->min;
    newEvent->time.hour = time->hour;
@@ -198,6 +182,8 @@ static void addEvent(struct Time *time, uint8_t type, char *eventdat,
    newEvent->next = clockState.evtList;
    clockState.evtList = newEvent;
    xSemaphoreGive(clockStateSem);
+
+   return 0;
 }
 
 // Check a specific event to see if it should occur, if so, return 1, else 0
@@ -243,9 +229,9 @@ static void checkEvents()
 
             case EVENT_COLOR:
                writeBytes("SCOL\r\n", 6, USART0);
-               changeColor(atoiX8(&iter->eventdat[0]),
-                              atoiX8(&iter->eventdat[2]),
-                              atoiX8(&iter->eventdat[4]));
+               changeColor((uint8_t) iter->eventdat[0],
+                           (uint8_t) iter->eventdat[1],
+                           (uint8_t) iter->eventdat[2]);
                break;
 
             default:
@@ -413,12 +399,42 @@ void ClockTask(void *args)
    }
 }
 
-// UART rx/tx poll task
-void UARTTask(void *args) 
+// Writes the rate each serial port achieved and its error from the requested
+// rate to the debug port
+static void baudDump(void)
+{
+   char line[40];
+   uint32_t baud;
+   int16_t error;
+   unsigned mag;
+   uint8_t usartn;
+
+   for (usartn = USART0; usartn <= USART3; usartn++) {
+      if (!(baud = getSerialBaud(usartn, &error)))
+         continue;
+      mag = error < 0 ? -error : error;
+      snprintf(line, sizeof(line), "baud - usart%u %lu err %c%u.%02u%%\r\n",
+               usartn, baud, error < 0 ? '-' : '+', mag / 100, mag % 100);
+      writeBytes(line, strlen(line), USART0);
+   }
+}
+
+// Debug console task. Typing 'h' on the debug port dumps the heap statistics,
+// 'b' the serial port rates. 'w' makes the next boot configure the wifly again.
+void ConsoleTask(void *args)
 {
+   char cmd;
+
    while (1) {
-      wifly_uart_rx_tx(&wf); // Poll the UART rx/tx buffer
-      vTaskDelay(0); // Allow this task to yeild
+      readByte_blocking(&cmd, USART0);
+      if (cmd == 'h' || cmd == 'H')
+         heapstats_dump(USART0);
+      else if (cmd == 'b' || cmd == 'B')
+         baudDump();
+      else if (cmd == 'w' || cmd == 'W') {
+         wifly_forget_config();
+         writeBytes("wifly - Config forgotten\r\n", 26, USART0);
+      }
    }
 }
 
@@ -431,99 +447,183 @@ void WiflyTask(void *args)
    }
 }
 
+// WIFLY transmit task. Coalesces queued messages into datagrams
+void WiflyTxTask(void *args)
+{
+   while (1)
+      wifly_send_queued(&wf);
+}
+
+// Command handlers. Each gets the bytes after its opcode, already checked
+// against the table's argument limits, and returns a PROTO_* status.
+
+static uint8_t cmdColor(uint8_t *args, uint8_t len)
+{
+   writeBytes("$COL\r\n", 6, USART0);
+   changeColor(args[0], args[1], args[2]);
+   return PROTO_OK;
+}
+
+static uint8_t cmdToggle(uint8_t *args, uint8_t len)
+{
+   writeBytes("$TOG\r\n", 6, USART0);
+   toggleONOFF();
+   return PROTO_OK;
+}
+
+static uint8_t cmdWrite(uint8_t *args, uint8_t len)
+{
+   char text[17];
+
+   if (args[0] > 1)
+      return PROTO_EARGS;
+
+   // writeDisplay terminates the text in place, so keep it off the packet
+   memcpy(text, &args[1], len - 1);
+   writeBytes("$WRT\r\n", 6, USART0);
+   writeDisplay(args[0], text, len - 1);
+   return PROTO_OK;
+}
+
+static uint8_t cmdClear(uint8_t *args, uint8_t len)
+{
+   writeBytes("$CLR\r\n", 6, USART0);
+   clearWrites();
+   return PROTO_OK;
+}
+
+static uint8_t cmdTime(uint8_t *args, uint8_t len)
+{
+   struct Time time;
+
+   if (readTime(&time, args))
+      return PROTO_EARGS;
+
+   writeBytes("$TIM\r\n", 6, USART0);
+   setTime(time.year, time.month, time.day, time.hour, time.min, time.sec);
+   return PROTO_OK;
+}
+
+static uint8_t cmdSchedule(uint8_t *args, uint8_t len)
+{
+   struct Time time;
+   uint8_t type = args[7], line = args[8];
+
+   if (readTime(&time, args) || type > EVENT_COLOR
+         || (type == EVENT_COLOR && len - 9 != 3))
+      return PROTO_EARGS;
+
+   writeBytes("$SCH\r\n", 6, USART0);
+   if (addEvent(&time, type, (char *) &args[9], line, len - 9))
+      return PROTO_EFULL;
+   return PROTO_OK;
+}
+
+// Opcode dispatch table
+static const struct Command {
+   uint8_t opcode;
+   uint8_t minArgs; // Fewest bytes after the opcode
+   uint8_t maxArgs; // Most bytes after the opcode
+   uint8_t (*handler)(uint8_t *args, uint8_t len);
+} commands[] = {
+   {OP_COLOR, 3, 3, cmdColor},
+   {OP_TOGGLE, 0, 0, cmdToggle},
+   {OP_WRITE, 1, 17, cmdWrite},
+   {OP_CLEAR, 0, 0, cmdClear},
+   {OP_TIME, 7, 7, cmdTime},
+   {OP_SCHEDULE, 9, 9 + DATSIZE - 1, cmdSchedule},
+   {0, 0, 0, NULL}
+};
+
+// Runs each command of a packet in turn and returns the status to ack it
+// with, that of the first command that failed
+static uint8_t runPacket(uint8_t *packet, uint16_t len)
+{
+   const struct Command *cmd;
+   uint16_t ndx = PROTO_HEADER_SZ;
+   uint8_t cmdLen, result, status = PROTO_OK;
+
+   while (ndx < len) {
+      cmdLen = packet[ndx++];
+      if (!cmdLen || ndx + cmdLen > len)
+         return PROTO_ELENGTH;
+
+      for (cmd = commands; cmd->handler && cmd->opcode != packet[ndx]; cmd++)
+         ;
+
+      if (!cmd->handler)
+         result = PROTO_EOPCODE;
+      else if (cmdLen - 1 < cmd->minArgs || cmdLen - 1 > cmd->maxArgs)
+         result = PROTO_EARGS;
+      else
+         result = cmd->handler(&packet[ndx + 1], cmdLen - 1);
+
+      if (status == PROTO_OK)
+         status = result;
+      ndx += cmdLen;
+   }
+
+   return status;
+}
+
+// Frame callback for each packet that passed its crc check. Applies it,
+// unless it repeats the last seq, and acks it.
+static void onPacket(uint8_t *packet, uint16_t len, void *arg)
+{
+   uint8_t ack[3];
+   uint8_t frame[FRAME_ENCODED_SZ(sizeof(ack))];
+
+   if (len < PROTO_HEADER_SZ)
+      return;
+
+   ack[0] = PROTO_VERSION;
+   ack[1] = packet[1];
+
+   if (packet[0] != PROTO_VERSION) {
+      ack[2] = PROTO_EVERSION;
+   } else if (haveSeq && packet[1] == lastSeq) {
+      ack[2] = lastStatus;
+   } else {
+      ack[2] = runPacket(packet, len);
+      lastSeq = packet[1];
+      lastStatus = ack[2];
+      haveSeq = 1;
+   }
+
+   wifly_transmit(&wf, (char *) frame,
+                  frame_encode(ack, sizeof(ack), frame, sizeof(frame)));
+}
+
 // Packet receive/handler task
 void ReceiveTask(void *args)
 {
+   struct frame_rx rx;
+   uint8_t packet[PROTO_MAX_PACKET + FRAME_CRC_SZ];
+   char buff[64];
    int cnt;
-   char buff[128];
+
+   frame_rx_init(&rx, packet, sizeof(packet), onPacket, NULL);
 
    while (1) {
 
-      // Receive command type bytes
-      if (3 == (cnt = wifly_receive(&wf, buff, 3))) {
-
-         // Color change command
-         if (!strncmp(buff, "COL", 3)) {
-            if (6 == (cnt = wifly_receive(&wf, buff, 6))) {
-               writeBytes("$COL", 4, USART0);
-               writeBytes(buff, cnt, USART0);
-               writeBytes("\r\n", 2, USART0);
-               changeColor(atoiX8(&buff[0]), atoiX8(&buff[2]), atoiX8(&buff[4]));
-            }
-
-         // Toggle display command
-         } else if (!strncmp(buff, "TOG", 3)) {
-            writeBytes("$TOG\r\n", 9, USART0);
-            toggleONOFF();
-
-         // Write display command
-         } else if (!strncmp(buff, "WRT", 3)) {
-            if (3 == (cnt = wifly_receive(&wf, buff, 3))) {
-               writeBytes("$WRT", 4, USART0);
-               writeBytes(buff, 3, USART0);
-               writeBytes("\r\n", 2, USART0);
-
-               uint8_t line = ctoi(buff[0]);
-               uint8_t bytes = atoiX8(&buff[1]);
-
-
-               if (bytes == (cnt = wifly_receive(&wf, buff, bytes))) {
-                  writeBytes(buff, bytes, USART0);
-                  writeDisplay(line, buff, bytes);
-               }
-            }
-
-         // Clear display command
-         } else if (!strncmp(buff, "CLR", 3)) {
-            writeBytes("$CLR\r\n", 6, USART0);
-            clearWrites();
-
-         // Change time command
-         } else if (!strncmp(buff, "TIM", 3)) {
-            if (14 == (cnt = wifly_receive(&wf, buff, 14))) {
-               writeBytes("$TIM", 4, USART0);
-               writeBytes(buff, 14, USART0);
-               writeBytes("\r\n", 2, USART0);
-
-               uint16_t year = atoiD16(&buff[0]);
-               uint8_t month = atoiD8(&buff[4]);
-               uint8_t day = atoiD8(&buff[6]);
-               uint8_t hour = atoiD8(&buff[8]);
-               uint8_t min = atoiD8(&buff[10]);
-               uint8_t second = atoiD8(&buff[12]);
-
-               setTime(year, month, day, hour, min, second);
-            }
-
-         } else if (!strncmp(buff, "SCH", 3)) {
-            if (17 == (cnt = wifly_receive(&wf, buff, 17))) {
-               writeBytes("$SCH", 4, USART0);
-               writeBytes(buff, 17, USART0);
-               writeBytes("\r\n", 2, USART0);
-
-               struct Time time;
-               time.year = atoiD16(&buff[0]);
-               time.month = atoiD8(&buff[4]);
-               time.day = atoiD8(&buff[6]);
-               time.hour = atoiD8(&buff[8]);
-               time.min = atoiD8(&buff[10]);
-               time.sec = atoiD8(&buff[12]);
-               uint8_t type = ctoi(buff[14]);
-               uint8_t line = ctoi(buff[15]);
-               uint8_t bytes = ctoi(buff[16]);
-
-               if (bytes == (cnt = wifly_receive(&wf, buff, bytes)))
-                  addEvent(&time, type, buff, line, bytes);
-            }
-         }
+      // Sleep until a datagram starts arriving, then take in the rest of it
+      // with one read. The frame decoder finds the packets in it and hands
+      // each to onPacket. After PROTO_SEQ_HOLD_MS of silence any retransmission
+      // is over, so a packet reusing the last seq is a new one.
+      if (1 == wifly_receive_timeout(&wf, buff, 1, PROTO_SEQ_HOLD_MS)) {
+         cnt = wifly_receive_timeout(&wf, &buff[1], sizeof(buff) - 1,
+                                     DATAGRAM_GAP);
+         frame_rx_bytes(&rx, (uint8_t *) buff, cnt > 0 ? cnt + 1 : 1);
+      } else {
+         haveSeq = 0;
       }
-
-      wifly_flush(&wf);
    }
 }
 
 int main(void)
 {
+   xTaskHandle receiveHandle;
+
    // Setup wifly and debug interface
    setupSerial(9600, USART0);
    setupSerial(9600, USART1);
@@ -545,9 +645,14 @@ int main(void)
    xTaskCreate(ClockTask, (cscp) "clock", 100, NULL, 6, NULL);
    xTaskCreate(TextTask, (cscp) "text", 200, NULL, 5, NULL);
    xTaskCreate(ColorTask, (cscp) "color", 1000, NULL, 4, NULL);
-   xTaskCreate(ReceiveTask, (cscp) "receive", 400, NULL, 3, NULL);
+   xTaskCreate(ReceiveTask, (cscp) "receive", 450, NULL, 3, &receiveHandle);
    xTaskCreate(WiflyTask, (cscp) "wifly", 100, NULL, 2, NULL);
-   xTaskCreate(UARTTask, (cscp) "uart", 100, NULL, 1, NULL);
+   xTaskCreate(WiflyTxTask, (cscp) "wiflytx", 150, NULL, 2, NULL);
+   xTaskCreate(ConsoleTask, (cscp) "console", 300, NULL, 1, NULL);
+
+   // Scheduled events come straight off the network, so cap how much of the
+   // heap the receive task can take
+   xPortSetHeapQuota(receiveHandle, RECEIVE_QUOTA);
 
    vTaskStartScheduler();
 
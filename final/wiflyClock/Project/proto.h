@@ -0,0 +1,67 @@
+/*
+ * @file proto.h
+ * @brief binary command protocol between the client and the clock.
+ *
+ * Each datagram carries one packet, sent as a frame (see frame.h) so that the
+ * clock finds packet boundaries in the byte stream the wifly hands it and
+ * drops corrupted packets on their crc. A packet is
+ *
+ *    version, seq, command, command, ...
+ *
+ * and each command is a length prefix followed by that many bytes, the first
+ * of them an opcode:
+ *
+ *    len, opcode, args[len - 1]
+ *
+ * The clock answers every packet with an ack packet of version, seq and a
+ * PROTO_* status. A packet that repeats the previous seq is a retransmission
+ * after a lost ack; it is acked again but not applied twice. The clock only
+ * holds on to the previous seq until nothing has arrived for
+ * PROTO_SEQ_HOLD_MS, so a client must send its retransmissions sooner, and
+ * should start from a random seq so that separate runs rarely repeat the
+ * seq of the one before. Commands with an
+ * unknown opcode are skipped by their length, so a newer client can still
+ * drive an older clock.
+ *
+ * Multi-byte fields are big endian.
+ */
+
+#ifndef _PROTO_H
+#define _PROTO_H
+
+#define PROTO_VERSION 1
+
+// Largest packet payload, header and commands together
+#define PROTO_MAX_PACKET 96
+
+// Bytes before the first command
+#define PROTO_HEADER_SZ 2
+
+// ms of silence after which the clock forgets the previous seq
+#define PROTO_SEQ_HOLD_MS 5000
+
+// Opcodes and their arguments
+#define OP_COLOR    0x01 // red, green, blue
+#define OP_TOGGLE   0x02 // (none)
+#define OP_WRITE    0x03 // line, text (up to 16 bytes)
+#define OP_CLEAR    0x04 // (none)
+#define OP_TIME     0x05 // year (2), month, day, hour, min, sec
+#define OP_SCHEDULE 0x06 // year (2), month, day, hour, min, sec, event type,
+                         // line, data (up to 15 bytes: text for a write,
+                         // red, green and blue for a color)
+
+// Scheduled event types
+#define EVENT_CLEAR    0
+#define EVENT_TOGGLE   1
+#define EVENT_WRITE    2
+#define EVENT_COLOR    3
+
+// Ack status
+#define PROTO_OK       0 // Every command was applied
+#define PROTO_EVERSION 1 // Version not understood, nothing was applied
+#define PROTO_EOPCODE  2 // A command's opcode was unknown and skipped
+#define PROTO_EARGS    3 // A command's arguments were malformed and skipped
+#define PROTO_ELENGTH  4 // A length ran past the packet, the rest was dropped
+#define PROTO_EFULL    5 // An event could not be scheduled
+
+#endif
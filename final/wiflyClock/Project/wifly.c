@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <string.h>
+#include <avr/eeprom.h>
 #include "wifly.h"
 #include "serial.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "queue.h"
 #include "task.h"
 
 #if (INCLUDE_vTaskSuspend != 1)
@@ -14,11 +16,19 @@
 #define SSID "paradise"
 #define PW   "kiwibird"
 
+// ms of quiet on the uart after which the module sends what it has buffered
+// as a datagram (its comm time). Bytes of one coalesced datagram are written
+// back to back, far closer together than this.
+#define COMM_TIME 10
+
+#define STR(x)  #x
+#define XSTR(x) STR(x)
+
 // Delay values in ms
 #define RESET_DELAY  100
 #define BOOT_DELAY   300
 #define FLUSH_DELAY  1000
-#define RX_DELAY     100
+#define GET_TIMEOUT  200 // Quiet time that ends a 'get' reply
 #define IDLE_DELAY   30*1000
 
 // State enumerations
@@ -36,6 +46,10 @@
 #define AUTOJOIN  12 // Set wifly to autojoin
 #define DATMODE   13 // Exit command mode
 #define FLUSH     14 // Pre idle mode flush
+#define COMMSIZE  15 // Set the datagram size to WIFLY_PACKET_SZ
+#define COMMTIME  16 // Set the datagram flush timer to COMM_TIME
+#define VERIFY    17 // Read back the settings the module holds
+#define SAVE      18 // Save the settings on the module
 #define IDLE      127 // Do nothing
 
 // Wifly pinout defines
@@ -51,8 +65,22 @@
 #define SF_RXTX_ENABLE  (1 << 2) // Enable wifly transmissions
 #define SF_RXTX_DISABLE (1 << 3) // Disable wifly transmissions
 #define SF_IDLE         (1 << 4) // Idle
+#define SF_FASTBOOT     (1 << 5) // Skip to data mode if this module saved it
+#define SF_VERIFY       (1 << 6) // Read back settings to skip those held
+#define SF_SETTING      (1 << 7) // A setting, part of the saved config
+#define SF_SAVE         (1 << 8) // Save the settings if any were sent
+#define SF_PIPELINE     (1 << 9) // May be sent before earlier replies are in
 #define SF_STARTFLAGS   (SF_RXTX_DISABLE | SF_RESET | SF_DFLUSH)
 
+// Bit for a state in wf->verified
+#define STATE_BIT(s) (1UL << (s))
+
+// The module's reply line naming its MAC address, see readModule
+#define MAC_LINE "Mac Addr="
+
+// A setting a factory reset clears, read back before trusting the saved hash
+#define FASTBOOT_CHECK AUTOPAIR
+
 // Debuging string defs
 #define STR_INVSTATE        "wifly - State not found\r\n"
 #define STR_CMDMODE         "wifly - Command mode\r\n"
@@ -61,6 +89,8 @@
 #define STR_DHCPC           "wifly - Enable DHCP\r\n"
 #define STR_UDP             "wifly - Enabling UDP protocol\r\n"
 #define STR_AUTOPAIR        "wifly - Enabling UDP autopairing\r\n"
+#define STR_COMMSIZE        "wifly - Setting datagram size\r\n"
+#define STR_COMMTIME        "wifly - Setting datagram flush timer\r\n"
 #define STR_JWAIT           "wifly - Setting join wait to 5000ms\r\n"
 #define STR_AUTH            "wifly - Setting auth to WPA1-WPA2psk\r\n"
 #define STR_SETPW           "wifly - Setting password\r\n"
@@ -70,100 +100,322 @@
 #define STR_DATMODE         "wifly - Data mode entered\r\n"
 #define STR_FLUSH           "wifly - Flushing received bytes\r\n"
 #define STR_IDLE            "wifly - Idling with rx/tx enabled\r\n"
+#define STR_FASTBOOT        "wifly - Saved config matches\r\n"
+#define STR_VERIFY          "wifly - Reading back settings\r\n"
+#define STR_HELD            "wifly - Already set\r\n"
+#define STR_SAVE            "wifly - Saving settings\r\n"
+#define STR_TXDROP          "wifly - Datagram cut short\r\n"
+
+// Start of the reply to a command the module rejected
+#define ERR_REPLY "ERR"
+
+// Hash of the settings last saved and the module they were saved on, see
+// configHash
+static uint32_t EEMEM savedHash;
+
+static xSemaphoreHandle rxLock;   // Serializes data mode receivers
+static xSemaphoreHandle readySem; // Given while rx/tx is enabled
+static xSemaphoreHandle txLock;   // Keeps one message's queue entries together
+static xSemaphoreHandle txFreed;  // Given when the transmit task frees an entry
+static xQueueHandle txQueue;      // Messages waiting to be coalesced
+
+// Every message must fit both one datagram and the queue, whole
+#if WIFLY_PACKET_SZ > 255
+#error "WIFLY_PACKET_SZ must fit struct wifly_msg's left"
+#endif
+#if (WIFLY_PACKET_SZ + WIFLY_MSG_SZ - 1) / WIFLY_MSG_SZ > WIFLY_TXQ_DEPTH
+#error "WIFLY_TXQ_DEPTH entries must hold a WIFLY_PACKET_SZ message"
+#endif
 
-static xSemaphoreHandle uartSem;
+// One transmit queue entry
+struct wifly_msg {
+   uint8_t bytes; // Bytes in this entry
+   uint8_t left;  // Bytes of the message from this entry on
+   char data[WIFLY_MSG_SZ];
+};
 
 // State machine lookup-table
 static struct wifly_state {
    int8_t state_enum;  // This states enumeration
    int8_t state_next;  // The next state
    int8_t state_recov; // The recovery state (where to go upon failure)
-   uint8_t sfunc;      // Special function bit fields
+   uint16_t sfunc;     // Special function bit fields
    const char *txstr;  // The outgoing command
    int16_t txdelay;    // Delay (ms) to observe before sending tx cmd
    const char *rxstr;  // The expected receive command
-   int16_t rxdelay;    // Delay (ms) to observe before reading rx cmd
+   int16_t rxtimeout;  // Longest wait (ms) for the rx cmd to complete
+   const char *held;   // [settings] 'get' line showing the module holds it
 } state_table[] = {
-   {CMDMODE,UARTNE,CMDMODE,SF_STARTFLAGS,"$$$",0,"CMD\r\n",500},
-   {UARTNE,QUIET,CMDMODE,SF_NONE,"set u m 1\r",0,"set u m 1\r\r\nAOK\r\n",50},
-   {QUIET,DHCPC,CMDMODE,SF_NONE,"set s p 0\r",0,"AOK\r\n",50},
-   {DHCPC,UDP,CMDMODE,SF_NONE,"set i d 1\r",0,"AOK\r\n",50},
-   {UDP,AUTOPAIR,CMDMODE,SF_NONE,"set i p 1\r",0,"AOK\r\n",50},
-   {AUTOPAIR,JWAIT,CMDMODE,SF_NONE,"set i f 0x47\r",0,"AOK\r\n",50},
-   {JWAIT,AUTH,CMDMODE,SF_NONE,"set o j 5000\r",0,"AOK\r\n",50},
-   {AUTH,SETPW,CMDMODE,SF_NONE,"set w a 4\r",0,"AOK\r\n",50},
-   {SETPW,SETSSID,CMDMODE,SF_NONE,"set w p "PW"\r",0,"AOK\r\n",750},
-   {SETSSID,HIDEKEY,CMDMODE,SF_NONE,"set w s "SSID"\r",0,"AOK\r\n",750},
-   {HIDEKEY,AUTOJOIN,CMDMODE,SF_NONE,"set w h 1\r",0,"AOK\r\n",50},
-   {AUTOJOIN,DATMODE,CMDMODE,SF_NONE,"set w j 1\r",0,"AOK\r\n",50},
-   {DATMODE,FLUSH,CMDMODE,SF_NONE,"exit\r",0,"EXIT\r\n",50},
-   {FLUSH,IDLE,IDLE,SF_DFLUSH,"",0, "",0},
-   {IDLE,IDLE,IDLE,SF_RXTX_ENABLE | SF_IDLE,"",0, "",0},
-   {-1,-1,-1,SF_NONE,NULL,-1,NULL,-1}
+   {CMDMODE,VERIFY,CMDMODE,SF_STARTFLAGS,"$$$",0,"CMD\r\n",1000,NULL},
+   {VERIFY,UARTNE,CMDMODE,SF_FASTBOOT | SF_VERIFY,"",0,"",0,NULL},
+   {UARTNE,QUIET,CMDMODE,SF_SETTING,"set u m 1\r",0,"AOK\r\n",500,"Mode=0x1"},
+   {QUIET,DHCPC,CMDMODE,SF_SETTING | SF_PIPELINE,"set s p 0\r",0,"AOK\r\n",500,"PrintLvl=0x0"},
+   {DHCPC,UDP,CMDMODE,SF_SETTING | SF_PIPELINE,"set i d 1\r",0,"AOK\r\n",500,"DHCP=ON"},
+   {UDP,AUTOPAIR,CMDMODE,SF_SETTING | SF_PIPELINE,"set i p 1\r",0,"AOK\r\n",500,"PROTO=UDP,"},
+   {AUTOPAIR,COMMSIZE,CMDMODE,SF_SETTING | SF_PIPELINE,"set i f 0x47\r",0,"AOK\r\n",500,"FLAGS=0x47"},
+   {COMMSIZE,COMMTIME,CMDMODE,SF_SETTING | SF_PIPELINE,"set c s "XSTR(WIFLY_PACKET_SZ)"\r",0,"AOK\r\n",500,"FlushSize="XSTR(WIFLY_PACKET_SZ)},
+   {COMMTIME,JWAIT,CMDMODE,SF_SETTING | SF_PIPELINE,"set c t "XSTR(COMM_TIME)"\r",0,"AOK\r\n",500,"FlushTimer="XSTR(COMM_TIME)},
+   {JWAIT,AUTH,CMDMODE,SF_SETTING | SF_PIPELINE,"set o j 5000\r",0,"AOK\r\n",500,"JoinTmr=5000"},
+   {AUTH,SETPW,CMDMODE,SF_SETTING | SF_PIPELINE,"set w a 4\r",0,"AOK\r\n",500,"Auth=MIXED"},
+   {SETPW,SETSSID,CMDMODE,SF_SETTING | SF_PIPELINE,"set w p "PW"\r",0,"AOK\r\n",500,NULL},
+   {SETSSID,HIDEKEY,CMDMODE,SF_SETTING | SF_PIPELINE,"set w s "SSID"\r",0,"AOK\r\n",500,"SSID="SSID},
+   {HIDEKEY,AUTOJOIN,CMDMODE,SF_SETTING | SF_PIPELINE,"set w h 1\r",0,"AOK\r\n",500,NULL},
+   {AUTOJOIN,SAVE,CMDMODE,SF_SETTING | SF_PIPELINE,"set w j 1\r",0,"AOK\r\n",500,"Join=1"},
+   {SAVE,DATMODE,CMDMODE,SF_SAVE,"save\r",0,"Storing in config\r\n",1000,NULL},
+   {DATMODE,FLUSH,CMDMODE,SF_NONE,"exit\r",0,"EXIT\r\n",500,NULL},
+   {FLUSH,IDLE,IDLE,SF_DFLUSH,"",0, "",0,NULL},
+   {IDLE,IDLE,IDLE,SF_RXTX_ENABLE | SF_IDLE,"",0, "",0,NULL},
+   {-1,-1,-1,SF_NONE,NULL,-1,NULL,-1,NULL}
 };
 
-static struct wifly_state * lookup_state(struct wifly *wf)
+static struct wifly_state * find_state(int16_t state)
 {
    struct wifly_state *s;
 
    // Navagate LUT and return correct state pointer
    for (s = state_table; s && s->state_enum != -1; s++)
-      if (s->state_enum == wf->currstate)
+      if (s->state_enum == state)
          return s;
 
    return NULL;
 }
 
+static struct wifly_state * lookup_state(struct wifly *wf)
+{
+   return find_state(wf->currstate);
+}
+
 void wifly_setup(struct wifly *wf)
 {
    WF_DDR |= WF_RESET_PIN;
    WF_PORT |= WF_RESET_PIN;
 
-   vSemaphoreCreateBinary(uartSem);
+   rxLock = xSemaphoreCreateMutex();
+   vSemaphoreCreateBinary(readySem);
+   xSemaphoreTake(readySem, 0); // created given, start it empty
+   txLock = xSemaphoreCreateMutex();
+   vSemaphoreCreateBinary(txFreed);
+   xSemaphoreTake(txFreed, 0); // created given, start it empty
+   txQueue = xQueueCreate(WIFLY_TXQ_DEPTH, sizeof(struct wifly_msg));
 
    wf->rxoffset = 0;
-   wf->rxbytes = 0;
-   wf->txoffset = 0;
    wf->txbytes = 0;
+   wf->txdropped = 0;
 
+   wf->module = 0;
+   wf->verified = 0;
+   wf->changed = 0;
    wf->currstate = CMDMODE;
    wf->rxtx_enabled = 0;
 }
 
-void wifly_uart_rx_tx(struct wifly *wf)
+static portTickType toTicks(uint16_t timeout)
+{
+   if (timeout == SERIAL_WAIT_FOREVER)
+      return portMAX_DELAY;
+
+   return timeout / portTICK_RATE_MS;
+}
+
+// Sleeps until rx/tx is enabled. Returns 1 if it is, 0 on timeout.
+static int waitReady(struct wifly *wf, uint16_t timeout)
+{
+   if (wf->rxtx_enabled)
+      return 1;
+
+   // readySem stays given while rx/tx is enabled, so pass it straight back
+   if (xSemaphoreTake(readySem, toTicks(timeout)) != pdTRUE)
+      return 0;
+   xSemaphoreGive(readySem);
+
+   return wf->rxtx_enabled;
+}
+
+// Advances a match of token by one received byte and returns how many of its
+// bytes now match. On a mismatch the match falls back to the longest tail of
+// what was matched that is still a prefix of token, so no start is missed.
+static uint8_t matchByte(const char *token, uint8_t matched, char c)
 {
-   xSemaphoreTake(uartSem, portMAX_DELAY);
+   uint8_t len, ndx;
+
+   if (token[matched] == c)
+      return matched + 1;
+
+   for (len = matched; len > 0; len--) {
+      if (token[len - 1] != c)
+         continue;
+      for (ndx = 0; ndx < len - 1 && token[ndx] == token[matched - len + 1 + ndx];
+           ndx++)
+         ;
+      if (ndx == len - 1)
+         return len;
+   }
 
-   // Read from the receive port
-   if (wf->rxoffset < wf->rxbytes)
-      if (!readByte_nonblocking(&wf->rxbuffer[wf->rxoffset], WF_USART))
-         wf->rxoffset++;
+   return 0;
+}
+
+// Waits for a command's reply, matching it byte by byte as the rx interrupt
+// delivers it, so that the wait ends the moment the reply is complete.
+// Returns 1 then, or 0 if the module rejects the command or the reply is not
+// complete within the state's rxtimeout.
+static int awaitReply(struct wifly_state *cs)
+{
+   portTickType start = xTaskGetTickCount(), waited;
+   portTickType limit = cs->rxtimeout / portTICK_RATE_MS;
+   uint8_t okLen = strlen(cs->rxstr), ok = 0, err = 0;
+   char c;
+
+   while (ok < okLen) {
+      waited = xTaskGetTickCount() - start;
+      if (waited >= limit || readBytes_timeout(&c, 1,
+               (limit - waited) * portTICK_RATE_MS, WF_USART) != 1)
+         return 0;
+
+      ok = matchByte(cs->rxstr, ok, c);
+      err = matchByte(ERR_REPLY, err, c);
+      if (err == strlen(ERR_REPLY))
+         return 0;
+   }
+
+   return 1;
+}
+
+// FNV-1a over a string, continuing from hash
+static uint32_t hashString(uint32_t hash, const char *c)
+{
+   for (; *c; c++)
+      hash = (hash ^ (uint8_t) *c) * 16777619UL;
+
+   return hash;
+}
+
+// FNV-1a over the module's MAC and the commands of every setting. A different
+// module, or any change to the commands, e.g. a new SSID, misses the hash
+// saved in EEPROM, so the settings are read back and sent again.
+static uint32_t configHash(struct wifly *wf)
+{
+   struct wifly_state *s;
+   uint32_t hash = wf->module;
 
-   // Write to the transmit port
-   if (wf->txoffset < wf->txbytes)
-      if (!writeByte_nonblocking(wf->txbuffer[wf->txoffset], WF_USART))
-         wf->txoffset++;
+   for (s = state_table; s->state_enum != -1; s++)
+      if (s->sfunc & SF_SETTING)
+         hash = hashString(hash, s->txstr);
 
-   xSemaphoreGive(uartSem);
+   return hash;
+}
+
+// The 'get' section a setting can be read back from, e.g. 'i' for every
+// 'set i ...', or 0 if it cannot be read back
+static char section(struct wifly_state *s)
+{
+   return (s->sfunc & SF_SETTING && s->held) ? s->txstr[4] : 0;
+}
+
+// Reads one line of a command mode reply into rxbuffer, without its line
+// ending. Returns 0 once nothing more arrives within timeout ms.
+static int readLine(struct wifly *wf, uint16_t timeout)
+{
+   char c;
+
+   wf->rxoffset = 0;
+   while (readBytes_timeout(&c, 1, timeout, WF_USART) == 1) {
+      if (c == '\n') {
+         wf->rxbuffer[wf->rxoffset] = '\0';
+         return 1;
+      }
+      if (c != '\r' && wf->rxoffset < RXBUFF_SZ - 1)
+         wf->rxbuffer[wf->rxoffset++] = c;
+   }
+
+   return 0;
+}
+
+// Reads 'get' replies until the module goes quiet, marking every setting
+// whose line they print in wf->verified
+static void readHeld(struct wifly *wf)
+{
+   struct wifly_state *t;
+
+   while (readLine(wf, GET_TIMEOUT))
+      for (t = state_table; t->state_enum != -1; t++)
+         if (section(t) && !strcmp(wf->rxbuffer, t->held))
+            wf->verified |= STATE_BIT(t->state_enum);
+}
+
+// Identifies the attached module by its MAC, left in wf->module (0 if it did
+// not answer), and reads back the FASTBOOT_CHECK setting's section
+static void readModule(struct wifly *wf)
+{
+   struct wifly_state *s = find_state(FASTBOOT_CHECK);
+   char cmd[] = "get ?\r";
+   char *mac;
+
+   wf->module = 0;
+   wf->verified = 0;
+   flushSerial(WF_USART);
+
+   writeBytes("get mac\r", 8, WF_USART);
+   while (readLine(wf, GET_TIMEOUT))
+      if ((mac = strstr(wf->rxbuffer, MAC_LINE)) != NULL)
+         wf->module = hashString(2166136261UL, mac);
+
+   cmd[4] = section(s);
+   writeBytes(cmd, strlen(cmd), WF_USART);
+   readHeld(wf);
+   wf->rxoffset = 0;
+}
+
+// Issues one 'get' per section to find the settings the module already
+// holds. Up to WIFLY_PIPELINE_DEPTH of them are queued on the module at once,
+// so their replies share one quiet period. Settings that cannot be read back,
+// such as the passphrase, are always sent.
+static void readBack(struct wifly *wf)
+{
+   struct wifly_state *s, *t;
+   char cmd[] = "get ?\r";
+   uint8_t queued = 0;
+
+   wf->verified = 0;
+   wf->changed = 0;
+   flushSerial(WF_USART);
+
+   for (s = state_table; s->state_enum != -1; s++) {
+      if (!section(s))
+         continue;
+
+      // Each section is read once, at its first setting
+      for (t = state_table; t != s && section(t) != section(s); t++)
+         ;
+      if (t != s)
+         continue;
+
+      cmd[4] = section(s);
+      writeBytes(cmd, strlen(cmd), WF_USART);
+      if (++queued == WIFLY_PIPELINE_DEPTH) {
+         readHeld(wf);
+         queued = 0;
+      }
+   }
+
+   if (queued)
+      readHeld(wf);
+   wf->rxoffset = 0;
 }
 
 static int handleSpecialFunctions(struct wifly *wf, struct wifly_state *cs)
 {
-   // Disable upper layer rx/tx
-   if (cs->sfunc & SF_RXTX_DISABLE)
-      xSemaphoreTake(uartSem, portMAX_DELAY);
+   // Disable upper layer rx/tx. A receiver already reading keeps reading,
+   // so this is only done before rx/tx is first enabled.
+   if (cs->sfunc & SF_RXTX_DISABLE) {
       wf->rxtx_enabled = 0;
-      wf->rxbytes = 0;
-      xSemaphoreGive(uartSem);
+      xSemaphoreTake(readySem, 0);
+   }
 
-   // Enable upper layer rx/tx
-   if (cs->sfunc & SF_RXTX_ENABLE) {
-      xSemaphoreTake(uartSem, portMAX_DELAY);
-      wf->rxtx_enabled = 1;
-      wf->rxoffset = 0;
-      wf->rxbytes = RXBUFF_SZ;
+   // Enable upper layer rx/tx, waking any waiting receiver
+   if (cs->sfunc & SF_RXTX_ENABLE && !wf->rxtx_enabled) {
       flushSerial(WF_USART);
-      xSemaphoreGive(uartSem);
+      wf->rxtx_enabled = 1;
+      xSemaphoreGive(readySem);
    }
 
    // Idle this state machine
@@ -184,24 +436,51 @@ static int handleSpecialFunctions(struct wifly *wf, struct wifly_state *cs)
    // Flush the wifly rx buffer
    if (cs->sfunc & SF_DFLUSH) {
       vTaskDelay(FLUSH_DELAY / portTICK_RATE_MS);
-      xSemaphoreTake(uartSem, portMAX_DELAY);
       wf->rxoffset = 0;
-      wf->rxbytes = 0;
       flushSerial(WF_USART);
-      xSemaphoreGive(uartSem);
+   }
+
+   // This module saved these exact settings on an earlier boot and still
+   // holds them, so leave command mode without reading back the rest. The
+   // saved hash alone would also match a replaced or factory reset module.
+   if (cs->sfunc & SF_FASTBOOT) {
+      readModule(wf);
+      if (wf->module && wf->verified & STATE_BIT(FASTBOOT_CHECK)
+            && eeprom_read_dword(&savedHash) == configHash(wf)) {
+         writeBytes(STR_FASTBOOT, strlen(STR_FASTBOOT), USART0);
+         wf->currstate = DATMODE;
+         return 1;
+      }
+   }
+
+   // Find out which settings the module already holds
+   if (cs->sfunc & SF_VERIFY) {
+      writeBytes(STR_VERIFY, strlen(STR_VERIFY), USART0);
+      readBack(wf);
+      wf->currstate = cs->state_next;
+      return 1;
+   }
+
+   // Skip settings the module already holds
+   if (wf->verified & STATE_BIT(cs->state_enum)) {
+      writeBytes(STR_HELD, strlen(STR_HELD), USART0);
+      wf->currstate = cs->state_next;
+      return 1;
+   }
+
+   // Nothing to save, the module held every setting
+   if (cs->sfunc & SF_SAVE && !wf->changed) {
+      eeprom_update_dword(&savedHash, configHash(wf));
+      wf->currstate = cs->state_next;
+      return 1;
    }
 
    return 0;
 }
 
-void wifly_check_state(struct wifly *wf)
+// Writes a state's debugging message. Returns 0 if the state is not known.
+static int printState(struct wifly_state *cs)
 {
-   struct wifly_state *cs = lookup_state(wf);
-
-   if (handleSpecialFunctions(wf, cs))
-      return;
-
-   // Debugging messages
    switch (cs->state_enum) {
       case CMDMODE: writeBytes(STR_CMDMODE, strlen(STR_CMDMODE), USART0);
          break;
@@ -215,6 +494,10 @@ void wifly_check_state(struct wifly *wf)
          break;
       case AUTOPAIR: writeBytes(STR_AUTOPAIR, strlen(STR_AUTOPAIR), USART0);
          break;
+      case COMMSIZE: writeBytes(STR_COMMSIZE, strlen(STR_COMMSIZE), USART0);
+         break;
+      case COMMTIME: writeBytes(STR_COMMTIME, strlen(STR_COMMTIME), USART0);
+         break;
       case JWAIT: writeBytes(STR_JWAIT, strlen(STR_JWAIT), USART0);
          break;
       case AUTH: writeBytes(STR_AUTH, strlen(STR_AUTH), USART0);
@@ -227,93 +510,215 @@ void wifly_check_state(struct wifly *wf)
          break;
       case AUTOJOIN: writeBytes(STR_AUTOJOIN, strlen(STR_AUTOJOIN), USART0);
          break;
+      case SAVE: writeBytes(STR_SAVE, strlen(STR_SAVE), USART0);
+         break;
       case DATMODE: writeBytes(STR_DATMODE, strlen(STR_DATMODE), USART0);
          break;
       case FLUSH: writeBytes(STR_FLUSH, strlen(STR_FLUSH), USART0);
          break;
       default: writeBytes(STR_INVSTATE, strlen(STR_INVSTATE), USART0);
-         return;
+         return 0;
    }
 
-   // Optional delay before transmit
-   if (cs->txdelay)
-      vTaskDelay(cs->txdelay / portTICK_RATE_MS);
+   return 1;
+}
 
-   // Transmit/receive setup
-   xSemaphoreTake(uartSem, portMAX_DELAY);
+void wifly_check_state(struct wifly *wf)
+{
+   struct wifly_state *cs = lookup_state(wf);
+   struct wifly_state *batch[WIFLY_PIPELINE_DEPTH];
+   struct wifly_state *s;
+   uint8_t count = 1, ndx;
+
+   if (handleSpecialFunctions(wf, cs))
+      return;
+
+   // Take the states after this one whose commands may be queued on the
+   // module before the replies ahead of them are in, passing over settings
+   // it already holds
+   batch[0] = cs;
+   for (s = find_state(cs->state_next);
+        cs->sfunc & SF_PIPELINE && s && count < WIFLY_PIPELINE_DEPTH;
+        s = find_state(s->state_next)) {
+      if (wf->verified & STATE_BIT(s->state_enum))
+         continue;
+      if (!(s->sfunc & SF_PIPELINE))
+         break;
+      batch[count++] = s;
+   }
+
+   // Debugging messages
+   for (ndx = 0; ndx < count; ndx++)
+      if (!printState(batch[ndx]))
+         return;
+
+   // Transmit the commands back to back
    flushSerial(WF_USART);
-   memcpy(wf->txbuffer, cs->txstr, strlen(cs->txstr));
-   wf->rxoffset = 0;
-   wf->rxbytes = strlen(cs->rxstr);   
-   wf->txoffset = 0;
-   wf->txbytes = strlen(cs->txstr);   
-   xSemaphoreGive(uartSem);
- 
-   // Optional delay before receive
-   if (cs->rxdelay)
-      vTaskDelay(cs->rxdelay / portTICK_RATE_MS);
-
-   // Check the received string and respond appropriately
-   xSemaphoreTake(uartSem, portMAX_DELAY);
-   if (wf->rxoffset == strlen(cs->rxstr)
-          && !memcmp(wf->rxbuffer, cs->rxstr, strlen(cs->rxstr))) {
-      wf->currstate = cs->state_next;
-   } else 
-      wf->currstate = cs->state_recov;
-   xSemaphoreGive(uartSem);
+   for (ndx = 0; ndx < count; ndx++) {
+      if (batch[ndx]->txdelay)
+         vTaskDelay(batch[ndx]->txdelay / portTICK_RATE_MS);
+      writeBytes((char *) batch[ndx]->txstr, strlen(batch[ndx]->txstr),
+                 WF_USART);
+   }
+
+   // The replies come back in command order. Move on as soon as each one is
+   // complete, or recover from the first that fails.
+   for (ndx = 0; ndx < count; ndx++) {
+      s = batch[ndx];
+      if (!awaitReply(s)) {
+         wf->currstate = s->state_recov;
+         return;
+      }
+
+      if (s->sfunc & SF_SETTING)
+         wf->changed = 1;
+
+      // Saved, later boots can skip configuration
+      if (s->sfunc & SF_SAVE)
+         eeprom_update_dword(&savedHash, configHash(wf));
+   }
+
+   wf->currstate = batch[count - 1]->state_next;
 }
 
-int wifly_transmit(struct wifly *wf, char *src, uint16_t bytes)
+// Waits up to WIFLY_TX_TIMEOUT ms for that many free queue entries. Only the
+// holder of txLock waits, so the entries stay free until it queues them.
+static uint8_t waitForRoom(uint8_t entries)
 {
-   // If the interface is not ready, return error
-   if (!wf->rxtx_enabled)
-      return -1;
+   portTickType start = xTaskGetTickCount(), waited;
+   portTickType limit = WIFLY_TX_TIMEOUT / portTICK_RATE_MS;
 
-   xSemaphoreTake(uartSem, portMAX_DELAY);
-   memcpy(wf->txbuffer, src, bytes);
-   wf->txbytes = bytes;
-   wf->txoffset = 0;
-   xSemaphoreGive(uartSem);
+   while (WIFLY_TXQ_DEPTH - uxQueueMessagesWaiting(txQueue) < entries) {
+      waited = xTaskGetTickCount() - start;
+      if (waited >= limit || xSemaphoreTake(txFreed, limit - waited) != pdTRUE)
+         return 0;
+   }
 
-   return bytes;
+   return 1;
 }
 
-int wifly_receive(struct wifly *wf, char *dst, uint16_t bytes)
+int wifly_transmit(struct wifly *wf, char *src, uint16_t bytes)
 {
-   uint16_t ndx;
+   struct wifly_msg msg;
+   uint16_t queued = 0;
+   int result = -1;
 
-   // If the interface is not ready, return error
-   if (!wf->rxtx_enabled) {
-      vTaskDelay(RX_DELAY / portTICK_RATE_MS);
+   // If the interface is not ready, or the message would not fit one
+   // datagram, return error
+   if (!wf->rxtx_enabled || bytes > WIFLY_PACKET_SZ)
       return -1;
+
+   // Queue the message in WIFLY_MSG_SZ pieces, which the transmit task joins
+   // back together. It goes in whole or not at all: a full queue makes the
+   // caller wait for room for all of it, never overwrites.
+   xSemaphoreTake(txLock, portMAX_DELAY);
+   if (waitForRoom((bytes + WIFLY_MSG_SZ - 1) / WIFLY_MSG_SZ)) {
+      while (queued < bytes) {
+         msg.left = bytes - queued;
+         msg.bytes = msg.left < WIFLY_MSG_SZ ? msg.left : WIFLY_MSG_SZ;
+         memcpy(msg.data, &src[queued], msg.bytes);
+         xQueueSendToBack(txQueue, &msg, 0); // room was waited for
+         queued += msg.bytes;
+      }
+      result = queued;
    }
+   xSemaphoreGive(txLock);
 
-   xSemaphoreTake(uartSem, portMAX_DELAY);
+   return result;
+}
 
-   // Loop until all bytes have been received
-   while (wf->rxoffset < bytes) {
-      xSemaphoreGive(uartSem);
-      vTaskDelay(RX_DELAY / portTICK_RATE_MS);
-      xSemaphoreTake(uartSem, portMAX_DELAY);
+// Moves the message at the head of the queue into the datagram. Its entries
+// were queued together, so the rest follow the first without fail.
+static void takeMessage(struct wifly *wf)
+{
+   struct wifly_msg msg;
+
+   do {
+      xQueueReceive(txQueue, &msg, portMAX_DELAY);
+      xSemaphoreGive(txFreed);
+      memcpy(&wf->txbuffer[wf->txbytes], msg.data, msg.bytes);
+      wf->txbytes += msg.bytes;
+   } while (msg.left > msg.bytes);
+}
+
+void wifly_send_queued(struct wifly *wf)
+{
+   struct wifly_msg msg;
+   portTickType start, waited;
+   portTickType window = WIFLY_COALESCE_MS / portTICK_RATE_MS;
+   uint16_t written;
+   uint32_t baud;
+
+   // Sleep until a message opens a datagram
+   xQueuePeek(txQueue, &msg, portMAX_DELAY);
+   wf->txbytes = 0;
+   takeMessage(wf);
+   start = xTaskGetTickCount();
+
+   // Take in whatever else is queued before the window closes, as long as all
+   // of it fits. A message that does not fit is left to open the next
+   // datagram, so no message is split between two. This task is the only
+   // reader, so a peeked message is still there.
+   while (wf->txbytes < WIFLY_PACKET_SZ
+          && (waited = xTaskGetTickCount() - start) < window
+          && xQueuePeek(txQueue, &msg, window - waited) == pdTRUE
+          && wf->txbytes + msg.left <= WIFLY_PACKET_SZ)
+      takeMessage(wf);
+
+   written = writeBytes_timeout(wf->txbuffer, wf->txbytes, WIFLY_TX_TIMEOUT,
+                                WF_USART);
+
+   // The uart stayed full, the rest of the datagram is dropped. The module
+   // still sends what got through, and its last message, cut short, fails
+   // the receiver's crc.
+   if (written < wf->txbytes) {
+      wf->txdropped++;
+      writeBytes(STR_TXDROP, strlen(STR_TXDROP), USART0);
    }
 
-   // Copy back to user buffer, adjust rx buffer to preserve extra bytes
-   memcpy(dst, wf->rxbuffer, bytes);
-   for (ndx = 0; ndx < wf->rxoffset - bytes; ndx++)
-      wf->rxbuffer[ndx] = wf->rxbuffer[ndx + bytes];
-   wf->rxoffset -= bytes;
+   // The module only ends a datagram short of WIFLY_PACKET_SZ once the uart
+   // has been quiet for COMM_TIME, so wait for the bytes to go out and the
+   // flush timer to expire before the next datagram's bytes can follow
+   baud = getSerialBaud(WF_USART, NULL);
+   if (written < WIFLY_PACKET_SZ && baud)
+      vTaskDelay((written * 10000UL / baud + COMM_TIME + 1)
+                 / portTICK_RATE_MS + 1);
+}
+
+int wifly_receive(struct wifly *wf, char *dst, uint16_t bytes)
+{
+   return wifly_receive_timeout(wf, dst, bytes, SERIAL_WAIT_FOREVER);
+}
+
+int wifly_receive_timeout(struct wifly *wf, char *dst, uint16_t bytes,
+                          uint16_t timeout)
+{
+   int count;
+
+   if (!waitReady(wf, timeout))
+      return -1;
 
-   xSemaphoreGive(uartSem);
+   // Bytes go straight from the serial driver's ring buffer to dst, the
+   // caller sleeping on the rx interrupt until they arrive
+   xSemaphoreTake(rxLock, portMAX_DELAY);
+   count = readBytes_timeout(dst, bytes, timeout, WF_USART);
+   xSemaphoreGive(rxLock);
 
-   return bytes;
+   return count;
 }
 
 void wifly_flush(struct wifly *wf)
 {
+   // In command mode the state machine owns the received bytes
    if (!wf->rxtx_enabled)
-      vTaskDelay(RX_DELAY / portTICK_RATE_MS);
+      return;
  
-   xSemaphoreTake(uartSem, portMAX_DELAY);
+   xSemaphoreTake(rxLock, portMAX_DELAY);
    flushSerial(WF_USART);
-   xSemaphoreGive(uartSem);
+   xSemaphoreGive(rxLock);
+}
+
+void wifly_forget_config(void)
+{
+   eeprom_update_dword(&savedHash, 0xFFFFFFFFUL);
 }
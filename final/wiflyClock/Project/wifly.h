@@ -3,31 +3,89 @@
 #include <stdint.h>
 
 #define RXBUFF_SZ 128
-#define TXBUFF_SZ 128
 
-struct wifly {
-   char txbuffer[TXBUFF_SZ];
-   uint16_t txoffset;
-   uint16_t txbytes;
+// Messages the transmit queue holds, each of up to WIFLY_MSG_SZ bytes
+#ifndef WIFLY_TXQ_DEPTH
+#define WIFLY_TXQ_DEPTH 8
+#endif
+
+// Longer messages take several queue entries
+#define WIFLY_MSG_SZ 24
+
+// Largest UDP datagram the module is set to send (its comm size). Queued
+// messages are coalesced into datagrams of up to this many bytes.
+#define WIFLY_PACKET_SZ 128
+
+// ms the transmit task holds a datagram open for more messages to join it
+#define WIFLY_COALESCE_MS 20
+
+// ms wifly_transmit waits for room for a whole message in the transmit queue
+#define WIFLY_TX_TIMEOUT 100
+
+// Command mode commands sent before the reply to the first of them is in.
+// 1 waits for each reply before sending the next command.
+#ifndef WIFLY_PIPELINE_DEPTH
+#define WIFLY_PIPELINE_DEPTH 1
+#endif
 
-   char rxbuffer[RXBUFF_SZ];
+struct wifly {
+   char rxbuffer[RXBUFF_SZ]; // Command mode replies
    uint16_t rxoffset;
-   uint16_t rxbytes;
+
+   char txbuffer[WIFLY_PACKET_SZ]; // Datagram being coalesced
+   uint16_t txbytes;
+   uint16_t txdropped; // Datagrams the uart did not take in full
 
    uint16_t currstate;
    uint8_t rxtx_enabled;
+
+   uint32_t module;   // Hash of the module's MAC, 0 if it was not read
+   uint32_t verified; // Settings the module was found to hold already
+   uint8_t changed;   // Settings were sent and need saving
 };
 
 void wifly_setup(struct wifly *wf);
 
-void wifly_uart_rx_tx(struct wifly *wf);
-
 void wifly_check_state(struct wifly *wf);
 
+/*
+ * Queues a message of up to WIFLY_PACKET_SZ bytes to be sent in data mode,
+ * waiting up to WIFLY_TX_TIMEOUT ms for room for all of it rather than
+ * overwriting anything queued earlier. Messages queued close together share
+ * a datagram, never split across two, so they should delimit themselves.
+ * Returns bytes once the whole message is queued, or -1 with nothing queued
+ * if rx/tx is not enabled, the message is too long or the queue stayed full.
+ */
 int wifly_transmit(struct wifly *wf, char *src, uint16_t bytes);
 
+/*
+ * Sends the next datagram, sleeping until a message is queued and then for
+ * up to WIFLY_COALESCE_MS while more messages join it. Call it in a loop from
+ * the task that owns the transmit side.
+ */
+void wifly_send_queued(struct wifly *wf);
+
+/*
+ * Reads bytes received in data mode, sleeping until rx/tx is enabled and
+ * then until all of them have arrived. Returns the number read, or -1 if
+ * rx/tx was not enabled in time.
+ */
 int wifly_receive(struct wifly *wf, char *dst, uint16_t bytes);
 
+/*
+ * As wifly_receive, giving up once nothing has arrived for timeout ms
+ * (SERIAL_WAIT_FOREVER to wait indefinitely). May return fewer bytes.
+ */
+int wifly_receive_timeout(struct wifly *wf, char *dst, uint16_t bytes,
+                          uint16_t timeout);
+
 void wifly_flush(struct wifly *wf);
 
+/*
+ * Forgets that the module holds this firmware's settings, so that the next
+ * boot reads them back and configures it again, e.g. after changing them by
+ * hand. A swapped or factory reset module is noticed without it.
+ */
+void wifly_forget_config(void);
+
 #endif
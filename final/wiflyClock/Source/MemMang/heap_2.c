@@ -111,6 +111,12 @@ typedef struct A_BLOCK_LINK
 {
 	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the list. */
 	size_t xBlockSize;						/*<< The size of the free block. */
+	#if ( configHEAP_DEBUG == 1 )
+		unsigned char ucSite;				/*<< Index of the allocating call site in xSites[]. */
+	#endif
+	#if ( configHEAP_TASK_STATS == 1 )
+		unsigned char ucTask;				/*<< Index of the allocating task in xTasks[]. */
+	#endif
 } xBlockLink;
 
 
@@ -124,6 +130,48 @@ static xBlockLink xStart, xEnd;
 fragmentation. */
 static size_t xFreeBytesRemaining = configTOTAL_HEAP_SIZE;
 
+#if ( configUSE_HEAP_STATS == 1 )
+
+	/* The lowest value xFreeBytesRemaining has ever fallen to. */
+	static size_t xMinimumEverFreeBytesRemaining = configTOTAL_HEAP_SIZE;
+
+	/* Counters reported by vPortGetHeapStats(). */
+	static unsigned long ulAllocations = 0UL, ulFrees = 0UL, ulFailedAllocations = 0UL;
+	static unsigned short usSizeClass[ portHEAP_SIZE_CLASSES ];
+
+	#if ( configHEAP_DEBUG == 1 )
+		/* Live bytes per pvPortMalloc() call site.  The last slot collects every
+		caller that did not find a free slot of its own. */
+		static xHeapSiteStats xSites[ configHEAP_DEBUG_SITES ];
+		#define heapCALLER_ADDRESS()	__builtin_return_address( 0 )
+	#else
+		#define heapCALLER_ADDRESS()	NULL
+	#endif
+
+	#if ( configHEAP_TASK_STATS == 1 )
+		/* Live and peak bytes per task.  Slot 0 holds the allocations made
+		before the scheduler started and the last slot collects every task that
+		did not find a free slot of its own. */
+		static xHeapTaskStats xTasks[ configHEAP_TASK_SLOTS ];
+	#endif
+
+	/*
+	 * Update the counters after pxBlock has been handed out or is about to be
+	 * returned.  Both are called with the scheduler suspended.
+	 */
+	static void prvRecordAllocation( xBlockLink *pxBlock, size_t xRequestedSize, void *pvCaller );
+	static void prvRecordFree( xBlockLink *pxBlock );
+
+	#if ( configHEAP_TASK_STATS == 1 )
+		/*
+		 * Return the xTasks[] slot of pvTask, claiming a free slot the first
+		 * time the task is seen.  Called with the scheduler suspended.
+		 */
+		static unsigned portBASE_TYPE prvTaskSlot( void *pvTask );
+	#endif
+
+#endif /* configUSE_HEAP_STATS */
+
 /* STATIC FUNCTIONS ARE DEFINED AS MACROS TO MINIMIZE THE FUNCTION CALL DEPTH. */
 
 /*
@@ -178,6 +226,15 @@ void *pvPortMalloc( size_t xWantedSize )
 xBlockLink *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 static portBASE_TYPE xHeapHasBeenInitialised = pdFALSE;
 void *pvReturn = NULL;
+#if ( configUSE_HEAP_STATS == 1 )
+	size_t xRequestedSize = xWantedSize;
+#endif
+#if ( configHEAP_TASK_STATS == 1 )
+	unsigned portBASE_TYPE uxTask;
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+		portBASE_TYPE xOverQuota = pdFALSE;
+	#endif
+#endif
 
 	vTaskSuspendAll();
 	{
@@ -203,6 +260,30 @@ void *pvReturn = NULL;
 			}
 		}
 
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+			if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
+			{
+				uxTask = 0;
+			}
+			else
+			{
+				uxTask = prvTaskSlot( xTaskGetCurrentTaskHandle() );
+			}
+
+			/* A task that would go over its quota is refused before the free
+			list is searched, leaving the rest of the heap to the other tasks. */
+			if( ( xTasks[ uxTask ].xQuota != 0 ) && ( ( xTasks[ uxTask ].xLiveBytes + xWantedSize ) > xTasks[ uxTask ].xQuota ) )
+			{
+				xTasks[ uxTask ].usRefused++;
+				#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+					xOverQuota = pdTRUE;
+				#endif
+				xWantedSize = 0;
+			}
+		}
+		#endif
+
 		if( ( xWantedSize > 0 ) && ( xWantedSize < configTOTAL_HEAP_SIZE ) )
 		{
 			/* Blocks are stored in byte order - traverse the list from the start
@@ -244,14 +325,40 @@ void *pvReturn = NULL;
 				}
 
 				xFreeBytesRemaining -= pxBlock->xBlockSize;
+
+				#if ( configHEAP_TASK_STATS == 1 )
+				{
+					pxBlock->ucTask = ( unsigned char ) uxTask;
+				}
+				#endif
+
+				#if ( configUSE_HEAP_STATS == 1 )
+				{
+					prvRecordAllocation( pxBlock, xRequestedSize, heapCALLER_ADDRESS() );
+				}
+				#endif
+			}
+		}
+
+		#if ( configUSE_HEAP_STATS == 1 )
+		{
+			if( pvReturn == NULL )
+			{
+				ulFailedAllocations++;
 			}
 		}
+		#endif
 	}
 	xTaskResumeAll();
 
 	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
 	{
-		if( pvReturn == NULL )
+		/* A refusal over a task quota does not mean the heap is exhausted. */
+		#if ( configHEAP_TASK_STATS == 1 )
+			if( ( pvReturn == NULL ) && ( xOverQuota == pdFALSE ) )
+		#else
+			if( pvReturn == NULL )
+		#endif
 		{
 			extern void vApplicationMallocFailedHook( void );
 			vApplicationMallocFailedHook();
@@ -279,6 +386,12 @@ xBlockLink *pxLink;
 
 		vTaskSuspendAll();
 		{
+			#if ( configUSE_HEAP_STATS == 1 )
+			{
+				prvRecordFree( pxLink );
+			}
+			#endif
+
 			/* Add this block to the list of free blocks. */
 			prvInsertBlockIntoFreeList( ( ( xBlockLink * ) pxLink ) );
 			xFreeBytesRemaining += pxLink->xBlockSize;
@@ -298,3 +411,227 @@ void vPortInitialiseBlocks( void )
 {
 	/* This just exists to keep the linker quiet. */
 }
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_HEAP_STATS == 1 )
+
+	static void prvRecordAllocation( xBlockLink *pxBlock, size_t xRequestedSize, void *pvCaller )
+	{
+	unsigned portBASE_TYPE uxClass;
+	size_t xClassLimit = 8;
+
+		ulAllocations++;
+
+		if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+		{
+			xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+		}
+
+		/* Find the power of two size class the request falls into. */
+		for( uxClass = 0; ( uxClass < ( portHEAP_SIZE_CLASSES - 1 ) ) && ( xRequestedSize > xClassLimit ); uxClass++ )
+		{
+			xClassLimit <<= 1;
+		}
+
+		if( usSizeClass[ uxClass ] != ( unsigned short ) 0xffff )
+		{
+			usSizeClass[ uxClass ]++;
+		}
+
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+		xHeapTaskStats *pxTask = &( xTasks[ pxBlock->ucTask ] );
+
+			pxTask->xLiveBytes += pxBlock->xBlockSize;
+			if( pxTask->xLiveBytes > pxTask->xPeakBytes )
+			{
+				pxTask->xPeakBytes = pxTask->xLiveBytes;
+			}
+		}
+		#endif
+
+		#if ( configHEAP_DEBUG == 1 )
+		{
+		unsigned portBASE_TYPE uxSite;
+
+			for( uxSite = 0; uxSite < ( configHEAP_DEBUG_SITES - 1 ); uxSite++ )
+			{
+				if( xSites[ uxSite ].pvCaller == NULL )
+				{
+					xSites[ uxSite ].pvCaller = pvCaller;
+					break;
+				}
+				else if( xSites[ uxSite ].pvCaller == pvCaller )
+				{
+					break;
+				}
+			}
+
+			xSites[ uxSite ].xLiveBytes += pxBlock->xBlockSize;
+			xSites[ uxSite ].ulAllocations++;
+			pxBlock->ucSite = ( unsigned char ) uxSite;
+		}
+		#else
+		{
+			( void ) pxBlock;
+			( void ) pvCaller;
+		}
+		#endif
+	}
+	/*-----------------------------------------------------------*/
+
+	static void prvRecordFree( xBlockLink *pxBlock )
+	{
+		ulFrees++;
+
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+			xTasks[ pxBlock->ucTask ].xLiveBytes -= pxBlock->xBlockSize;
+		}
+		#endif
+
+		#if ( configHEAP_DEBUG == 1 )
+		{
+			xSites[ pxBlock->ucSite ].xLiveBytes -= pxBlock->xBlockSize;
+		}
+		#else
+		{
+			( void ) pxBlock;
+		}
+		#endif
+	}
+	/*-----------------------------------------------------------*/
+
+	void vPortGetHeapStats( xHeapStats *pxHeapStats )
+	{
+	xBlockLink *pxBlock;
+	unsigned portBASE_TYPE uxClass;
+
+		vTaskSuspendAll();
+		{
+			pxHeapStats->xFreeBytesRemaining = xFreeBytesRemaining;
+			pxHeapStats->xMinimumEverFreeBytesRemaining = xMinimumEverFreeBytesRemaining;
+			pxHeapStats->ulAllocations = ulAllocations;
+			pxHeapStats->ulFrees = ulFrees;
+			pxHeapStats->ulFailedAllocations = ulFailedAllocations;
+
+			for( uxClass = 0; uxClass < portHEAP_SIZE_CLASSES; uxClass++ )
+			{
+				pxHeapStats->usSizeClass[ uxClass ] = usSizeClass[ uxClass ];
+			}
+
+			if( xStart.pxNextFreeBlock == NULL )
+			{
+				/* pvPortMalloc() has not been called yet, so the heap is still
+				one block. */
+				pxHeapStats->xLargestFreeBlock = configTOTAL_HEAP_SIZE;
+				pxHeapStats->xFreeBlockCount = 1;
+			}
+			else
+			{
+				/* The free list is ordered by size, so the last block before
+				xEnd is the largest. */
+				pxHeapStats->xLargestFreeBlock = 0;
+				pxHeapStats->xFreeBlockCount = 0;
+				for( pxBlock = xStart.pxNextFreeBlock; pxBlock != &xEnd; pxBlock = pxBlock->pxNextFreeBlock )
+				{
+					pxHeapStats->xLargestFreeBlock = pxBlock->xBlockSize;
+					pxHeapStats->xFreeBlockCount++;
+				}
+			}
+		}
+		xTaskResumeAll();
+	}
+	/*-----------------------------------------------------------*/
+
+	#if ( configHEAP_DEBUG == 1 )
+
+		unsigned portBASE_TYPE uxPortGetHeapSiteStats( xHeapSiteStats *pxSites, unsigned portBASE_TYPE uxMaxSites )
+		{
+		unsigned portBASE_TYPE uxSite, uxCount = 0;
+
+			vTaskSuspendAll();
+			{
+				for( uxSite = 0; ( uxSite < configHEAP_DEBUG_SITES ) && ( uxCount < uxMaxSites ); uxSite++ )
+				{
+					if( xSites[ uxSite ].ulAllocations != 0UL )
+					{
+						pxSites[ uxCount++ ] = xSites[ uxSite ];
+					}
+				}
+			}
+			xTaskResumeAll();
+
+			return uxCount;
+		}
+
+	#endif /* configHEAP_DEBUG */
+
+	#if ( configHEAP_TASK_STATS == 1 )
+
+		static unsigned portBASE_TYPE prvTaskSlot( void *pvTask )
+		{
+		unsigned portBASE_TYPE uxSlot;
+
+			for( uxSlot = 1; uxSlot < ( configHEAP_TASK_SLOTS - 1 ); uxSlot++ )
+			{
+				if( xTasks[ uxSlot ].pvTask == NULL )
+				{
+					xTasks[ uxSlot ].pvTask = pvTask;
+					break;
+				}
+				else if( xTasks[ uxSlot ].pvTask == pvTask )
+				{
+					break;
+				}
+			}
+
+			return uxSlot;
+		}
+		/*-----------------------------------------------------------*/
+
+		portBASE_TYPE xPortSetHeapQuota( void *pvTask, size_t xQuota )
+		{
+		unsigned portBASE_TYPE uxSlot;
+		portBASE_TYPE xReturn = pdFAIL;
+
+			vTaskSuspendAll();
+			{
+				/* A NULL handle means the calling task. */
+				if( pvTask == NULL )
+				{
+					pvTask = xTaskGetCurrentTaskHandle();
+				}
+
+				/* The overflow slot is shared by several tasks, so it can not
+				carry a quota. */
+				uxSlot = prvTaskSlot( pvTask );
+				if( uxSlot < ( configHEAP_TASK_SLOTS - 1 ) )
+				{
+					xTasks[ uxSlot ].xQuota = xQuota;
+					xReturn = pdPASS;
+				}
+			}
+			xTaskResumeAll();
+
+			return xReturn;
+		}
+		/*-----------------------------------------------------------*/
+
+		void vPortGetHeapTaskStats( xHeapTaskStats *pxTasks )
+		{
+		unsigned portBASE_TYPE uxSlot;
+
+			vTaskSuspendAll();
+			{
+				for( uxSlot = 0; uxSlot < configHEAP_TASK_SLOTS; uxSlot++ )
+				{
+					pxTasks[ uxSlot ] = xTasks[ uxSlot ];
+				}
+			}
+			xTaskResumeAll();
+		}
+
+	#endif /* configHEAP_TASK_STATS */
+
+#endif /* configUSE_HEAP_STATS */
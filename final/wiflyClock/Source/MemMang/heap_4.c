@@ -112,6 +112,12 @@ typedef struct A_BLOCK_LINK
 {
 	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the list. */
 	size_t xBlockSize;						/*<< The size of the free block. */
+	#if ( configHEAP_DEBUG == 1 )
+		unsigned char ucSite;				/*<< Index of the allocating call site in xSites[]. */
+	#endif
+	#if ( configHEAP_TASK_STATS == 1 )
+		unsigned char ucTask;				/*<< Index of the allocating task in xTasks[]. */
+	#endif
 } xBlockLink;
 
 /*-----------------------------------------------------------*/
@@ -130,6 +136,25 @@ static void prvInsertBlockIntoFreeList( xBlockLink *pxBlockToInsert );
  */
 static void prvHeapInit( void );
 
+#if ( configUSE_HEAP_STATS == 1 )
+
+	/*
+	 * Update the counters after pxBlock has been handed out or is about to be
+	 * returned.  Both are called with the scheduler suspended.
+	 */
+	static void prvRecordAllocation( xBlockLink *pxBlock, size_t xRequestedSize, void *pvCaller );
+	static void prvRecordFree( xBlockLink *pxBlock );
+
+	#if ( configHEAP_TASK_STATS == 1 )
+		/*
+		 * Return the xTasks[] slot of pvTask, claiming a free slot the first
+		 * time the task is seen.  Called with the scheduler suspended.
+		 */
+		static unsigned portBASE_TYPE prvTaskSlot( void *pvTask );
+	#endif
+
+#endif /* configUSE_HEAP_STATS */
+
 /*-----------------------------------------------------------*/
 
 /* The size of the structure placed at the beginning of each allocated memory
@@ -146,6 +171,33 @@ static xBlockLink xStart, *pxEnd = NULL;
 fragmentation. */
 static size_t xFreeBytesRemaining = ( ( size_t ) configTOTAL_HEAP_SIZE ) & ( ( size_t ) ~portBYTE_ALIGNMENT_MASK );
 
+#if ( configUSE_HEAP_STATS == 1 )
+
+	/* The lowest value xFreeBytesRemaining has ever fallen to. */
+	static size_t xMinimumEverFreeBytesRemaining = ( ( size_t ) configTOTAL_HEAP_SIZE ) & ( ( size_t ) ~portBYTE_ALIGNMENT_MASK );
+
+	/* Counters reported by vPortGetHeapStats(). */
+	static unsigned long ulAllocations = 0UL, ulFrees = 0UL, ulFailedAllocations = 0UL;
+	static unsigned short usSizeClass[ portHEAP_SIZE_CLASSES ];
+
+	#if ( configHEAP_DEBUG == 1 )
+		/* Live bytes per pvPortMalloc() call site.  The last slot collects every
+		caller that did not find a free slot of its own. */
+		static xHeapSiteStats xSites[ configHEAP_DEBUG_SITES ];
+		#define heapCALLER_ADDRESS()	__builtin_return_address( 0 )
+	#else
+		#define heapCALLER_ADDRESS()	NULL
+	#endif
+
+	#if ( configHEAP_TASK_STATS == 1 )
+		/* Live and peak bytes per task.  Slot 0 holds the allocations made
+		before the scheduler started and the last slot collects every task that
+		did not find a free slot of its own. */
+		static xHeapTaskStats xTasks[ configHEAP_TASK_SLOTS ];
+	#endif
+
+#endif /* configUSE_HEAP_STATS */
+
 /* STATIC FUNCTIONS ARE DEFINED AS MACROS TO MINIMIZE THE FUNCTION CALL DEPTH. */
 
 /*-----------------------------------------------------------*/
@@ -154,6 +206,15 @@ void *pvPortMalloc( size_t xWantedSize )
 {
 xBlockLink *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 void *pvReturn = NULL;
+#if ( configUSE_HEAP_STATS == 1 )
+	size_t xRequestedSize = xWantedSize;
+#endif
+#if ( configHEAP_TASK_STATS == 1 )
+	unsigned portBASE_TYPE uxTask;
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+		portBASE_TYPE xOverQuota = pdFALSE;
+	#endif
+#endif
 
 	vTaskSuspendAll();
 	{
@@ -179,6 +240,30 @@ void *pvReturn = NULL;
 			}
 		}
 
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+			if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
+			{
+				uxTask = 0;
+			}
+			else
+			{
+				uxTask = prvTaskSlot( xTaskGetCurrentTaskHandle() );
+			}
+
+			/* A task that would go over its quota is refused before the free
+			list is searched, leaving the rest of the heap to the other tasks. */
+			if( ( xTasks[ uxTask ].xQuota != 0 ) && ( ( xTasks[ uxTask ].xLiveBytes + xWantedSize ) > xTasks[ uxTask ].xQuota ) )
+			{
+				xTasks[ uxTask ].usRefused++;
+				#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+					xOverQuota = pdTRUE;
+				#endif
+				xWantedSize = 0;
+			}
+		}
+		#endif
+
 		if( ( xWantedSize > 0 ) && ( xWantedSize < xTotalHeapSize ) )
 		{
 			/* Traverse the list from the start	(lowest address) block until one
@@ -221,14 +306,40 @@ void *pvReturn = NULL;
 				}
 
 				xFreeBytesRemaining -= pxBlock->xBlockSize;
+
+				#if ( configHEAP_TASK_STATS == 1 )
+				{
+					pxBlock->ucTask = ( unsigned char ) uxTask;
+				}
+				#endif
+
+				#if ( configUSE_HEAP_STATS == 1 )
+				{
+					prvRecordAllocation( pxBlock, xRequestedSize, heapCALLER_ADDRESS() );
+				}
+				#endif
 			}
 		}
+
+		#if ( configUSE_HEAP_STATS == 1 )
+		{
+			if( pvReturn == NULL )
+			{
+				ulFailedAllocations++;
+			}
+		}
+		#endif
 	}
 	xTaskResumeAll();
 
 	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
 	{
-		if( pvReturn == NULL )
+		/* A refusal over a task quota does not mean the heap is exhausted. */
+		#if ( configHEAP_TASK_STATS == 1 )
+			if( ( pvReturn == NULL ) && ( xOverQuota == pdFALSE ) )
+		#else
+			if( pvReturn == NULL )
+		#endif
 		{
 			extern void vApplicationMallocFailedHook( void );
 			vApplicationMallocFailedHook();
@@ -256,6 +367,14 @@ xBlockLink *pxLink;
 
 		vTaskSuspendAll();
 		{
+			/* The block size has to be read before it is merged with its
+			neighbours. */
+			#if ( configUSE_HEAP_STATS == 1 )
+			{
+				prvRecordFree( pxLink );
+			}
+			#endif
+
 			/* Add this block to the list of free blocks. */
 			xFreeBytesRemaining += pxLink->xBlockSize;
 			prvInsertBlockIntoFreeList( ( ( xBlockLink * ) pxLink ) );
@@ -361,4 +480,230 @@ unsigned char *puc;
 		pxIterator->pxNextFreeBlock = pxBlockToInsert;
 	}
 }
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_HEAP_STATS == 1 )
+
+	static void prvRecordAllocation( xBlockLink *pxBlock, size_t xRequestedSize, void *pvCaller )
+	{
+	unsigned portBASE_TYPE uxClass;
+	size_t xClassLimit = 8;
+
+		ulAllocations++;
+
+		if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+		{
+			xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+		}
+
+		/* Find the power of two size class the request falls into. */
+		for( uxClass = 0; ( uxClass < ( portHEAP_SIZE_CLASSES - 1 ) ) && ( xRequestedSize > xClassLimit ); uxClass++ )
+		{
+			xClassLimit <<= 1;
+		}
+
+		if( usSizeClass[ uxClass ] != ( unsigned short ) 0xffff )
+		{
+			usSizeClass[ uxClass ]++;
+		}
+
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+		xHeapTaskStats *pxTask = &( xTasks[ pxBlock->ucTask ] );
+
+			pxTask->xLiveBytes += pxBlock->xBlockSize;
+			if( pxTask->xLiveBytes > pxTask->xPeakBytes )
+			{
+				pxTask->xPeakBytes = pxTask->xLiveBytes;
+			}
+		}
+		#endif
+
+		#if ( configHEAP_DEBUG == 1 )
+		{
+		unsigned portBASE_TYPE uxSite;
+
+			for( uxSite = 0; uxSite < ( configHEAP_DEBUG_SITES - 1 ); uxSite++ )
+			{
+				if( xSites[ uxSite ].pvCaller == NULL )
+				{
+					xSites[ uxSite ].pvCaller = pvCaller;
+					break;
+				}
+				else if( xSites[ uxSite ].pvCaller == pvCaller )
+				{
+					break;
+				}
+			}
+
+			xSites[ uxSite ].xLiveBytes += pxBlock->xBlockSize;
+			xSites[ uxSite ].ulAllocations++;
+			pxBlock->ucSite = ( unsigned char ) uxSite;
+		}
+		#else
+		{
+			( void ) pxBlock;
+			( void ) pvCaller;
+		}
+		#endif
+	}
+	/*-----------------------------------------------------------*/
+
+	static void prvRecordFree( xBlockLink *pxBlock )
+	{
+		ulFrees++;
+
+		#if ( configHEAP_TASK_STATS == 1 )
+		{
+			xTasks[ pxBlock->ucTask ].xLiveBytes -= pxBlock->xBlockSize;
+		}
+		#endif
+
+		#if ( configHEAP_DEBUG == 1 )
+		{
+			xSites[ pxBlock->ucSite ].xLiveBytes -= pxBlock->xBlockSize;
+		}
+		#else
+		{
+			( void ) pxBlock;
+		}
+		#endif
+	}
+	/*-----------------------------------------------------------*/
+
+	void vPortGetHeapStats( xHeapStats *pxHeapStats )
+	{
+	xBlockLink *pxBlock;
+	unsigned portBASE_TYPE uxClass;
+
+		vTaskSuspendAll();
+		{
+			pxHeapStats->xFreeBytesRemaining = xFreeBytesRemaining;
+			pxHeapStats->xMinimumEverFreeBytesRemaining = xMinimumEverFreeBytesRemaining;
+			pxHeapStats->ulAllocations = ulAllocations;
+			pxHeapStats->ulFrees = ulFrees;
+			pxHeapStats->ulFailedAllocations = ulFailedAllocations;
+
+			for( uxClass = 0; uxClass < portHEAP_SIZE_CLASSES; uxClass++ )
+			{
+				pxHeapStats->usSizeClass[ uxClass ] = usSizeClass[ uxClass ];
+			}
+
+			if( pxEnd == NULL )
+			{
+				/* pvPortMalloc() has not been called yet, so the heap is still
+				one block. */
+				pxHeapStats->xLargestFreeBlock = xTotalHeapSize - heapSTRUCT_SIZE;
+				pxHeapStats->xFreeBlockCount = 1;
+			}
+			else
+			{
+				/* The free list is ordered by address, so every block has to
+				be looked at to find the largest. */
+				pxHeapStats->xLargestFreeBlock = 0;
+				pxHeapStats->xFreeBlockCount = 0;
+				for( pxBlock = xStart.pxNextFreeBlock; pxBlock != pxEnd; pxBlock = pxBlock->pxNextFreeBlock )
+				{
+					if( pxBlock->xBlockSize > pxHeapStats->xLargestFreeBlock )
+					{
+						pxHeapStats->xLargestFreeBlock = pxBlock->xBlockSize;
+					}
+					pxHeapStats->xFreeBlockCount++;
+				}
+			}
+		}
+		xTaskResumeAll();
+	}
+	/*-----------------------------------------------------------*/
+
+	#if ( configHEAP_DEBUG == 1 )
+
+		unsigned portBASE_TYPE uxPortGetHeapSiteStats( xHeapSiteStats *pxSites, unsigned portBASE_TYPE uxMaxSites )
+		{
+		unsigned portBASE_TYPE uxSite, uxCount = 0;
+
+			vTaskSuspendAll();
+			{
+				for( uxSite = 0; ( uxSite < configHEAP_DEBUG_SITES ) && ( uxCount < uxMaxSites ); uxSite++ )
+				{
+					if( xSites[ uxSite ].ulAllocations != 0UL )
+					{
+						pxSites[ uxCount++ ] = xSites[ uxSite ];
+					}
+				}
+			}
+			xTaskResumeAll();
+
+			return uxCount;
+		}
+
+	#endif /* configHEAP_DEBUG */
+
+	#if ( configHEAP_TASK_STATS == 1 )
+
+		static unsigned portBASE_TYPE prvTaskSlot( void *pvTask )
+		{
+		unsigned portBASE_TYPE uxSlot;
+
+			for( uxSlot = 1; uxSlot < ( configHEAP_TASK_SLOTS - 1 ); uxSlot++ )
+			{
+				if( xTasks[ uxSlot ].pvTask == NULL )
+				{
+					xTasks[ uxSlot ].pvTask = pvTask;
+					break;
+				}
+				else if( xTasks[ uxSlot ].pvTask == pvTask )
+				{
+					break;
+				}
+			}
+
+			return uxSlot;
+		}
+		/*-----------------------------------------------------------*/
+
+		portBASE_TYPE xPortSetHeapQuota( void *pvTask, size_t xQuota )
+		{
+		unsigned portBASE_TYPE uxSlot;
+		portBASE_TYPE xReturn = pdFAIL;
+
+			vTaskSuspendAll();
+			{
+				/* A NULL handle means the calling task. */
+				if( pvTask == NULL )
+				{
+					pvTask = xTaskGetCurrentTaskHandle();
+				}
+
+				/* The overflow slot is shared by several tasks, so it can not
+				carry a quota. */
+				uxSlot = prvTaskSlot( pvTask );
+				if( uxSlot < ( configHEAP_TASK_SLOTS - 1 ) )
+				{
+					xTasks[ uxSlot ].xQuota = xQuota;
+					xReturn = pdPASS;
+				}
+			}
+			xTaskResumeAll();
+
+			return xReturn;
+		}
+		/*-----------------------------------------------------------*/
+
+		void vPortGetHeapTaskStats( xHeapTaskStats *pxTasks )
+		{
+		unsigned portBASE_TYPE uxSlot;
+
+			vTaskSuspendAll();
+			{
+				for( uxSlot = 0; uxSlot < configHEAP_TASK_SLOTS; uxSlot++ )
+				{
+					pxTasks[ uxSlot ] = xTasks[ uxSlot ];
+				}
+			}
+			xTaskResumeAll();
+		}
+
+	#endif /* configHEAP_TASK_STATS */
 
+#endif /* configUSE_HEAP_STATS */
@@ -0,0 +1,636 @@
+/*
+    FreeRTOS V7.3.0 - Copyright (C) 2012 Real Time Engineers Ltd.
+
+    FEATURES AND PORTS ARE ADDED TO FREERTOS ALL THE TIME.  PLEASE VISIT
+    http://www.FreeRTOS.org TO ENSURE YOU ARE USING THE LATEST VERSION.
+
+    ***************************************************************************
+     *                                                                       *
+     *    FreeRTOS tutorial books are available in pdf and paperback.        *
+     *    Complete, revised, and edited pdf reference manuals are also       *
+     *    available.                                                         *
+     *                                                                       *
+     *    Purchasing FreeRTOS documentation will not only help you, by       *
+     *    ensuring you get running as quickly as possible and with an        *
+     *    in-depth knowledge of how to use FreeRTOS, it will also help       *
+     *    the FreeRTOS project to continue with its mission of providing     *
+     *    professional grade, cross platform, de facto standard solutions    *
+     *    for microcontrollers - completely free of charge!                  *
+     *                                                                       *
+     *    >>> See http://www.FreeRTOS.org/Documentation for details. <<<     *
+     *                                                                       *
+     *    Thank you for using FreeRTOS, and thank you for your support!      *
+     *                                                                       *
+    ***************************************************************************
+
+
+    This file is part of the FreeRTOS distribution.
+
+    FreeRTOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 2) as published by the
+    Free Software Foundation AND MODIFIED BY the FreeRTOS exception.
+    >>>NOTE<<< The modification to the GPL is included to allow you to
+    distribute a combined work that includes FreeRTOS without being obliged to
+    provide the source code for proprietary components outside of the FreeRTOS
+    kernel.  FreeRTOS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+    more details. You should have received a copy of the GNU General Public
+    License and the FreeRTOS license exception along with FreeRTOS; if not it
+    can be viewed here: http://www.freertos.org/a00114.html and also obtained
+    by writing to Richard Barry, contact details for whom are available on the
+    FreeRTOS WEB site.
+
+    1 tab == 4 spaces!
+
+    ***************************************************************************
+     *                                                                       *
+     *    Having a problem?  Start by reading the FAQ "My application does   *
+     *    not run, what could be wrong?"                                     *
+     *                                                                       *
+     *    http://www.FreeRTOS.org/FAQHelp.html                               *
+     *                                                                       *
+    ***************************************************************************
+
+
+    http://www.FreeRTOS.org - Documentation, training, latest versions, license
+    and contact details.
+
+    http://www.FreeRTOS.org/plus - A selection of FreeRTOS ecosystem products,
+    including FreeRTOS+Trace - an indispensable productivity tool.
+
+    Real Time Engineers ltd license FreeRTOS to High Integrity Systems, who sell
+    the code with commercial support, indemnification, and middleware, under
+    the OpenRTOS brand: http://www.OpenRTOS.com.  High Integrity Systems also
+    provide a safety engineered and independently SIL3 certified version under
+    the SafeRTOS brand: http://www.SafeRTOS.com.
+*/
+
+/*
+ * A pvPortMalloc() and vPortFree() implementation that manages several
+ * regions: the internal SRAM of the AVR and, when a QuadRAM or MegaRAM is
+ * fitted, every bank of the external RAM.  Each region keeps its own address
+ * ordered free list and combines adjacent free blocks as heap_4.c does.
+ *
+ * pvPortMalloc() only ever returns internal SRAM, so task control blocks,
+ * stacks and queues stay in fast memory that every task and interrupt can
+ * reach.  Bulk buffers are requested with pvPortMallocHint( x, portHEAP_BULK )
+ * which places them in XRAM bank 0.  Bank 0 is mapped in at all times, so
+ * those pointers can be used like any other.
+ *
+ * The remaining banks are only mapped in for short windows.  Memory in them
+ * comes from pvPortMallocBanked(), and is reached by bracketing the access
+ * with vPortBankSelect() and vPortBankRestore(), or with the vPortBankRead()
+ * and vPortBankWrite() copy helpers.  The scheduler is suspended while another
+ * bank is mapped so no other task can see the wrong memory.  Interrupt
+ * handlers must never touch XRAM.
+ *
+ * This heap owns the whole of XRAM, so the avr-libc malloc() heap must not be
+ * moved there (call extRAMInitHeap( false ), or not at all), and the
+ * .ext_ram_heap linker options used by heap_1.c, heap_2.c and heap_4.c are not
+ * required.  configINTERNAL_HEAP_SIZE sets the size of the internal region.
+ *
+ * Set configUSE_HEAP_REGIONS to 1 in FreeRTOSConfig.h when using this file.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#if ( configUSE_HEAP_REGIONS != 1 )
+	#error configUSE_HEAP_REGIONS must be set to 1 in FreeRTOSConfig.h to use heap_banked.c
+#endif
+
+#if ( configUSE_HEAP_STATS == 1 )
+	#error heap_banked.c does not implement configUSE_HEAP_STATS, use heap_2.c or heap_4.c
+#endif
+
+/* XRAM is only available to the heap when it is not given over to ramfs. */
+#if defined( portEXT_RAM ) && !defined( portEXT_RAMFS )
+	#include <ext_ram.h>
+	#define heapXRAM_BANKS		RAM_BANKS
+#else
+	#define heapXRAM_BANKS		0
+#endif
+
+/* Region 0 is internal SRAM, region n + 1 is XRAM bank n. */
+#define heapREGIONS				( 1 + heapXRAM_BANKS )
+#define heapINTERNAL_REGION		0
+#define heapBANK_REGION( ucBank )	( ( unsigned portBASE_TYPE ) ( ucBank ) + 1 )
+
+#ifndef configINTERNAL_HEAP_SIZE
+	#define configINTERNAL_HEAP_SIZE	configTOTAL_HEAP_SIZE
+#endif
+
+/* Block sizes must not get too small. */
+#define heapMINIMUM_BLOCK_SIZE	( ( size_t ) ( heapSTRUCT_SIZE * 2 ) )
+
+/* Allocate the memory for the internal region.  The struct is used to force
+byte alignment without using any non-portable code. */
+static union xRTOS_HEAP
+{
+	#if portBYTE_ALIGNMENT == 8
+		volatile portDOUBLE dDummy;
+	#else
+		volatile unsigned long ulDummy;
+	#endif
+	unsigned char ucHeap[ configINTERNAL_HEAP_SIZE ];
+} xHeap;
+
+/* Define the linked list structure.  This is used to link free blocks in order
+of their memory address. */
+typedef struct A_BLOCK_LINK
+{
+	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the list. */
+	size_t xBlockSize;						/*<< The size of the free block. */
+} xBlockLink;
+
+/* Each region has its own free list.  The list links of an XRAM region live in
+that region, so they can only be followed while its bank is mapped. */
+typedef struct xHEAP_REGION
+{
+	xBlockLink xStart;						/*<< Marks the start of the free list. */
+	xBlockLink *pxEnd;						/*<< Marks the end of the free list, NULL until the region is initialised. */
+	size_t xFreeBytesRemaining;				/*<< Free bytes in this region. */
+} xHeapRegion;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Inserts a block of memory that is being freed into the correct position in
+ * the free list of pxRegion, merging it with adjacent free blocks.
+ */
+static void prvInsertBlockIntoFreeList( xHeapRegion *pxRegion, xBlockLink *pxBlockToInsert );
+
+/*
+ * Sets up the free list of a region the first time it is used.
+ */
+static void prvRegionInit( unsigned portBASE_TYPE uxRegion );
+
+/*
+ * Allocate from, or free into, a single region.  Must be called with the
+ * scheduler suspended.  The bank holding the region is mapped in for the
+ * duration of the call.
+ */
+static void *prvRegionMalloc( unsigned portBASE_TYPE uxRegion, size_t xWantedSize );
+static void prvRegionFree( unsigned portBASE_TYPE uxRegion, void *pv );
+
+/*
+ * Map in the bank holding a region, and map back whichever bank the
+ * application had selected.
+ */
+static void prvMapRegion( unsigned portBASE_TYPE uxRegion );
+static void prvUnmapRegion( unsigned portBASE_TYPE uxRegion );
+
+/*-----------------------------------------------------------*/
+
+/* The size of the structure placed at the beginning of each allocated memory
+block must by correctly byte aligned. */
+static const unsigned short heapSTRUCT_SIZE	= ( sizeof( xBlockLink ) + portBYTE_ALIGNMENT - ( sizeof( xBlockLink ) % portBYTE_ALIGNMENT ) );
+
+static xHeapRegion xRegions[ heapREGIONS ];
+
+/* The bank the application has mapped in with vPortBankSelect(), 0 otherwise. */
+static unsigned char ucBankMapped = 0;
+
+/*-----------------------------------------------------------*/
+
+void *pvPortMalloc( size_t xWantedSize )
+{
+	return pvPortMallocHint( xWantedSize, portHEAP_INTERNAL );
+}
+/*-----------------------------------------------------------*/
+
+void *pvPortMallocHint( size_t xWantedSize, unsigned char ucHint )
+{
+unsigned portBASE_TYPE uxRegion = heapINTERNAL_REGION;
+void *pvReturn;
+
+	/* Without XRAM every hint is served from internal SRAM. */
+	#if ( heapXRAM_BANKS > 0 )
+	{
+		if( ucHint == portHEAP_BULK )
+		{
+			uxRegion = heapBANK_REGION( 0 );
+		}
+	}
+	#else
+	{
+		( void ) ucHint;
+	}
+	#endif
+
+	vTaskSuspendAll();
+	{
+		pvReturn = prvRegionMalloc( uxRegion, xWantedSize );
+	}
+	xTaskResumeAll();
+
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+	{
+		if( pvReturn == NULL )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+	}
+	#endif
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void *pvPortMallocBanked( size_t xWantedSize, unsigned char ucBank )
+{
+void *pvReturn = NULL;
+
+	if( ucBank < heapXRAM_BANKS )
+	{
+		vTaskSuspendAll();
+		{
+			pvReturn = prvRegionMalloc( heapBANK_REGION( ucBank ), xWantedSize );
+		}
+		xTaskResumeAll();
+	}
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortFree( void *pv )
+{
+unsigned char *puc = ( unsigned char * ) pv;
+
+	if( pv != NULL )
+	{
+		vTaskSuspendAll();
+		{
+			/* Anything outside the internal array came from XRAM bank 0, the
+			only bank pvPortMallocHint() uses. */
+			if( ( puc >= xHeap.ucHeap ) && ( puc < ( xHeap.ucHeap + configINTERNAL_HEAP_SIZE ) ) )
+			{
+				prvRegionFree( heapINTERNAL_REGION, pv );
+			}
+			else
+			{
+				#if ( heapXRAM_BANKS > 0 )
+				{
+					prvRegionFree( heapBANK_REGION( 0 ), pv );
+				}
+				#else
+				{
+					configASSERT( pdFALSE );
+				}
+				#endif
+			}
+		}
+		xTaskResumeAll();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortFreeBanked( void *pv, unsigned char ucBank )
+{
+	if( ( pv != NULL ) && ( ucBank < heapXRAM_BANKS ) )
+	{
+		vTaskSuspendAll();
+		{
+			prvRegionFree( heapBANK_REGION( ucBank ), pv );
+		}
+		xTaskResumeAll();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortBankSelect( unsigned char ucBank )
+{
+	configASSERT( ucBank < heapXRAM_BANKS );
+
+	/* Nothing else may run while the bank is switched.  The matching
+	xTaskResumeAll() is in vPortBankRestore(). */
+	vTaskSuspendAll();
+
+	#if ( heapXRAM_BANKS > 0 )
+	{
+		ucBankMapped = ucBank;
+		setMemoryBank( ucBank, false );
+	}
+	#else
+	{
+		( void ) ucBank;
+	}
+	#endif
+}
+/*-----------------------------------------------------------*/
+
+void vPortBankRestore( void )
+{
+	#if ( heapXRAM_BANKS > 0 )
+	{
+		ucBankMapped = 0;
+		setMemoryBank( 0, false );
+	}
+	#endif
+
+	xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+void vPortBankRead( void *pvDest, const void *pvSource, size_t xLength, unsigned char ucBank )
+{
+	vPortBankSelect( ucBank );
+	memcpy( pvDest, pvSource, xLength );
+	vPortBankRestore();
+}
+/*-----------------------------------------------------------*/
+
+void vPortBankWrite( void *pvDest, const void *pvSource, size_t xLength, unsigned char ucBank )
+{
+	vPortBankSelect( ucBank );
+	memcpy( pvDest, pvSource, xLength );
+	vPortBankRestore();
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize( void )
+{
+	return xPortGetFreeBankSize( portHEAP_INTERNAL_BANK );
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeBankSize( unsigned char ucBank )
+{
+unsigned portBASE_TYPE uxRegion;
+size_t xReturn = 0;
+
+	uxRegion = ( ucBank == portHEAP_INTERNAL_BANK ) ? heapINTERNAL_REGION : heapBANK_REGION( ucBank );
+
+	if( uxRegion < heapREGIONS )
+	{
+		vTaskSuspendAll();
+		{
+			if( xRegions[ uxRegion ].pxEnd == NULL )
+			{
+				prvMapRegion( uxRegion );
+				prvRegionInit( uxRegion );
+				prvUnmapRegion( uxRegion );
+			}
+			xReturn = xRegions[ uxRegion ].xFreeBytesRemaining;
+		}
+		xTaskResumeAll();
+	}
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortInitialiseBlocks( void )
+{
+	/* This just exists to keep the linker quiet. */
+}
+/*-----------------------------------------------------------*/
+
+static void prvMapRegion( unsigned portBASE_TYPE uxRegion )
+{
+	#if ( heapXRAM_BANKS > 0 )
+	{
+		if( uxRegion != heapINTERNAL_REGION )
+		{
+			setMemoryBank( ( uint8_t ) ( uxRegion - 1 ), false );
+		}
+	}
+	#else
+	{
+		( void ) uxRegion;
+	}
+	#endif
+}
+/*-----------------------------------------------------------*/
+
+static void prvUnmapRegion( unsigned portBASE_TYPE uxRegion )
+{
+	#if ( heapXRAM_BANKS > 0 )
+	{
+		if( uxRegion != heapINTERNAL_REGION )
+		{
+			setMemoryBank( ucBankMapped, false );
+		}
+	}
+	#else
+	{
+		( void ) uxRegion;
+	}
+	#endif
+}
+/*-----------------------------------------------------------*/
+
+static void *prvRegionMalloc( unsigned portBASE_TYPE uxRegion, size_t xWantedSize )
+{
+xHeapRegion *pxRegion = &xRegions[ uxRegion ];
+xBlockLink *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
+void *pvReturn = NULL;
+
+	prvMapRegion( uxRegion );
+
+	/* If this is the first allocation from the region then its free list
+	has to be set up. */
+	if( pxRegion->pxEnd == NULL )
+	{
+		prvRegionInit( uxRegion );
+	}
+
+	/* The wanted size is increased so it can contain a xBlockLink
+	structure in addition to the requested amount of bytes. */
+	if( xWantedSize > 0 )
+	{
+		xWantedSize += heapSTRUCT_SIZE;
+
+		/* Ensure that blocks are always aligned to the required number of
+		bytes. */
+		if( xWantedSize & portBYTE_ALIGNMENT_MASK )
+		{
+			/* Byte alignment required. */
+			xWantedSize += ( portBYTE_ALIGNMENT - ( xWantedSize & portBYTE_ALIGNMENT_MASK ) );
+		}
+	}
+
+	if( ( xWantedSize > 0 ) && ( xWantedSize < pxRegion->xFreeBytesRemaining ) )
+	{
+		/* Traverse the list from the start	(lowest address) block until one
+		of adequate size is found. */
+		pxPreviousBlock = &( pxRegion->xStart );
+		pxBlock = pxRegion->xStart.pxNextFreeBlock;
+		while( ( pxBlock->xBlockSize < xWantedSize ) && ( pxBlock->pxNextFreeBlock != NULL ) )
+		{
+			pxPreviousBlock = pxBlock;
+			pxBlock = pxBlock->pxNextFreeBlock;
+		}
+
+		/* If the end marker was reached then a block of adequate size was
+		not found. */
+		if( pxBlock != pxRegion->pxEnd )
+		{
+			/* Return the memory space - jumping over the xBlockLink structure
+			at its start. */
+			pvReturn = ( void * ) ( ( ( unsigned char * ) pxPreviousBlock->pxNextFreeBlock ) + heapSTRUCT_SIZE );
+
+			/* This block is being returned for use so must be taken out of
+			the	list of free blocks. */
+			pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+
+			/* If the block is larger than required it can be split into two. */
+			if( ( pxBlock->xBlockSize - xWantedSize ) > heapMINIMUM_BLOCK_SIZE )
+			{
+				/* This block is to be split into two.  Create a new block
+				following the number of bytes requested. The void cast is
+				used to prevent byte alignment warnings from the compiler. */
+				pxNewBlockLink = ( void * ) ( ( ( unsigned char * ) pxBlock ) + xWantedSize );
+
+				/* Calculate the sizes of two blocks split from the single
+				block. */
+				pxNewBlockLink->xBlockSize = pxBlock->xBlockSize - xWantedSize;
+				pxBlock->xBlockSize = xWantedSize;
+
+				/* Insert the new block into the list of free blocks. */
+				prvInsertBlockIntoFreeList( pxRegion, pxNewBlockLink );
+			}
+
+			pxRegion->xFreeBytesRemaining -= pxBlock->xBlockSize;
+		}
+	}
+
+	prvUnmapRegion( uxRegion );
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRegionFree( unsigned portBASE_TYPE uxRegion, void *pv )
+{
+xHeapRegion *pxRegion = &xRegions[ uxRegion ];
+unsigned char *puc = ( unsigned char * ) pv;
+xBlockLink *pxLink;
+
+	/* The memory being freed will have an xBlockLink structure immediately
+	before it. */
+	puc -= heapSTRUCT_SIZE;
+
+	/* This casting is to keep the compiler from issuing warnings. */
+	pxLink = ( void * ) puc;
+
+	prvMapRegion( uxRegion );
+	{
+		/* Add this block to the list of free blocks. */
+		pxRegion->xFreeBytesRemaining += pxLink->xBlockSize;
+		prvInsertBlockIntoFreeList( pxRegion, pxLink );
+	}
+	prvUnmapRegion( uxRegion );
+}
+/*-----------------------------------------------------------*/
+
+static void prvRegionInit( unsigned portBASE_TYPE uxRegion )
+{
+xHeapRegion *pxRegion = &xRegions[ uxRegion ];
+xBlockLink *pxFirstFreeBlock;
+unsigned char *pucStart;
+size_t xTotalSize;
+
+	#if ( heapXRAM_BANKS > 0 )
+	if( uxRegion != heapINTERNAL_REGION )
+	{
+		/* Every bank covers the same address range. */
+		pucStart = ( unsigned char * ) XRAMSTART;
+		xTotalSize = ( ( size_t ) ( XRAMEND - XRAMSTART ) + 1 ) & ( ( size_t ) ~portBYTE_ALIGNMENT_MASK );
+	}
+	else
+	#endif
+	{
+		pucStart = xHeap.ucHeap;
+		xTotalSize = ( ( size_t ) configINTERNAL_HEAP_SIZE ) & ( ( size_t ) ~portBYTE_ALIGNMENT_MASK );
+	}
+
+	/* Ensure the start of the region is aligned. */
+	configASSERT( ( ( ( unsigned long ) pucStart ) & ( ( unsigned long ) portBYTE_ALIGNMENT_MASK ) ) == 0UL );
+
+	/* xStart is used to hold a pointer to the first item in the list of free
+	blocks.  The void cast is used to prevent compiler warnings. */
+	pxRegion->xStart.pxNextFreeBlock = ( void * ) pucStart;
+	pxRegion->xStart.xBlockSize = ( size_t ) 0;
+
+	/* pxEnd is used to mark the end of the list of free blocks and is inserted
+	at the end of the region.  The size is subtracted before it is added to
+	the start, as the last XRAM bank ends at the top of the address space. */
+	pxRegion->pxEnd = ( void * ) ( pucStart + ( xTotalSize - heapSTRUCT_SIZE ) );
+	pxRegion->pxEnd->xBlockSize = 0;
+	pxRegion->pxEnd->pxNextFreeBlock = NULL;
+
+	/* To start with there is a single free block that is sized to take up the
+	entire region, minus the space taken by pxEnd. */
+	pxFirstFreeBlock = ( void * ) pucStart;
+	pxFirstFreeBlock->xBlockSize = xTotalSize - heapSTRUCT_SIZE;
+	pxFirstFreeBlock->pxNextFreeBlock = pxRegion->pxEnd;
+
+	pxRegion->xFreeBytesRemaining = xTotalSize - heapSTRUCT_SIZE;
+}
+/*-----------------------------------------------------------*/
+
+static void prvInsertBlockIntoFreeList( xHeapRegion *pxRegion, xBlockLink *pxBlockToInsert )
+{
+xBlockLink *pxIterator;
+unsigned char *puc;
+
+	/* Iterate through the list until a block is found that has a higher address
+	than the block being inserted. */
+	for( pxIterator = &( pxRegion->xStart ); pxIterator->pxNextFreeBlock < pxBlockToInsert; pxIterator = pxIterator->pxNextFreeBlock )
+	{
+		/* Nothing to do here, just iterate to the right position. */
+	}
+
+	/* Do the block being inserted, and the block it is being inserted after
+	make a contiguous block of memory?  xStart lives outside the region so it
+	can never be merged with. */
+	puc = ( unsigned char * ) pxIterator;
+	if( ( pxIterator != &( pxRegion->xStart ) ) && ( ( puc + pxIterator->xBlockSize ) == ( unsigned char * ) pxBlockToInsert ) )
+	{
+		pxIterator->xBlockSize += pxBlockToInsert->xBlockSize;
+		pxBlockToInsert = pxIterator;
+	}
+
+	/* Do the block being inserted, and the block it is being inserted before
+	make a contiguous block of memory? */
+	puc = ( unsigned char * ) pxBlockToInsert;
+	if( ( puc + pxBlockToInsert->xBlockSize ) == ( unsigned char * ) pxIterator->pxNextFreeBlock )
+	{
+		if( pxIterator->pxNextFreeBlock != pxRegion->pxEnd )
+		{
+			/* Form one big block from the two blocks. */
+			pxBlockToInsert->xBlockSize += pxIterator->pxNextFreeBlock->xBlockSize;
+			pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock->pxNextFreeBlock;
+		}
+		else
+		{
+			pxBlockToInsert->pxNextFreeBlock = pxRegion->pxEnd;
+		}
+	}
+	else
+	{
+		pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock;
+	}
+
+	/* If the block being inserted plugged a gab, so was merged with the block
+	before and the block after, then it's pxNextFreeBlock pointer will have
+	already been set, and should not be set here as that would make it point
+	to itself. */
+	if( pxIterator != pxBlockToInsert )
+	{
+		pxIterator->pxNextFreeBlock = pxBlockToInsert;
+	}
+}
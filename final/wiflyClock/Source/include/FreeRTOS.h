@@ -514,6 +514,46 @@ typedef portBASE_TYPE (*pdTASK_HOOK_CODE)( void * );
 	#define configUSE_MALLOC_FAILED_HOOK 0
 #endif
 
+#ifndef configUSE_HEAP_STATS
+	#define configUSE_HEAP_STATS 0
+#endif
+
+#ifndef configHEAP_DEBUG
+	#define configHEAP_DEBUG 0
+#endif
+
+#ifndef configUSE_HEAP_REGIONS
+	#define configUSE_HEAP_REGIONS 0
+#endif
+
+#ifndef configHEAP_DEBUG_SITES
+	#define configHEAP_DEBUG_SITES 12
+#endif
+
+#if ( configHEAP_DEBUG == 1 ) && ( configUSE_HEAP_STATS == 0 )
+	#error configUSE_HEAP_STATS must be set to 1 when configHEAP_DEBUG is set to 1.
+#endif
+
+#ifndef configHEAP_TASK_STATS
+	#define configHEAP_TASK_STATS 0
+#endif
+
+#ifndef configHEAP_TASK_SLOTS
+	#define configHEAP_TASK_SLOTS 8
+#endif
+
+#if ( configHEAP_TASK_STATS == 1 )
+	#if ( configUSE_HEAP_STATS == 0 )
+		#error configUSE_HEAP_STATS must be set to 1 when configHEAP_TASK_STATS is set to 1.
+	#endif
+	#if ( INCLUDE_xTaskGetSchedulerState == 0 ) && ( configUSE_TIMERS == 0 )
+		#error INCLUDE_xTaskGetSchedulerState must be set to 1 when configHEAP_TASK_STATS is set to 1.
+	#endif
+	#if ( INCLUDE_xTaskGetCurrentTaskHandle == 0 ) && ( configUSE_MUTEXES == 0 )
+		#error INCLUDE_xTaskGetCurrentTaskHandle must be set to 1 when configHEAP_TASK_STATS is set to 1.
+	#endif
+#endif
+
 #ifndef portPRIVILEGE_BIT
 	#define portPRIVILEGE_BIT ( ( unsigned portBASE_TYPE ) 0x00 )
 #endif
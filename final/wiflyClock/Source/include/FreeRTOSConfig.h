@@ -190,6 +190,18 @@
 #define configCHECK_FOR_STACK_OVERFLOW  1
 #define configQUEUE_REGISTRY_SIZE	    0
 
+/* Heap instrumentation (heap_2.c and heap_4.c). configHEAP_DEBUG adds per call site totals,
+configHEAP_TASK_STATS adds per task totals and quotas. */
+#define configUSE_HEAP_STATS            1
+#define configHEAP_DEBUG                0
+#define configHEAP_TASK_STATS           1
+#define configHEAP_TASK_SLOTS           10
+
+/* Set to 1 when linking heap_banked.c, which spreads the heap over internal SRAM
+and the XRAM banks. configINTERNAL_HEAP_SIZE then sizes the internal region. */
+#define configUSE_HEAP_REGIONS          0
+#define configINTERNAL_HEAP_SIZE        ( (size_t ) 0x1000 )
+
 /* Timer definitions. */
 #define configUSE_TIMERS				0
 #define configTIMER_TASK_PRIORITY       ( ( unsigned portBASE_TYPE ) 7 )
@@ -211,8 +223,9 @@ to exclude the API function. */
 #define INCLUDE_vResumeFromISR                  1
 #define INCLUDE_vTaskDelayUntil			        1
 #define INCLUDE_vTaskDelay			            1
-#define INCLUDE_xTaskGetSchedulerState          0
+#define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       0
 #define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_pcTaskGetTaskName               1
 
 #endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,96 @@
+/*
+ * lib_log.h
+ *
+ * Deferred logging. A call site records only the PROGMEM address of its format
+ * string and the raw argument words into a ring of fixed size records, which
+ * takes a few microseconds and never blocks. A low priority task drains the
+ * ring later and either formats each record onto the serial port, or, with
+ * logBINARY_OUTPUT set, sends the record as is for a host side decoder to
+ * format against the .elf file.
+ *
+ * Arguments are copied by value as 16 bit words, so a %s or %S argument must
+ * point at a string that is still unchanged when the log task gets to it
+ * (a PSTR() or a static buffer). Anything else should be formatted directly.
+ */
+
+#ifndef LIB_LOG_H
+#define LIB_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include <FreeRTOS.h>
+
+/* Number of records held, must be a power of two no larger than 128. */
+#ifndef logQUEUE_LENGTH
+	#define logQUEUE_LENGTH			16
+#endif
+
+/* Largest number of argument words kept per record. A long or a double takes
+two. A format needing more is logged as "[log: format too long]" instead. */
+#ifndef logMAX_WORDS
+	#define logMAX_WORDS			6
+#endif
+
+/* Longest formatted line, including the terminator. */
+#ifndef logLINE_LENGTH
+	#define logLINE_LENGTH			80
+#endif
+
+/* How long the log task sleeps when it finds the ring empty. */
+#ifndef logPOLL_PERIOD
+	#define logPOLL_PERIOD			( ( portTickType ) ( 20 / portTICK_RATE_MS ) )
+#endif
+
+#ifndef logSTACK_SIZE
+	#define logSTACK_SIZE			( configMINIMAL_STACK_SIZE + 100 )
+#endif
+
+/* 1 to send raw records instead of formatted text. Each record goes out as
+logBINARY_SYNC, the format address (low byte first), the word count and the
+argument words (low byte first). A format address of zero carries the count of
+records dropped because the ring was full. */
+#ifndef logBINARY_OUTPUT
+	#define logBINARY_OUTPUT		0
+#endif
+
+#define logBINARY_SYNC				0xA5
+
+/*-----------------------------------------------------------*/
+
+/**
+ * Start the task that drains the log ring onto the serial port, which must
+ * already be open.
+ * @param uxPriority priority of the log task, normally tskIDLE_PRIORITY + 1.
+ * @return pdPASS if the task was created.
+ */
+portBASE_TYPE xLogInit( unsigned portBASE_TYPE uxPriority );
+
+/**
+ * Record a printf style message from PROGMEM. Safe from tasks and ISRs.
+ * The record is dropped, and counted, if the ring is full.
+ * @param format printf format string.
+ */
+void vLogPrintf_P( PGM_P format, ... );
+
+/**
+ * Record a fixed string from PROGMEM, printed without formatting.
+ * @param str string to print.
+ */
+void vLogPrint_P( PGM_P str );
+
+/**
+ * @return number of records dropped because the ring was full, and not yet
+ *         reported by the log task.
+ */
+uint16_t usLogGetDropped( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_LOG_H */
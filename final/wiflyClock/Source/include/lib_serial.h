@@ -63,6 +63,9 @@ extern "C" {
 /* Constant for zero block time on xQueue */
 #define xNoBlock						( ( uint8_t ) 0x00 )
 
+/* Longest the print functions wait for room in the Tx ring, per character. */
+#define serPRINT_BLOCK_TIME				( ( portTickType ) ( 10 / portTICK_RATE_MS ) )
+
 typedef enum
 {
 	serCOM1,
@@ -135,6 +138,9 @@ extern xComPortHandle xSerialPort;
  * a semaphore to limit this case.
  * Since I just use the serial port for debugging mainly, there seems to be too much
  * overhead to build this semaphore into the print functions themselves.
+ *
+ * The Rx and Tx buffers are lock-free single producer, single consumer rings, so only
+ * one task at a time may read, and only one task at a time may write.
  */
 
 /**
@@ -179,6 +185,7 @@ void vSerialClose( xComPortHandle xPort );
 
 /**
  * Interrupt driven routines to interface to ISR serial port IO.
+ * These block only while the Rx ring is empty or the Tx ring is full.
  */
 portBASE_TYPE xSerialGetChar( xComPortHandle pxPort, unsigned portBASE_TYPE *pcRxedChar, portTickType xBlockTime );
 portBASE_TYPE xSerialPutChar( xComPortHandle pxPort, unsigned portBASE_TYPE cOutChar, portTickType xBlockTime );
@@ -141,6 +141,118 @@ void vPortFree( void *pv ) PRIVILEGED_FUNCTION;
 void vPortInitialiseBlocks( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 
+/* Placement hints for pvPortMallocHint().  Bulk buffers may be placed in
+external RAM when the heap manages more than one region. */
+#define portHEAP_INTERNAL			( ( unsigned char ) 0 )
+#define portHEAP_BULK				( ( unsigned char ) 1 )
+
+#if ( configUSE_HEAP_REGIONS == 1 )
+
+	/* Passed to xPortGetFreeBankSize() to ask about internal SRAM. */
+	#define portHEAP_INTERNAL_BANK	( ( unsigned char ) 0xff )
+
+	/*
+	 * Multi-region heap (heap_banked.c).  pvPortMalloc() always returns
+	 * internal SRAM.  pvPortMallocHint( x, portHEAP_BULK ) returns memory in
+	 * XRAM bank 0, which stays mapped in, and can be released with vPortFree().
+	 */
+	void *pvPortMallocHint( size_t xSize, unsigned char ucHint ) PRIVILEGED_FUNCTION;
+
+	/*
+	 * Allocate from, or free into, a given XRAM bank.  The memory can only be
+	 * used between vPortBankSelect( ucBank ) and vPortBankRestore(), which
+	 * suspend and resume the scheduler, or through vPortBankRead() and
+	 * vPortBankWrite().  pvDest / pvSource on the internal side of a copy
+	 * must be in internal SRAM.
+	 */
+	void *pvPortMallocBanked( size_t xSize, unsigned char ucBank ) PRIVILEGED_FUNCTION;
+	void vPortFreeBanked( void *pv, unsigned char ucBank ) PRIVILEGED_FUNCTION;
+	void vPortBankSelect( unsigned char ucBank ) PRIVILEGED_FUNCTION;
+	void vPortBankRestore( void ) PRIVILEGED_FUNCTION;
+	void vPortBankRead( void *pvDest, const void *pvSource, size_t xLength, unsigned char ucBank ) PRIVILEGED_FUNCTION;
+	void vPortBankWrite( void *pvDest, const void *pvSource, size_t xLength, unsigned char ucBank ) PRIVILEGED_FUNCTION;
+	size_t xPortGetFreeBankSize( unsigned char ucBank ) PRIVILEGED_FUNCTION;
+
+#else
+
+	/* A single region heap places everything in the same memory. */
+	#define pvPortMallocHint( xSize, ucHint ) pvPortMalloc( xSize )
+
+#endif /* configUSE_HEAP_REGIONS */
+
+#if ( configUSE_HEAP_STATS == 1 )
+
+	/* Requested sizes are counted in power of two classes: <= 8, <= 16, ...
+	<= 512 and anything larger. */
+	#define portHEAP_SIZE_CLASSES	8
+
+	typedef struct xHEAP_STATS
+	{
+		size_t xFreeBytesRemaining;				/*<< Bytes currently free. */
+		size_t xMinimumEverFreeBytesRemaining;	/*<< Low watermark of xFreeBytesRemaining. */
+		size_t xLargestFreeBlock;				/*<< Largest single allocation that could succeed now (including the block header). */
+		size_t xFreeBlockCount;					/*<< Number of blocks in the free list. */
+		unsigned long ulAllocations;			/*<< Successful calls to pvPortMalloc(). */
+		unsigned long ulFrees;					/*<< Calls to vPortFree() with a non NULL pointer. */
+		unsigned long ulFailedAllocations;		/*<< Calls to pvPortMalloc() that returned NULL. */
+		unsigned short usSizeClass[ portHEAP_SIZE_CLASSES ];	/*<< Allocation histogram by requested size. */
+	} xHeapStats;
+
+	/*
+	 * Fill in pxHeapStats with a snapshot of the heap.  The free list is walked
+	 * with the scheduler suspended, so do not call this from an interrupt.
+	 */
+	void vPortGetHeapStats( xHeapStats *pxHeapStats ) PRIVILEGED_FUNCTION;
+
+	#if ( configHEAP_DEBUG == 1 )
+
+		typedef struct xHEAP_SITE_STATS
+		{
+			void *pvCaller;					/*<< Return address of the pvPortMalloc() call, NULL for the overflow slot. */
+			size_t xLiveBytes;				/*<< Bytes allocated from this site and not yet freed. */
+			unsigned long ulAllocations;	/*<< Number of successful allocations from this site. */
+		} xHeapSiteStats;
+
+		/*
+		 * Copy up to uxMaxSites entries of the per call site table into
+		 * pxSites.  Returns the number of entries written.
+		 */
+		unsigned portBASE_TYPE uxPortGetHeapSiteStats( xHeapSiteStats *pxSites, unsigned portBASE_TYPE uxMaxSites ) PRIVILEGED_FUNCTION;
+
+	#endif /* configHEAP_DEBUG */
+
+	#if ( configHEAP_TASK_STATS == 1 )
+
+		/* Heap use per task, in bytes including the block headers.  Slot 0 is
+		the memory allocated before the scheduler started and the last slot is
+		shared by every task that did not get a slot of its own. */
+		typedef struct xHEAP_TASK_STATS
+		{
+			void *pvTask;					/*<< Handle of the allocating task, NULL for an unused slot. */
+			size_t xLiveBytes;				/*<< Bytes allocated by the task and not yet freed. */
+			size_t xPeakBytes;				/*<< High watermark of xLiveBytes. */
+			size_t xQuota;					/*<< Limit on xLiveBytes, 0 for none. */
+			unsigned short usRefused;		/*<< Allocations refused because of xQuota. */
+		} xHeapTaskStats;
+
+		/*
+		 * Limit the heap a task may hold to xQuota bytes, or remove the limit
+		 * with 0.  pvPortMalloc() returns NULL to that task once the limit would
+		 * be passed, without calling the malloc failed hook.  A NULL handle
+		 * means the calling task.  Returns pdFAIL if the task has no slot.
+		 */
+		portBASE_TYPE xPortSetHeapQuota( void *pvTask, size_t xQuota ) PRIVILEGED_FUNCTION;
+
+		/*
+		 * Copy all configHEAP_TASK_SLOTS entries of the per task table into
+		 * pxTasks.
+		 */
+		void vPortGetHeapTaskStats( xHeapTaskStats *pxTasks ) PRIVILEGED_FUNCTION;
+
+	#endif /* configHEAP_TASK_STATS */
+
+#endif /* configUSE_HEAP_STATS */
+
 /*
  * Setup the hardware ready for the scheduler to take control.  This generally
  * sets up a tick interrupt and sets timers for the correct tick frequency.
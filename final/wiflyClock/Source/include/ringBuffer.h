@@ -0,0 +1,99 @@
+/*
+ * ringBuffer.h
+ *
+ * Lock-free single producer, single consumer byte ring for ISR <-> task
+ * traffic. The producer only ever writes ucHead and the consumer only ever
+ * writes ucTail, and both indexes are single bytes, so neither side needs to
+ * disable interrupts or take a lock on the AVR.
+ *
+ * The storage size must be a power of two between 2 and 256; one slot is kept
+ * empty to tell a full ring from an empty one.
+ */
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+
+typedef struct xRING_BUFFER
+{
+	uint8_t *pucBuffer;			// Storage, ( ucMask + 1 ) bytes.
+	uint8_t ucMask;				// Storage size - 1.
+	volatile uint8_t ucHead;	// Next slot to write. Producer only.
+	volatile uint8_t ucTail;	// Next slot to read. Consumer only.
+} xRingBuffer;
+
+// Stops the compiler moving the data access across the index update.
+#define ringMEMORY_BARRIER()	__asm__ __volatile__ ( "" ::: "memory" )
+
+static inline void vRingBufferInit( xRingBuffer *pxRing, uint8_t *pucStorage, uint16_t usSize )
+{
+	pxRing->pucBuffer = pucStorage;
+	pxRing->ucMask = ( uint8_t ) ( usSize - 1 );
+	pxRing->ucHead = 0;
+	pxRing->ucTail = 0;
+}
+
+static inline portBASE_TYPE xRingBufferIsEmpty( const xRingBuffer *pxRing )
+{
+	return ( pxRing->ucHead == pxRing->ucTail );
+}
+
+static inline portBASE_TYPE xRingBufferIsFull( const xRingBuffer *pxRing )
+{
+	return ( ( ( pxRing->ucHead + 1 ) & pxRing->ucMask ) == pxRing->ucTail );
+}
+
+static inline uint8_t ucRingBufferCount( const xRingBuffer *pxRing )
+{
+	return ( uint8_t ) ( ( pxRing->ucHead - pxRing->ucTail ) & pxRing->ucMask );
+}
+
+// Producer side. Returns pdFALSE, leaving the ring untouched, if it is full.
+static inline portBASE_TYPE xRingBufferPut( xRingBuffer *pxRing, uint8_t ucByte )
+{
+	uint8_t ucHead = pxRing->ucHead;
+	uint8_t ucNext = ( ucHead + 1 ) & pxRing->ucMask;
+
+	if( ucNext == pxRing->ucTail )
+		return pdFALSE;
+
+	pxRing->pucBuffer[ ucHead ] = ucByte;
+	ringMEMORY_BARRIER();
+	pxRing->ucHead = ucNext;
+
+	return pdTRUE;
+}
+
+// Consumer side. Returns pdFALSE if the ring is empty.
+static inline portBASE_TYPE xRingBufferGet( xRingBuffer *pxRing, uint8_t *pucByte )
+{
+	uint8_t ucTail = pxRing->ucTail;
+
+	if( ucTail == pxRing->ucHead )
+		return pdFALSE;
+
+	*pucByte = pxRing->pucBuffer[ ucTail ];
+	ringMEMORY_BARRIER();
+	pxRing->ucTail = ( ucTail + 1 ) & pxRing->ucMask;
+
+	return pdTRUE;
+}
+
+// Consumer side. Discards everything currently in the ring.
+static inline void vRingBufferFlush( xRingBuffer *pxRing )
+{
+	pxRing->ucTail = pxRing->ucHead;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RING_BUFFER_H_ */
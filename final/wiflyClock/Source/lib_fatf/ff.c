@@ -769,7 +769,7 @@ void* ff_memalloc (	/* Returns pointer to the allocated memory block */
 	uint16_t size		/* Number of bytes to allocate */
 )
 {
-	return pvPortMalloc(size);
+	return pvPortMallocHint(size, portHEAP_BULK);
 }
 
 
@@ -12,7 +12,7 @@
 #include <queue.h>
 #include <semphr.h>
 
-#include <lib_serial.h>
+#include <lib_log.h>
 
 #include <w5100.h>
 #include <socket.h>
@@ -159,12 +159,12 @@ static void send_DHCP_DISCOVER(
 
 	if(0 == sendto(s, (uint8_t *)pRIPMSG, sizeof(RIP_MSG), ip, IP_PORT_DHCP_SERVER))
 	{
-		xSerialPrint_P(PSTR("\r\nDHCP: Fatal Error(0)."));
+		vLogPrint_P(PSTR("\r\nDHCP: Fatal Error(0)."));
 		if ( dhcp_ip_conflict != 0 )
 			(*dhcp_ip_conflict)();
 	}
 
-	xSerialPrint_P(PSTR("\r\nsent DHCP_DISCOVER\r\n"));
+	vLogPrint_P(PSTR("\r\nsent DHCP_DISCOVER\r\n"));
 }
 
 
@@ -287,12 +287,12 @@ static void send_DHCP_REQUEST(
 
 	if(0 == sendto(s, (uint8_t*)pRIPMSG, sizeof(RIP_MSG), ip, IP_PORT_DHCP_SERVER))
 	{
-		xSerialPrint_P(PSTR("\r\nDHCP: Fatal Error(1)."));
+		vLogPrint_P(PSTR("\r\nDHCP: Fatal Error(1)."));
 		if ( dhcp_ip_conflict != 0 )
 			(*dhcp_ip_conflict)();
 	}
 
-	xSerialPrint_P(PSTR("\r\nsent DHCP_REQUEST\r\n"));
+	vLogPrint_P(PSTR("\r\nsent DHCP_REQUEST\r\n"));
 
 }
 
@@ -365,12 +365,12 @@ static void send_DHCP_RELEASE_DECLINE(
 		pRIPMSG->OPT[i++] = GET_SIP[2];
 		pRIPMSG->OPT[i++] = GET_SIP[3];
 		pRIPMSG->OPT[i++] = endOption;
-		xSerialPrint_P(PSTR("\r\nsent DHCP_DECLINE\r\n"));
+		vLogPrint_P(PSTR("\r\nsent DHCP_DECLINE\r\n"));
 	}
 	else
 	{
 		pRIPMSG->OPT[i++] = endOption;
-		xSerialPrint_P(PSTR("\r\nsent DHCP_RELEASE\r\n"));
+		vLogPrint_P(PSTR("\r\nsent DHCP_RELEASE\r\n"));
 	}
 
 	if(!msgtype)
@@ -390,7 +390,7 @@ static void send_DHCP_RELEASE_DECLINE(
 
 	if(0 == sendto(s, (uint8_t *)pRIPMSG, sizeof(RIP_MSG), ip, IP_PORT_DHCP_SERVER))
 	{
-		xSerialPrint_P(PSTR("\r\nDHCP: Fatal Error(2)."));
+		vLogPrint_P(PSTR("\r\nDHCP: Fatal Error(2)."));
 		if ( dhcp_ip_conflict != 0 )
 			(*dhcp_ip_conflict)();
 	}
@@ -418,14 +418,14 @@ static uint8_t parseDHCPMSG(
 	len = recvfrom(s, (uint8_t *)pRIPMSG, length, svr_addr, &svr_port);
 
 #ifdef DHCP_DEBUG
-	xSerialPrintf_P(PSTR("\r\nDHCP_SIP: %d.%d.%d.%d"),DHCP_SIP[0],DHCP_SIP[1],DHCP_SIP[2],DHCP_SIP[3]);
-	xSerialPrintf_P(PSTR("\r\nDHCP_RIP: %d.%d.%d.%d"),DHCP_REAL_SIP[0],DHCP_REAL_SIP[1],DHCP_REAL_SIP[2],DHCP_REAL_SIP[3]);
-	xSerialPrintf_P(PSTR("\r\nsvr_addr: %d.%d.%d.%d"),svr_addr[0],svr_addr[1],svr_addr[2],svr_addr[3]);
+	vLogPrintf_P(PSTR("\r\nDHCP_SIP: %d.%d.%d.%d"),DHCP_SIP[0],DHCP_SIP[1],DHCP_SIP[2],DHCP_SIP[3]);
+	vLogPrintf_P(PSTR("\r\nDHCP_RIP: %d.%d.%d.%d"),DHCP_REAL_SIP[0],DHCP_REAL_SIP[1],DHCP_REAL_SIP[2],DHCP_REAL_SIP[3]);
+	vLogPrintf_P(PSTR("\r\nsvr_addr: %d.%d.%d.%d"),svr_addr[0],svr_addr[1],svr_addr[2],svr_addr[3]);
 #endif
 
 	if(pRIPMSG->op != DHCP_BOOTREPLY)
 	{
-		xSerialPrint_P(PSTR("\r\nDHCP : NO DHCP MSG"));
+		vLogPrint_P(PSTR("\r\nDHCP : NO DHCP MSG"));
 	}
 	else
 	{
@@ -434,14 +434,14 @@ static uint8_t parseDHCPMSG(
 			if(memcmp(pRIPMSG->chaddr,SRC_MAC_ADDR,6) != 0 || pRIPMSG->xid != htonl(DHCP_XID))
 			{
 #ifdef DHCP_DEBUG
-				xSerialPrint_P(PSTR("\r\nNot my DHCP Message. This message is ignored..."));
-
-				xSerialPrintf_P(PSTR("\tSRC_MAC_ADDR(%02X.%02X.%02X."),SRC_MAC_ADDR[0],SRC_MAC_ADDR[1],SRC_MAC_ADDR[2]);
-				xSerialPrintf_P(PSTR("%02X.%02X.%02X)"),SRC_MAC_ADDR[3],SRC_MAC_ADDR[4],SRC_MAC_ADDR[5]);
-				xSerialPrintf_P(PSTR(", pRIPMSG->chaddr(%02X.%02X.%02X."),pRIPMSG->chaddr[0],pRIPMSG->chaddr[1],pRIPMSG->chaddr[2]);
-				xSerialPrintf_P(PSTR("\r\n%02X.%02X.%02X)"),pRIPMSG->chaddr[3],pRIPMSG->chaddr[4],pRIPMSG->chaddr[5]);
-				xSerialPrintf_P(PSTR("\r\n\tpRIPMSG->xid(%08lX), DHCP_XID(%08lX)"),pRIPMSG->xid,htonl(DHCP_XID));
-				xSerialPrintf_P(PSTR("\r\n\tpRIMPMSG->yiaddr:%d.%d.%d.%d"),pRIPMSG->yiaddr[0],pRIPMSG->yiaddr[1],pRIPMSG->yiaddr[2],pRIPMSG->yiaddr[3]);
+				vLogPrint_P(PSTR("\r\nNot my DHCP Message. This message is ignored..."));
+
+				vLogPrintf_P(PSTR("\tSRC_MAC_ADDR(%02X.%02X.%02X."),SRC_MAC_ADDR[0],SRC_MAC_ADDR[1],SRC_MAC_ADDR[2]);
+				vLogPrintf_P(PSTR("%02X.%02X.%02X)"),SRC_MAC_ADDR[3],SRC_MAC_ADDR[4],SRC_MAC_ADDR[5]);
+				vLogPrintf_P(PSTR(", pRIPMSG->chaddr(%02X.%02X.%02X."),pRIPMSG->chaddr[0],pRIPMSG->chaddr[1],pRIPMSG->chaddr[2]);
+				vLogPrintf_P(PSTR("\r\n%02X.%02X.%02X)"),pRIPMSG->chaddr[3],pRIPMSG->chaddr[4],pRIPMSG->chaddr[5]);
+				vLogPrintf_P(PSTR("\r\n\tpRIPMSG->xid(%08lX), DHCP_XID(%08lX)"),pRIPMSG->xid,htonl(DHCP_XID));
+				vLogPrintf_P(PSTR("\r\n\tpRIMPMSG->yiaddr:%d.%d.%d.%d"),pRIPMSG->yiaddr[0],pRIPMSG->yiaddr[1],pRIPMSG->yiaddr[2],pRIPMSG->yiaddr[3]);
 #endif
 				return 0;
 			}
@@ -452,8 +452,8 @@ static uint8_t parseDHCPMSG(
 					*((uint32_t*)DHCP_SIP) != *((uint32_t*)svr_addr) )
 				{
 #ifdef DHCP_DEBUG
-					xSerialPrint_P(PSTR("\r\nAnother DHCP sever send a response message. This is ignored."));
-					xSerialPrintf_P(PSTR("\r\n\tIP:%d.%d.%d.%d"),svr_addr[0],svr_addr[1],svr_addr[2],svr_addr[3]);
+					vLogPrint_P(PSTR("\r\nAnother DHCP sever send a response message. This is ignored."));
+					vLogPrintf_P(PSTR("\r\n\tIP:%d.%d.%d.%d"),svr_addr[0],svr_addr[1],svr_addr[2],svr_addr[3]);
 #endif
 					return 0;
 				}
@@ -461,7 +461,7 @@ static uint8_t parseDHCPMSG(
 
 			memcpy(GET_SIP,pRIPMSG->yiaddr,4);
 
-			xSerialPrint_P(PSTR("\r\nDHCP MSG received..."));
+			vLogPrint_P(PSTR("\r\nDHCP MSG received..."));
 
 			type = 0;
 			p = (uint8_t *)(&pRIPMSG->op);
@@ -469,8 +469,8 @@ static uint8_t parseDHCPMSG(
 			e = p + (len - 240);
 
 #ifdef DHCP_DEBUG
-			xSerialPrintf_P(PSTR("\r\nyiaddr : %d.%d.%d.%d"),GET_SIP[0],GET_SIP[1],GET_SIP[2],GET_SIP[3]);
-			xSerialPrintf_P(PSTR("\r\np: 0x%08X  e: 0x%08X  len: %d\r\n"), (uint16_t)p, (uint16_t)e, len);
+			vLogPrintf_P(PSTR("\r\nyiaddr : %d.%d.%d.%d"),GET_SIP[0],GET_SIP[1],GET_SIP[2],GET_SIP[3]);
+			vLogPrintf_P(PSTR("\r\np: 0x%08X  e: 0x%08X  len: %d\r\n"), (uint16_t)p, (uint16_t)e, len);
 #endif
 			while ( p < e )
 			{
@@ -485,23 +485,23 @@ static uint8_t parseDHCPMSG(
 					opt_len = *p++;
 					type = *p;
 #ifdef DHCP_DEBUG
-					xSerialPrintf_P(PSTR("\r\ndhcpMessageType: %x"), type);
+					vLogPrintf_P(PSTR("\r\ndhcpMessageType: %x"), type);
 #endif
 					break;
 				case subnetMask :
 					opt_len =* p++;
 					memcpy(GET_SN_MASK,p,4);
 #ifdef DHCP_DEBUG
-					xSerialPrint_P(PSTR("\r\nsubnetMask: "));
-					xSerialPrintf_P(PSTR("\r\n%d.%d.%d.%d"),GET_SN_MASK[0],GET_SN_MASK[1],GET_SN_MASK[2],GET_SN_MASK[3]);
+					vLogPrint_P(PSTR("\r\nsubnetMask: "));
+					vLogPrintf_P(PSTR("\r\n%d.%d.%d.%d"),GET_SN_MASK[0],GET_SN_MASK[1],GET_SN_MASK[2],GET_SN_MASK[3]);
 #endif
 					break;
 				case routersOnSubnet :
 					opt_len = *p++;
 					memcpy(GET_GW_IP,p,4);
 #ifdef DHCP_DEBUG
-					xSerialPrint_P(PSTR("\r\nroutersOnSubnet: "));
-					xSerialPrintf_P(PSTR("\r\n%d.%d.%d.%d"),GET_GW_IP[0],GET_GW_IP[1],GET_GW_IP[2],GET_GW_IP[3]);
+					vLogPrint_P(PSTR("\r\nroutersOnSubnet: "));
+					vLogPrintf_P(PSTR("\r\n%d.%d.%d.%d"),GET_GW_IP[0],GET_GW_IP[1],GET_GW_IP[2],GET_GW_IP[3]);
 #endif
 					break;
 				case dns :
@@ -512,14 +512,14 @@ static uint8_t parseDHCPMSG(
 					opt_len = *p++;
 					lease_time.lVal = ntohl(*((uint32_t*)p));
 #ifdef DHCP_DEBUG
-					xSerialPrintf_P(PSTR("\r\ndhcpIPaddrLeaseTime: %08lX"), lease_time.lVal);
+					vLogPrintf_P(PSTR("\r\ndhcpIPaddrLeaseTime: %08lX"), lease_time.lVal);
 #endif
 					break;
 
 				case dhcpServerIdentifier :
 					opt_len = *p++;
 #ifdef DHCP_DEBUG
-					xSerialPrintf_P(PSTR("\r\nDHCP_SIP: %d.%d.%d.%d"), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
+					vLogPrintf_P(PSTR("\r\nDHCP_SIP: %d.%d.%d.%d"), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
 #endif
 					if( *((uint32_t*)DHCP_SIP) == 0 ||
 					    *((uint32_t*)DHCP_REAL_SIP) == *((uint32_t*)svr_addr) ||
@@ -528,18 +528,18 @@ static uint8_t parseDHCPMSG(
 						memcpy(DHCP_SIP,p,4);
 						memcpy(DHCP_REAL_SIP,svr_addr,4);	// Copy the real ip address of my DHCP server
 #ifdef DHCP_DEBUG
-						xSerialPrint_P(PSTR("\r\nMy dhcpServerIdentifier: "));
-						xSerialPrintf_P(PSTR("\r\n%d.%d.%d.%d"), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
-						xSerialPrint_P(PSTR("\r\nMy DHCP server real IP address: "));
-						xSerialPrintf_P(PSTR("\r\n%d.%d.%d.%d"), DHCP_REAL_SIP[0], DHCP_REAL_SIP[1], DHCP_REAL_SIP[2], DHCP_REAL_SIP[3]);
+						vLogPrint_P(PSTR("\r\nMy dhcpServerIdentifier: "));
+						vLogPrintf_P(PSTR("\r\n%d.%d.%d.%d"), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
+						vLogPrint_P(PSTR("\r\nMy DHCP server real IP address: "));
+						vLogPrintf_P(PSTR("\r\n%d.%d.%d.%d"), DHCP_REAL_SIP[0], DHCP_REAL_SIP[1], DHCP_REAL_SIP[2], DHCP_REAL_SIP[3]);
 #endif
 					}
 					else
 					{
 #ifdef DHCP_DEBUG
-						xSerialPrint_P(PSTR("\r\nAnother dhcpServerIdentifier: "));
-						xSerialPrintf_P(PSTR("\r\n\tMY(%d.%d.%d.%d) "), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
-						xSerialPrintf_P(PSTR("\r\nAnother(%d.%d.%d.%d): "), svr_addr[0], svr_addr[1], svr_addr[2], svr_addr[3]);
+						vLogPrint_P(PSTR("\r\nAnother dhcpServerIdentifier: "));
+						vLogPrintf_P(PSTR("\r\n\tMY(%d.%d.%d.%d) "), DHCP_SIP[0], DHCP_SIP[1], DHCP_SIP[2], DHCP_SIP[3]);
+						vLogPrintf_P(PSTR("\r\nAnother(%d.%d.%d.%d): "), svr_addr[0], svr_addr[1], svr_addr[2], svr_addr[3]);
 #endif
 					}
 
@@ -547,7 +547,7 @@ static uint8_t parseDHCPMSG(
 				default :
 					opt_len = *p++;
 #ifdef DHCP_DEBUG
-					xSerialPrintf_P(PSTR("\r\nopt_len: %d"), opt_len);
+					vLogPrintf_P(PSTR("\r\nopt_len: %d"), opt_len);
 #endif
 					break;
 				} // switch
@@ -581,7 +581,7 @@ void check_DHCP_state(
 	}
 	else if(!socket(s, Sn_MR_UDP, IP_PORT_DHCP_CLIENT, 0x00))
 	{
-		xSerialPrint_P(PSTR("\r\nFail to create the DHCPC_SOCK(%d)"));
+		vLogPrint_P(PSTR("\r\nFail to create the DHCPC_SOCK(%d)"));
 	}
 
 
@@ -590,7 +590,7 @@ void check_DHCP_state(
 	case DHCP_STATE_DISCOVER :
 		if (type == DHCP_OFFER)
 		{
-			xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_REQUEST\r\n"));
+			vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_REQUEST\r\n"));
 			dhcp_state = DHCP_STATE_REQUEST;
 			send_DHCP_REQUEST(s);
 			reset_DHCP_time();
@@ -604,19 +604,19 @@ void check_DHCP_state(
 			reset_DHCP_time();
 			if (check_leasedIP())
 			{
-				xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_LEASED\r\n"));
+				vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_LEASED\r\n"));
 				dhcp_state = DHCP_STATE_LEASED;
 				set_DHCP_network();
 			}
 			else
 			{
-				xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
+				vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
 				dhcp_state = DHCP_STATE_DISCOVER;
 			}
 		}
 		else if (type == DHCP_NAK)
 		{
-			xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
+			vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
 			dhcp_state = DHCP_STATE_DISCOVER;
 			reset_DHCP_time();
 		}
@@ -626,7 +626,7 @@ void check_DHCP_state(
 	case DHCP_STATE_LEASED :
 		if ((lease_time.lVal != 0xffffffff) && (((lease_time.lVal/2)* 1000 / portTICK_RATE_MS) < (xTaskGetTickCount() - start_dhcp_time)))
 		{
-			xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_REREQUEST\r\n"));
+			vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_REREQUEST\r\n"));
 			type = 0;
 			memcpy(OLD_SIP,GET_SIP,4);
 			DHCP_XID++;
@@ -641,21 +641,22 @@ void check_DHCP_state(
 		{
 			if(memcmp(OLD_SIP,GET_SIP,4)!=0)
 			{
-				xSerialPrintf_P(PSTR("\r\nOLD_SIP=%s,GET_SIP=%s"),inet_ntoa(ntohl(*((uint32_t*)OLD_SIP))), inet_ntoa(ntohl(*((uint32_t*)GET_SIP))));
+				vLogPrintf_P(PSTR("\r\nOLD_SIP=%d.%d.%d.%d"),OLD_SIP[0],OLD_SIP[1],OLD_SIP[2],OLD_SIP[3]);
+				vLogPrintf_P(PSTR(",GET_SIP=%d.%d.%d.%d"),GET_SIP[0],GET_SIP[1],GET_SIP[2],GET_SIP[3]);
 				if ( dhcp_ip_update != 0 )
 					(*dhcp_ip_update)();
-				xSerialPrint_P(PSTR("\r\nThe IP address from the DHCP server is updated."));
+				vLogPrint_P(PSTR("\r\nThe IP address from the DHCP server is updated."));
 			}
 			else
 			{
-				xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_LEASED same IP\r\n"));
+				vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_LEASED same IP\r\n"));
 			}
 			dhcp_state = DHCP_STATE_LEASED;
 			reset_DHCP_time();
 		}
 		else if (type == DHCP_NAK)
 		{
-			xSerialPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
+			vLogPrint_P(PSTR("\r\nstate: DHCP_STATE_DISCOVER\r\n"));
 			dhcp_state = DHCP_STATE_DISCOVER;
 			reset_DHCP_time();
 		}
@@ -686,17 +687,17 @@ static void check_DHCP_Timeout(void)
 			switch ( dhcp_state )
 			{
 			case DHCP_STATE_DISCOVER :
-				xSerialPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_DISCOVER"));
+				vLogPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_DISCOVER"));
 				send_DHCP_DISCOVER(DHCPC_SOCK);
 				break;
 
 			case DHCP_STATE_REQUEST :
-				xSerialPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_REQUEST"));
+				vLogPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_REQUEST"));
 				send_DHCP_REQUEST(DHCPC_SOCK);
 				break;
 
 			case DHCP_STATE_REREQUEST :
-				xSerialPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_REREQUEST"));
+				vLogPrint_P(PSTR("\r\n<timeout> state: DHCP_STATE_REREQUEST"));
 				send_DHCP_REQUEST(DHCPC_SOCK);
 				break;
 
@@ -710,7 +711,7 @@ static void check_DHCP_Timeout(void)
 		reset_DHCP_time();
 		DHCP_timeout = 1;
 
-		xSerialPrint_P(PSTR("\r\n<<timeout>> state: DHCP_STATE_DISCOVER"));
+		vLogPrint_P(PSTR("\r\n<<timeout>> state: DHCP_STATE_DISCOVER"));
 		dhcp_state = DHCP_STATE_DISCOVER;
 		send_DHCP_DISCOVER(DHCPC_SOCK);
 	}
@@ -735,7 +736,7 @@ static void set_DHCP_network(void)
 
 	W5100_sysinit(0x55, 0x55);
 
-	xSerialPrintf_P(PSTR("\r\nDHCP set IP: %d.%d.%d.%d\r\n"), GET_SIP[0], GET_SIP[1], GET_SIP[2], GET_SIP[3]);
+	vLogPrintf_P(PSTR("\r\nDHCP set IP: %d.%d.%d.%d\r\n"), GET_SIP[0], GET_SIP[1], GET_SIP[2], GET_SIP[3]);
 }
 
 
@@ -748,7 +749,7 @@ static uint8_t check_leasedIP(void)
 
 //	uint16_t a;
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR("\r\n<Check the IP Conflict : <skipped>"));
+	vLogPrint_P(PSTR("\r\n<Check the IP Conflict : <skipped>"));
 #endif
 	// sendto is complete. that means there is a node which has a same IP.
 
@@ -758,14 +759,14 @@ static uint8_t check_leasedIP(void)
 /*	a=0; // Skip checking IP Conflict ; W5100 reply itself to ARP request with self-IP in non-switching network environment.
 	if ( a> 0)
 	{
-		xSerialPrint_P(PSTR(" Conflict>\r\n"));
+		vLogPrint_P(PSTR(" Conflict>\r\n"));
 		send_DHCP_RELEASE_DECLINE(DHCPC_SOCK,1);
 		if ( dhcp_ip_conflict != 0 )
 			(*dhcp_ip_conflict)();
 		return 0;
 	} // */
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR(" No Conflict>\r\n"));
+	vLogPrint_P(PSTR(" No Conflict>\r\n"));
 #endif
 	return 1;
 
@@ -824,7 +825,7 @@ void init_dhcp_client(
  */
 static void proc_ip_conflict(void)
 {
-	xSerialPrint_P(PSTR("\r\nThe IP Address from DHCP server is CONFLICT!!!\r\n"
+	vLogPrint_P(PSTR("\r\nThe IP Address from DHCP server is CONFLICT!!!\r\n"
 			"Retry to get a IP address from DHCP server\r\n"));
 }
 
@@ -853,12 +854,8 @@ uint8_t init_dhcpc_ch(SOCKET s)
 	W5100_sysinit(0x55, 0x55);
 
 #ifdef DHCP_DEBUG
-{
-	uint16_t i;
-	xSerialPrint_P(PSTR("\r\nMAC Addr: "));
-	for (i = 0; i < 5; i++) xSerialPrintf_P(PSTR("%02x."), SRC_MAC_ADDR[i]);
-	xSerialPrintf_P(PSTR("%02x"),SRC_MAC_ADDR[5]);
-}
+	vLogPrintf_P(PSTR("\r\nMAC Addr: %02x.%02x.%02x.%02x.%02x.%02x"),
+		SRC_MAC_ADDR[0], SRC_MAC_ADDR[1], SRC_MAC_ADDR[2], SRC_MAC_ADDR[3], SRC_MAC_ADDR[4], SRC_MAC_ADDR[5]);
 #endif
 
 	if( getSn_SR(s) != SOCK_CLOSED )	// Check the preferred socket is available,
@@ -870,21 +867,21 @@ uint8_t init_dhcpc_ch(SOCKET s)
 		ret = 1;
 	}
 
-	xSerialPrintf_P(PSTR("\r\nDHCP socket: %d,"),s);
+	vLogPrintf_P(PSTR("\r\nDHCP socket: %d,"),s);
 	if(!socket(s, Sn_MR_UDP, IP_PORT_DHCP_CLIENT, 0x00)) // initialise the socket for DHCP service
 	{
-		xSerialPrint_P(PSTR(" fail..!\r\n"));
+		vLogPrint_P(PSTR(" fail..!\r\n"));
 		ret = 0;
 	}
 	else
 	{
-		xSerialPrint_P(PSTR(" ok..!\r\n"));
+		vLogPrint_P(PSTR(" ok..!\r\n"));
 		ret = 1;
 	}
 
 	if(pRIPMSG == NULL) // if there is no buffer allocated (pointer is NULL), then allocate buffer for all DHCP functions.
 	{
-		if( !(pRIPMSG = (RIP_MSG *) pvPortMalloc( sizeof(RIP_MSG) ) ) )
+		if( !(pRIPMSG = (RIP_MSG *) pvPortMallocHint( sizeof(RIP_MSG), portHEAP_BULK ) ) )
 			ret = 0;
 		else
 			ret = 1;
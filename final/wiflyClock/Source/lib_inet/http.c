@@ -15,6 +15,7 @@
 #include <semphr.h>
 
 #include <lib_serial.h>
+#include <lib_log.h>
 
 #include <w5100.h>
 #include <socket.h>
@@ -48,38 +49,38 @@ uint8_t init_httpd_ch(SOCKET s)
 
 	if(!socket(s, Sn_MR_TCP, IP_PORT_HTTP, 0x00)) // initialise the socket for DHCP service
 	{
-		xSerialPrintf_P(PSTR("HTTPD socket: %d, initialise fail..!\r\n"),s);
+		vLogPrintf_P(PSTR("HTTPD socket: %d, initialise fail..!\r\n"),s);
 		ret = 0;
 	}
 #ifdef HTTP_DEBUG
 	else
-		xSerialPrintf_P(PSTR("HTTPD socket: %d, initialise success..!\r\n"),s);
+		vLogPrintf_P(PSTR("HTTPD socket: %d, initialise success..!\r\n"),s);
 #endif
 
 	if(pHTTPRequest == NULL) // if there is no buffer allocated (pointer is NULL), then allocate request buffer for all HTTP functions.
 	{
-		if( !(pHTTPRequest = (HTTP_REQUEST *) pvPortMalloc( sizeof(HTTP_REQUEST) )))
+		if( !(pHTTPRequest = (HTTP_REQUEST *) pvPortMallocHint( sizeof(HTTP_REQUEST), portHEAP_BULK )))
 		{
-			xSerialPrint_P(PSTR("HTTP Request Buffer: malloc fail..!\r\n"));
+			vLogPrint_P(PSTR("HTTP Request Buffer: malloc fail..!\r\n"));
 			ret = 0;
 		}
 #ifdef HTTP_DEBUG
 		else
-			xSerialPrint_P(PSTR("HTTP Request Buffer: malloc success..!\r\n"));
+			vLogPrint_P(PSTR("HTTP Request Buffer: malloc success..!\r\n"));
 #endif
 	}
 
 	if(pHTTPResponse == NULL) // if there is no buffer allocated (pointer is NULL), then allocate response buffer for all HTTP functions.
 	{
-		if( !(pHTTPResponse = (uint8_t *) pvPortMalloc( sizeof(uint8_t) * (FILE_BUFFER_SIZE + 1) )))
+		if( !(pHTTPResponse = (uint8_t *) pvPortMallocHint( sizeof(uint8_t) * (FILE_BUFFER_SIZE + 1), portHEAP_BULK )))
 		{
-			xSerialPrint_P(PSTR("HTTP Response Buffer: malloc fail..!\r\n"));
+			vLogPrint_P(PSTR("HTTP Response Buffer: malloc fail..!\r\n"));
 			vPortFree(pHTTPRequest);
 			ret = 0;
 		}
 #ifdef HTTP_DEBUG
 		else
-			xSerialPrint_P(PSTR("HTTP Response Buffer: malloc success..!\r\n"));
+			vLogPrint_P(PSTR("HTTP Response Buffer: malloc success..!\r\n"));
 #endif
 	}
 
@@ -163,7 +164,7 @@ void make_http_response_head(
 
 		default:
 #ifdef HTTP_DEBUG
-			xSerialPrint_P(PSTR("\r\n\r\nHTTP RESPONSE HEADER UNKNOWN-\r\n"));
+			vLogPrint_P(PSTR("\r\n\r\nHTTP RESPONSE HEADER UNKNOWN-\r\n"));
 #endif
 			break;
 	}
@@ -223,7 +224,7 @@ void parse_http_request(
 		request->METHOD = METHOD_GET;
 		nexttok = (uint8_t *)strtok(NULL," ");
 #ifdef HTTP_DEBUG
-		xSerialPrint_P(PSTR("METHOD_GET "));
+		vLogPrint_P(PSTR("METHOD_GET "));
 #endif
 	}
 	else if (!strcmp_P((const char *)nexttok, PSTR("HEAD")) || !strcmp_P((const char *)nexttok, PSTR("head")))
@@ -231,7 +232,7 @@ void parse_http_request(
 		request->METHOD = METHOD_HEAD;
 		nexttok = (uint8_t *)strtok(NULL," ");
 #ifdef HTTP_DEBUG
-		xSerialPrint_P(PSTR("METHOD_HEAD "));
+		vLogPrint_P(PSTR("METHOD_HEAD "));
 #endif
 
 	}
@@ -240,14 +241,14 @@ void parse_http_request(
 		nexttok = (uint8_t *)strtok((char *)NULL,"\0");
 		request->METHOD = METHOD_POST;
 #ifdef HTTP_DEBUG
-		xSerialPrint_P(PSTR("METHOD_POST "));
+		vLogPrint_P(PSTR("METHOD_POST "));
 #endif
 	}
 	else
 	{
 		request->METHOD = METHOD_ERR;
 #ifdef HTTP_DEBUG
-		xSerialPrint_P(PSTR("METHOD_ERR "));
+		vLogPrint_P(PSTR("METHOD_ERR "));
 #endif
 	}
 
@@ -255,7 +256,7 @@ void parse_http_request(
 	{
 		request->METHOD = METHOD_ERR;
 #ifdef HTTP_DEBUG
-		xSerialPrint_P(PSTR("METHOD_ERR "));
+		vLogPrint_P(PSTR("METHOD_ERR "));
 #endif
 		return;
 	}
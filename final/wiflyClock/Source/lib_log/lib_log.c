@@ -0,0 +1,291 @@
+/*
+ * lib_log.c
+ *
+ * Deferred logging, see lib_log.h.
+ *
+ * Any task or ISR may log, so writers claim a record with interrupts briefly
+ * disabled; the AVR has no compare and swap to do it otherwise. Only the copy
+ * of a handful of argument words happens in that window, the format string is
+ * never touched. The log task is the only reader and runs lock-free against
+ * the writers, as in ringBuffer.h.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <ringBuffer.h>
+#include <lib_serial.h>
+#include <lib_log.h>
+
+#if ( logQUEUE_LENGTH & ( logQUEUE_LENGTH - 1 ) ) || ( logQUEUE_LENGTH > 128 )
+	#error logQUEUE_LENGTH must be a power of two no larger than 128
+#endif
+
+#if logMAX_WORDS != 6
+	#error prvLogTask passes exactly six argument words to snprintf_P
+#endif
+
+#define logMASK						( logQUEUE_LENGTH - 1 )
+
+/* ucWords value marking a fixed string, printed as is. */
+#define logLITERAL					( ( uint8_t ) 0xff )
+
+typedef struct xLOG_RECORD
+{
+	PGM_P pcFormat;
+	uint8_t ucWords;
+	uint16_t usArgs[ logMAX_WORDS ];
+} xLogRecord;
+
+static xLogRecord xRecords[ logQUEUE_LENGTH ];
+static volatile uint8_t ucHead;		// Next record to write. Writers only.
+static volatile uint8_t ucTail;		// Next record to read. Log task only.
+static volatile uint16_t usDropped;
+
+/* Logged in place of a message whose format needs more than logMAX_WORDS. */
+static const char pcTooLong[] PROGMEM = "\r\n[log: format too long]\r\n";
+
+static void prvLogTask( void *pvParameters );
+static uint8_t prvCountWords( PGM_P pcFormat );
+static xLogRecord *prvClaim( void );
+static void prvCommit( void );
+
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE xLogInit( unsigned portBASE_TYPE uxPriority )
+{
+	return xTaskCreate( prvLogTask, ( const signed char * ) "Log", logSTACK_SIZE, NULL, uxPriority, NULL );
+}
+/*-----------------------------------------------------------*/
+
+void vLogPrintf_P( PGM_P format, ... )
+{
+	va_list xArgs;
+	xLogRecord *pxRecord;
+	uint8_t ucWords, x;
+
+	/* Work out the argument size before going critical. The log task hands
+	the format exactly logMAX_WORDS words, so one that needs more cannot be
+	printed faithfully. */
+	ucWords = prvCountWords( format );
+	if( ucWords > logMAX_WORDS )
+	{
+		vLogPrint_P( pcTooLong );
+		return;
+	}
+
+	va_start( xArgs, format );
+
+	/* portENTER_CRITICAL() saves and restores SREG, so it is also safe to
+	use from an ISR. */
+	portENTER_CRITICAL();
+	{
+		pxRecord = prvClaim();
+		if( pxRecord != NULL )
+		{
+			pxRecord->pcFormat = format;
+			pxRecord->ucWords = ucWords;
+
+			/* Every argument is at least one word on the AVR, and a long is
+			two consecutive words, low word first. */
+			for( x = 0; x < ucWords; x++ )
+				pxRecord->usArgs[ x ] = va_arg( xArgs, unsigned int );
+
+			prvCommit();
+		}
+	}
+	portEXIT_CRITICAL();
+
+	va_end( xArgs );
+}
+/*-----------------------------------------------------------*/
+
+void vLogPrint_P( PGM_P str )
+{
+	xLogRecord *pxRecord;
+
+	portENTER_CRITICAL();
+	{
+		pxRecord = prvClaim();
+		if( pxRecord != NULL )
+		{
+			pxRecord->pcFormat = str;
+			pxRecord->ucWords = logLITERAL;
+			prvCommit();
+		}
+	}
+	portEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+uint16_t usLogGetDropped( void )
+{
+	uint16_t usCount;
+
+	portENTER_CRITICAL();
+	usCount = usDropped;
+	portEXIT_CRITICAL();
+
+	return usCount;
+}
+/*-----------------------------------------------------------*/
+
+/* Returns the record at the head of the ring, or NULL after counting a drop
+if the ring is full. Called with interrupts disabled. */
+static xLogRecord *prvClaim( void )
+{
+	if( ( ( ucHead + 1 ) & logMASK ) == ucTail )
+	{
+		if( usDropped != 0xffff )
+			usDropped++;
+
+		return NULL;
+	}
+
+	return &xRecords[ ucHead ];
+}
+
+/* Hands the record filled in after prvClaim() to the log task. */
+static void prvCommit( void )
+{
+	ringMEMORY_BARRIER();
+	ucHead = ( ucHead + 1 ) & logMASK;
+}
+/*-----------------------------------------------------------*/
+
+/* Counts the argument words a format string consumes, from its conversion
+specifiers alone: one per conversion, two for a long or a double (4 bytes on
+the AVR), four for a long long, and one for each '*' width or precision. */
+static uint8_t prvCountWords( PGM_P pcFormat )
+{
+	uint8_t ucWords = 0, ucLongs;
+	char c;
+
+	while( ( c = pgm_read_byte( pcFormat++ ) ) != '\0' )
+	{
+		if( c != '%' )
+			continue;
+
+		ucLongs = 0;
+		while( ( c = pgm_read_byte( pcFormat++ ) ) != '\0' )
+		{
+			if( c == '*' )
+				ucWords++;
+			else if( c == 'l' )
+				ucLongs++;
+			else if( strchr_P( PSTR( "-+ #0123456789.h" ), c ) == NULL )
+				break;
+		}
+
+		if( c == '\0' )
+			break;
+
+		if( c == '%' )
+			continue;
+
+		if( ucLongs > 1 )
+			ucWords += 4;
+		else if( ucLongs == 1 || strchr_P( PSTR( "eEfFgGaA" ), c ) != NULL )
+			ucWords += 2;
+		else
+			ucWords++;
+	}
+
+	return ucWords;
+}
+/*-----------------------------------------------------------*/
+
+#if ( logBINARY_OUTPUT == 1 )
+
+static void prvSendWord( uint16_t usWord )
+{
+	xSerialPutChar( xSerialPort, ( uint8_t ) usWord, serPRINT_BLOCK_TIME );
+	xSerialPutChar( xSerialPort, ( uint8_t ) ( usWord >> 8 ), serPRINT_BLOCK_TIME );
+}
+
+static void prvSendRecord( PGM_P pcFormat, uint8_t ucWords, const uint16_t *pusArgs )
+{
+	uint8_t x;
+
+	xSerialPutChar( xSerialPort, logBINARY_SYNC, serPRINT_BLOCK_TIME );
+	prvSendWord( ( uint16_t ) pcFormat );
+	xSerialPutChar( xSerialPort, ucWords, serPRINT_BLOCK_TIME );
+
+	if( ucWords == logLITERAL )
+		return;
+
+	for( x = 0; x < ucWords; x++ )
+		prvSendWord( pusArgs[ x ] );
+}
+
+#endif
+/*-----------------------------------------------------------*/
+
+static void prvLogTask( void *pvParameters )
+{
+	xLogRecord xRecord;
+	uint8_t ucIndex;
+	uint16_t usLost;
+
+	#if ( logBINARY_OUTPUT == 0 )
+		static char cLine[ logLINE_LENGTH ];
+	#endif
+
+	( void ) pvParameters;
+
+	for( ;; )
+	{
+		ucIndex = ucTail;
+
+		if( ucIndex == ucHead )
+		{
+			portENTER_CRITICAL();
+			usLost = usDropped;
+			usDropped = 0;
+			portEXIT_CRITICAL();
+
+			if( usLost != 0 )
+			{
+				#if ( logBINARY_OUTPUT == 1 )
+					prvSendRecord( NULL, 1, &usLost );
+				#else
+					snprintf_P( cLine, logLINE_LENGTH, PSTR( "\r\n[log: %u dropped]\r\n" ), usLost );
+					xSerialPrint( ( uint8_t * ) cLine );
+				#endif
+			}
+
+			vTaskDelay( logPOLL_PERIOD );
+			continue;
+		}
+
+		/* Copy the record out so the slot can be handed back straight away. */
+		ringMEMORY_BARRIER();
+		memcpy( &xRecord, &xRecords[ ucIndex ], sizeof( xLogRecord ) );
+		ringMEMORY_BARRIER();
+		ucTail = ( ucIndex + 1 ) & logMASK;
+
+		#if ( logBINARY_OUTPUT == 1 )
+			prvSendRecord( xRecord.pcFormat, xRecord.ucWords, xRecord.usArgs );
+		#else
+			if( xRecord.ucWords == logLITERAL )
+			{
+				xSerialPrint_P( xRecord.pcFormat );
+			}
+			else
+			{
+				/* Unused words are passed too; the format never reads them, as
+				vLogPrintf_P turns away formats needing more. */
+				snprintf_P( cLine, logLINE_LENGTH, xRecord.pcFormat,
+						xRecord.usArgs[ 0 ], xRecord.usArgs[ 1 ], xRecord.usArgs[ 2 ],
+						xRecord.usArgs[ 3 ], xRecord.usArgs[ 4 ], xRecord.usArgs[ 5 ] );
+				xSerialPrint( ( uint8_t * ) cLine );
+			}
+		#endif
+	}
+}
@@ -67,7 +67,9 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <queue.h>
+#include <semphr.h>
 
+#include <ringBuffer.h>
 #include <lib_serial.h>
 
 
@@ -93,8 +95,19 @@
 }
 
 /*-----------------------------------------------------------*/
-static xQueueHandle xRxedChars;
-static xQueueHandle xCharsForTx;
+/* The Rx ring is filled by the Rx ISR and emptied by the reading task, the Tx
+ring is filled by the writing task and emptied by the UDRE ISR.  Neither ISR
+disables interrupts or touches a queue unless a task is waiting on it. */
+static xRingBuffer xRxedChars;
+static xRingBuffer xCharsForTx;
+
+/* A task that finds its ring empty (Rx) or full (Tx) sets the flag and blocks
+on the semaphore.  The ISR clears the flag and gives the semaphore. */
+static xSemaphoreHandle xRxSemaphore;
+static xSemaphoreHandle xTxSemaphore;
+static volatile portBASE_TYPE xRxWaiting = pdFALSE;
+static volatile portBASE_TYPE xTxWaiting = pdFALSE;
+
 static unsigned portBASE_TYPE *serialWorkBuffer; // create a working buffer pointer, to later be malloc() on the heap.
 
 /* Create a handle for the serial port. */
@@ -132,7 +145,7 @@ void xSerialPrint( uint8_t * str)
 	stringlength = strlen((char *)str);
 
 	while(i < stringlength)
-		xSerialPutChar( xSerialPort, str[i++], xNoBlock );
+		xSerialPutChar( xSerialPort, str[i++], serPRINT_BLOCK_TIME );
 }
 
 void xSerialPrint_P(PGM_P str)
@@ -143,26 +156,40 @@ void xSerialPrint_P(PGM_P str)
 	stringlength = strlen_P(str);
 
 	while(i < stringlength)
-		xSerialPutChar( xSerialPort, pgm_read_byte(&str[i++]), xNoBlock );
+		xSerialPutChar( xSerialPort, pgm_read_byte(&str[i++]), serPRINT_BLOCK_TIME );
 }
 
 /*-----------------------------------------------------------*/
 
 inline portBASE_TYPE xSerialGetChar( xComPortHandle pxPort, unsigned portBASE_TYPE *pcRxedChar, portTickType xBlockTime )
 {
+uint8_t ucChar;
+
 	/* Only one port is supported. */
 	( void ) pxPort;
 
 	/* Get the next character from the buffer.  Return false if no characters
 	are available, or arrive before xBlockTime expires. */
-	if( xQueueReceive( xRxedChars, pcRxedChar, xBlockTime ) )
-	{
-		return pdTRUE;
-	}
-	else
+	while( xRingBufferGet( &xRxedChars, &ucChar ) == pdFALSE )
 	{
-		return pdFALSE;
+		if( xBlockTime == xNoBlock )
+		{
+			return pdFALSE;
+		}
+
+		/* Ask the ISR for a wake up, then look again in case a character
+		arrived before the flag was seen. */
+		xRxWaiting = pdTRUE;
+		if( xRingBufferIsEmpty( &xRxedChars ) && ( xSemaphoreTake( xRxSemaphore, xBlockTime ) != pdTRUE ) )
+		{
+			xRxWaiting = pdFALSE;
+			return pdFALSE;
+		}
 	}
+
+	*pcRxedChar = ucChar;
+
+	return pdTRUE;
 }
 
 
@@ -171,10 +198,22 @@ inline portBASE_TYPE xSerialPutChar( xComPortHandle pxPort, unsigned portBASE_TY
 	/* Only one port is supported. */
 	( void ) pxPort;
 
-	/* Return false if after the block time there is no room on the Tx queue. */
-	if( xQueueSendToBack( xCharsForTx, &cOutChar, xBlockTime ) != pdPASS )
+	/* Return false if after the block time there is no room on the Tx ring. */
+	while( xRingBufferPut( &xCharsForTx, ( uint8_t ) cOutChar ) == pdFALSE )
 	{
-		return pdFAIL;
+		if( xBlockTime == xNoBlock )
+		{
+			return pdFAIL;
+		}
+
+		/* The ring is full, so the UDRE interrupt is running and will wake
+		us once it has taken a character. */
+		xTxWaiting = pdTRUE;
+		if( xRingBufferIsFull( &xCharsForTx ) && ( xSemaphoreTake( xTxSemaphore, xBlockTime ) != pdTRUE ) )
+		{
+			xTxWaiting = pdFALSE;
+			return pdFAIL;
+		}
 	}
 
 	vInterruptOn();
@@ -184,16 +223,44 @@ inline portBASE_TYPE xSerialPutChar( xComPortHandle pxPort, unsigned portBASE_TY
 
 /*-----------------------------------------------------------*/
 
+/* Ring sizes are rounded up to a power of two, at most 256 bytes. */
+static uint16_t prvRingSize( unsigned portBASE_TYPE uxLength )
+{
+uint16_t usSize = 2;
+
+	while( ( usSize < uxLength ) && ( usSize < 256 ) )
+		usSize <<= 1;
+
+	return usSize;
+}
+
 xComPortHandle xSerialPortInitMinimal( uint32_t ulWantedBaud, unsigned portBASE_TYPE uxTxQueueLength, unsigned portBASE_TYPE uxRxQueueLength )
 {
 uint32_t ulBaudRateCounter;
 uint8_t ucByte;
+uint16_t usRxSize = prvRingSize( uxRxQueueLength );
+uint16_t usTxSize = prvRingSize( uxTxQueueLength );
+uint8_t *pucRxStorage;
+uint8_t *pucTxStorage;
+
+	/* Create the rings used by the serial communications task. */
+	pucRxStorage = ( uint8_t * ) pvPortMalloc( usRxSize );
+	pucTxStorage = ( uint8_t * ) pvPortMalloc( usTxSize );
+	if( ( pucRxStorage == NULL ) || ( pucTxStorage == NULL ) )
+		return NULL;
+
+	/* Binary semaphores are created available, so take them once. */
+	vSemaphoreCreateBinary( xRxSemaphore );
+	vSemaphoreCreateBinary( xTxSemaphore );
+	if( ( xRxSemaphore == NULL ) || ( xTxSemaphore == NULL ) )
+		return NULL;
+	xSemaphoreTake( xRxSemaphore, xNoBlock );
+	xSemaphoreTake( xTxSemaphore, xNoBlock );
 
 	portENTER_CRITICAL();
 	{
-		/* Create the queues used by the serial communications task. */
-		xRxedChars = xQueueCreate( uxRxQueueLength, (unsigned portBASE_TYPE) sizeof(unsigned portBASE_TYPE) );
-		xCharsForTx = xQueueCreate( uxTxQueueLength, (unsigned portBASE_TYPE) sizeof(unsigned portBASE_TYPE) );
+		vRingBufferInit( &xRxedChars, pucRxStorage, usRxSize );
+		vRingBufferInit( &xCharsForTx, pucTxStorage, usTxSize );
 
 		// create a working buffer for vsnprintf on the heap (so we can use extended RAM, if available).
 		// create the structures on the heap (so they can be moved later).
@@ -248,13 +315,7 @@ void vSerialClose( xComPortHandle xPort )
 	/* The parameter is not used. */
 	( void ) xPort;
 
-	/* Turn off the interrupts.  We may also want to delete the queues and/or
-	re-install the original ISR. */
-
-	vPortFree (serialWorkBuffer);
-	vQueueDelete(xRxedChars);
-	vQueueDelete(xCharsForTx);
-
+	/* Turn off the interrupts before the rings they use are released. */
 	portENTER_CRITICAL();
 	{
 		vInterruptOff();
@@ -263,6 +324,13 @@ void vSerialClose( xComPortHandle xPort )
 		UCSR0B = ucByte;
 	}
 	portEXIT_CRITICAL();
+
+	vPortFree (serialWorkBuffer);
+	serialWorkBuffer = NULL;
+	vPortFree (xRxedChars.pucBuffer);
+	vPortFree (xCharsForTx.pucBuffer);
+	vQueueDelete(xRxSemaphore);
+	vQueueDelete(xTxSemaphore);
 }
 
 /*-----------------------------------------------------------*/
@@ -356,26 +424,30 @@ ISR( USART_RX_vect )
 {
 	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
+	uint8_t ucStatus;
 	uint8_t cChar;
 
-	/* Get status and data */
-	/* from buffer */
-
-	portENTER_CRITICAL();
+	/* Get status and data from buffer.  UDR0 is always read, so the
+	interrupt is cleared even when the character is bad. */
+	ucStatus = UCSR0A;
+	cChar = UDR0;
 
 	/* If error it set (Frame Error, Data Over Run, Parity), return 0xFF */
-	if ( UCSR0A & ((1<<FE0)|(1<<DOR0)|(1<<UPE0)) )
+	if ( ucStatus & ((1<<FE0)|(1<<DOR0)|(1<<UPE0)) )
 		cChar = 0xFF;
-	else
-		/* Get the character and post it on the queue of Rxed characters.
-		If the post causes a task to wake force a context switch as the awoken task
-		may have a higher priority than the task we have interrupted. */
-		cChar = UDR0;
 
-	xQueueSendToBackFromISR( xRxedChars, &cChar, &xHigherPriorityTaskWoken );
-
-	portEXIT_CRITICAL();
+	/* Put the character on the ring of Rxed characters, dropping it if the
+	reader has fallen a whole ring behind. */
+	xRingBufferPut( &xRxedChars, cChar );
 
+	/* Only wake the reader if it is blocked.  If that causes a task to wake
+	force a context switch as the awoken task may have a higher priority than
+	the task we have interrupted. */
+	if( xRxWaiting != pdFALSE )
+	{
+		xRxWaiting = pdFALSE;
+		xSemaphoreGiveFromISR( xRxSemaphore, &xHigherPriorityTaskWoken );
+	}
 
 	if( xHigherPriorityTaskWoken != pdFALSE )
 	{
@@ -393,21 +465,28 @@ ISR( USART_UDRE_vect )
 #endif
 {
 	uint8_t cChar;
-	signed portBASE_TYPE cTaskWoken;
-
-	portENTER_CRITICAL();
+	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-	if( xQueueReceiveFromISR( xCharsForTx, &cChar, &cTaskWoken ) == pdTRUE )
+	if( xRingBufferGet( &xCharsForTx, &cChar ) == pdTRUE )
 	{
 		/* Send the next character queued for Tx. */
 		UDR0 = cChar;
 	}
 	else
 	{
-		/* Queue empty, nothing to send. */
+		/* Ring empty, nothing to send. */
 		vInterruptOff();
 	}
 
-	portEXIT_CRITICAL();
+	/* A slot is free now, so wake the writer if it is blocked. */
+	if( xTxWaiting != pdFALSE )
+	{
+		xTxWaiting = pdFALSE;
+		xSemaphoreGiveFromISR( xTxSemaphore, &xHigherPriorityTaskWoken );
+	}
 
+	if( xHigherPriorityTaskWoken != pdFALSE )
+	{
+		taskYIELD();
+	}
 }
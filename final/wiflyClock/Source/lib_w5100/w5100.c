@@ -54,6 +54,8 @@
 #include <w5100.h>
 #include <socket.h>
 
+#include <lib_log.h>
+
 #ifdef __DEF_W5100_DBG__
 #include <lib_serial.h>
 #endif
@@ -263,7 +265,7 @@ uint16_t wiz_write_buf(uint16_t addr, uint8_t *buf, uint16_t len)
 	if ( !(SPCR & _BV(MSTR)) ) return 0;
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR("wiz_write_buf: tx_ptr: %.4x "), addr);
+	vLogPrintf_P(PSTR("wiz_write_buf: tx_ptr: %.4x "), addr);
 #endif
 
 	for( i=0; i<len; ++i)
@@ -312,7 +314,7 @@ uint16_t wiz_write_buf(uint16_t addr, uint8_t *buf, uint16_t len)
 	W5100_ISR_ENABLE();
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR(" %.4x tx_len: %.4x\r\n"), addr+i, len);
+	vLogPrintf_P(PSTR(" %.4x tx_len: %.4x\r\n"), addr+i, len);
 #endif
 
 	return len;
@@ -352,7 +354,7 @@ uint16_t wiz_read_buf(uint16_t addr, uint8_t *buf, uint16_t len)
 	if ( !(SPCR & _BV(MSTR)) ) return 0;
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR("wiz_read_buf: rx_ptr: %.4x "), addr);
+	vLogPrintf_P(PSTR("wiz_read_buf: rx_ptr: %.4x "), addr);
 #endif
 
 	for ( i=0; i<len; ++i)
@@ -403,7 +405,7 @@ uint16_t wiz_read_buf(uint16_t addr, uint8_t *buf, uint16_t len)
 	W5100_ISR_ENABLE();
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR(" %.4x rx_len: %.4x\r\n"), addr+i, len);
+	vLogPrintf_P(PSTR(" %.4x rx_len: %.4x\r\n"), addr+i, len);
 #endif
 
 	return len;
@@ -431,13 +433,13 @@ ISR(INT0_vect)
 
    	if (int_val & IR_CONFLICT)
    	{
-   		xSerialPrintf_P(PSTR("IP conflict : %.2x\r\n"), int_val);
+   		vLogPrintf_P(PSTR("IP conflict : %.2x\r\n"), int_val);
    	}
    	if (int_val & IR_UNREACH)
    	{
-   		xSerialPrintf_P(PSTR("INT Port Unreachable : %.2x\r\n"), int_val);
-   		xSerialPrintf_P(PSTR("UIPR0 : %d.%d.%d.%d\r\n"), W5100_READ(UIPR0), W5100_READ(UIPR0+1), W5100_READ(UIPR0+2), W5100_READ(UIPR0+3));
-   		xSerialPrintf_P(PSTR("UPORT0 : %.2x %.2x\r\n"), W5100_READ(UPORT0), W5100_READ(UPORT0+1));
+   		vLogPrintf_P(PSTR("INT Port Unreachable : %.2x\r\n"), int_val);
+   		vLogPrintf_P(PSTR("UIPR0 : %d.%d.%d.%d\r\n"), W5100_READ(UIPR0), W5100_READ(UIPR0+1), W5100_READ(UIPR0+2), W5100_READ(UIPR0+3));
+   		vLogPrintf_P(PSTR("UPORT0 : %.2x %.2x\r\n"), W5100_READ(UPORT0), W5100_READ(UPORT0+1));
    	}
 
    	/* +200801[bj] interrupt clear */
@@ -545,7 +547,7 @@ void W5100_sysinit(
 	int16_t ssum,rsum;
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR(" sysinit()\r\n"));
+	vLogPrint_P(PSTR(" sysinit()\r\n"));
 #endif
 
 	ssum = 0;
@@ -558,7 +560,7 @@ void W5100_sysinit(
 	RBUFBASEADDRESS[0] = (uint16_t)(__DEF_W5100_MAP_RXBUF__);		/* Set base address of Rx memory for channel #0 */
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR("Channel : SEND MEM SIZE : RECV MEM SIZE\r\n"));
+	vLogPrint_P(PSTR("Channel : SEND MEM SIZE : RECV MEM SIZE\r\n"));
 #endif
 
    for (uint8_t i = 0 ; i < MAX_SOCK_NUM; ++i)       // Set the size, masking and base address of Tx & Rx memory by each channel
@@ -618,7 +620,7 @@ void W5100_sysinit(
 			RBUFBASEADDRESS[i] = RBUFBASEADDRESS[i-1] + RSIZE[i-1];
 		}
 #ifdef __DEF_W5100_DBG__
-		xSerialPrintf_P(PSTR("%d : %.4x : %.4x : %.4x : %.4x\r\n"), i, (uint16_t)SBUFBASEADDRESS[i], (uint16_t)RBUFBASEADDRESS[i], SSIZE[i], RSIZE[i]);
+		vLogPrintf_P(PSTR("%d : %.4x : %.4x : %.4x : %.4x\r\n"), i, (uint16_t)SBUFBASEADDRESS[i], (uint16_t)RBUFBASEADDRESS[i], SSIZE[i], RSIZE[i]);
 #endif
 	}
 }
@@ -981,7 +983,7 @@ void send_data_processing(SOCKET s, uint8_t *data, uint16_t len)
 //	ptr = ((ptr & 0x00ff) << 8) + W5100_READ(Sn_TX_WR1(s));
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR("ISR_TX: tx_ptr: %.4x tx_len: %.4x\r\n"), ptr, len);
+	vLogPrintf_P(PSTR("ISR_TX: tx_ptr: %.4x tx_len: %.4x\r\n"), ptr, len);
 #endif
 
 	write_data(s, data, (uint8_t *)ptr, len);
@@ -1004,7 +1006,7 @@ void recv_data_processing(SOCKET s, uint8_t *data, uint16_t len)
 	ptr = W5100_READ(Sn_RX_RD0(s));
 	ptr = ((ptr & 0x00ff) << 8) + W5100_READ(Sn_RX_RD1(s));
 #ifdef __DEF_W5100_DBG__
-	xSerialPrintf_P(PSTR("ISR_RX: rd_ptr: %.4x rd_len: %.4x\r\n"), ptr, len);
+	vLogPrintf_P(PSTR("ISR_RX: rd_ptr: %.4x rd_len: %.4x\r\n"), ptr, len);
 #endif
 	read_data(s, (uint8_t *)ptr, data, len); // read data
 	ptr += len;
@@ -1096,7 +1098,7 @@ uint8_t pppinit(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwdlen
 
 	// PHASE0. W5100 PPPoE(ADSL) setup
 	// enable pppoe mode
-	xSerialPrint_P(PSTR("-- PHASE 0. W5100 PPPoE(ADSL) setup process --\r\n\n"));
+	vLogPrint_P(PSTR("-- PHASE 0. W5100 PPPoE(ADSL) setup process --\r\n\n"));
 
 	W5100_WRITE(MR,W5100_READ(MR) | MR_PPPOE);
 
@@ -1136,8 +1138,8 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 
    // PHASE1. PPPoE Discovery
 	// start to connect pppoe connection
-	xSerialPrint_P(PSTR("-- PHASE 1. PPPoE Discovery process --"));
-	xSerialPrint_P(PSTR(" ok\r\n\n"));
+	vLogPrint_P(PSTR("-- PHASE 1. PPPoE Discovery process --"));
+	vLogPrint_P(PSTR(" ok\r\n\n"));
 	W5100_WRITE(Sn_CR(0),Sn_CR_PCON);
 	/* +20071122[chungs]:wait to process the command... */
 	while( W5100_READ(Sn_CR(0)) )
@@ -1149,10 +1151,10 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	//check whether PPPoE discovery end or not
 	while (!(W5100_READ(Sn_IR(0)) & Sn_IR_PNEXT))
 	{
-		xSerialPrintf(".");
+		vLogPrint_P(PSTR("."));
 		if (loop_idx++ == 10) // timeout
 		{
-			xSerialPrint_P(PSTR("timeout before LCP\r\n"));
+			vLogPrint_P(PSTR("timeout before LCP\r\n"));
 			return 3;
 		}
 		_delay_ms(1000);
@@ -1163,7 +1165,7 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
    /*---*/
 
    // PHASE2. LCP process
-	xSerialPrint_P(PSTR("-- PHASE 2. LCP process --"));
+	vLogPrint_P(PSTR("-- PHASE 2. LCP process --"));
 
 	// send LCP Request
 	{
@@ -1234,15 +1236,15 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 				/* ------- */
   			}
 		}
-		xSerialPrintf(".");
+		vLogPrint_P(PSTR("."));
 		if (loop_idx++ == 10) // timeout
 		{
-			xSerialPrint_P(PSTR("timeout after LCP\r\n"));
+			vLogPrint_P(PSTR("timeout after LCP\r\n"));
 			return 3;
 		}
 		_delay_ms(1000);
 	}
-	xSerialPrint_P(PSTR(" ok\r\n\n"));
+	vLogPrint_P(PSTR(" ok\r\n\n"));
 
    /* +200801[bj] clear interrupt value*/
    W5100_WRITE(Sn_IR(0), 0xff);
@@ -1259,13 +1261,13 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	}
    /*---*/
 
-	xSerialPrint_P(PSTR("-- PHASE 3. PPPoE(ADSL) Authentication mode --\r\n"));
-	xSerialPrintf_P(PSTR("Authentication protocol : %.2x %.2x, "), W5100_READ(PATR0), W5100_READ(PATR0+1));
+	vLogPrint_P(PSTR("-- PHASE 3. PPPoE(ADSL) Authentication mode --\r\n"));
+	vLogPrintf_P(PSTR("Authentication protocol : %.2x %.2x, "), W5100_READ(PATR0), W5100_READ(PATR0+1));
 
 	loop_idx = 0;
 	if (W5100_READ(PATR0) == 0xc0 && W5100_READ(PATR0+1) == 0x23)
 	{
-		xSerialPrintf_P(PSTR("PAP\r\n")); // in case of adsl normally supports PAP.
+		vLogPrintf_P(PSTR("PAP\r\n")); // in case of adsl normally supports PAP.
 		// send authentication data
 		// copy (idlen + id + passwdlen + passwd)
 		buf[loop_idx] = idlen; loop_idx++;
@@ -1352,15 +1354,15 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	}
 	else
 	{
-		xSerialPrint_P(PSTR("Not support\r\n"));
+		vLogPrint_P(PSTR("Not support\r\n"));
 #ifdef __DEF_W5100_DBG__
-		xSerialPrintf_P(PSTR("Not support PPP Auth type: %.2x%.2x\r\n"),W5100_READ(PATR0), W5100_READ(PATR0+1));
+		vLogPrintf_P(PSTR("Not support PPP Auth type: %.2x%.2x\r\n"),W5100_READ(PATR0), W5100_READ(PATR0+1));
 #endif
 		return 4;
 	}
-	xSerialPrintf("\r\n");
+	vLogPrint_P(PSTR("\r\n"));
 
-	xSerialPrint_P(PSTR("-- Waiting for PPPoE server's admission --"));
+	vLogPrint_P(PSTR("-- Waiting for PPPoE server's admission --"));
 	loop_idx = 0;
 	while (!((isr = W5100_READ(Sn_IR(0))) & Sn_IR_PNEXT))
 	{
@@ -1369,16 +1371,16 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
    /* +200801[bj] clear interrupt value*/
    W5100_WRITE(Sn_IR(0), 0xff);
    /*---*/
-			xSerialPrint_P(PSTR("failed\r\nReinput id, password..\r\n"));
+			vLogPrint_P(PSTR("failed\r\nReinput id, password..\r\n"));
 			return 2;
 		}
-		xSerialPrintf(".");
+		vLogPrint_P(PSTR("."));
 		if (loop_idx++ == 10) // timeout
 		{
    /* +200801[bj] clear interrupt value*/
    W5100_WRITE(Sn_IR(0), 0xff);
    /*---*/
-			xSerialPrint_P(PSTR("timeout after PAP\r\n"));
+			vLogPrint_P(PSTR("timeout after PAP\r\n"));
 			return 3;
 		}
 		_delay_ms(1000);
@@ -1398,7 +1400,7 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	}
    /*---*/
 
-	xSerialPrint_P(PSTR("ok\r\n\n-- PHASE 4. IPCP process --"));
+	vLogPrint_P(PSTR("ok\r\n\n-- PHASE 4. IPCP process --"));
 	// IP Address
 	buf[0] = 0x03; buf[1] = 0x06; buf[2] = 0x00; buf[3] = 0x00; buf[4] = 0x00; buf[5] = 0x00;
 	send_data_processing(0, buf, 6);
@@ -1457,10 +1459,10 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	   			}
 			}
 		}
-		xSerialPrintf(".");
+		vLogPrint_P(PSTR("."));
 		if (loop_idx++ == 10) // timeout
 		{
-			xSerialPrint_P(PSTR("timeout after IPCP\r\n"));
+			vLogPrint_P(PSTR("timeout after IPCP\r\n"));
 			return 3;
 		}
 		_delay_ms(1000);
@@ -1475,10 +1477,10 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
 	loop_idx = 0;
 	while (!(W5100_READ(Sn_IR(0)) & Sn_IR_PNEXT))
 	{
-		xSerialPrint_P(PSTR("."));
+		vLogPrint_P(PSTR("."));
 		if (loop_idx++ == 10) // timeout
 		{
-			xSerialPrint_P(PSTR("timeout after IPCP NAK\r\n"));
+			vLogPrint_P(PSTR("timeout after IPCP NAK\r\n"));
 			return 3;
 		}
 		_delay_ms(1000);
@@ -1491,7 +1493,7 @@ uint8_t pppinit_in(uint8_t * id, uint8_t idlen, uint8_t * passwd, uint8_t passwd
    /* +200801[bj] clear interrupt value*/
    W5100_WRITE(Sn_IR(0), 0xff);
    /*---*/
-	xSerialPrint_P(PSTR("ok\r\n\n"));
+	vLogPrint_P(PSTR("ok\r\n\n"));
 	return 1;
 	// after this function, User must save the pppoe server's mac address and pppoe session id in current connection
 }
@@ -1505,7 +1507,7 @@ uint8_t pppterm(uint8_t * mac, uint8_t * sessionid)
 	uint16_t i;
 	uint8_t isr;
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR("pppterm()\r\n"));
+	vLogPrint_P(PSTR("pppterm()\r\n"));
 #endif
 	/* Set PPPoE bit in MR(Common Mode Register) : enable socket0 pppoe */
 	W5100_WRITE(MR,W5100_READ(MR) | MR_PPPOE);
@@ -1539,7 +1541,7 @@ uint8_t pppterm(uint8_t * mac, uint8_t * sessionid)
 
 
 #ifdef __DEF_W5100_DBG__
-	xSerialPrint_P(PSTR("pppterm() end ..\r\n"));
+	vLogPrint_P(PSTR("pppterm() end ..\r\n"));
 #endif
 
 	return 1;
@@ -0,0 +1,109 @@
+#include "arena.h"
+
+/*******************************************************************************
+* Function: xArenaCreate
+*
+* Description: Creates an arena backed by a single block from the FreeRTOS heap.
+*  Objects are carved out of the block by pvArenaAlloc and are never freed one
+*  at a time; vArenaReset releases all of them at once.
+*
+* param arena: The arena to initialize.
+* param size: Number of bytes to take from the FreeRTOS heap.
+* return: pdPASS, or pdFAIL if the heap could not supply the block.
+*******************************************************************************/
+portBASE_TYPE xArenaCreate(xArena *arena, size_t size) {
+	vArenaCreateStatic(arena, pvPortMalloc(size), size);
+	if (arena->pucBase == NULL) {
+		arena->xSize = 0;
+		return pdFAIL;
+	}
+
+	arena->ucOwned = 1;
+	return pdPASS;
+}
+
+/*******************************************************************************
+* Function: vArenaCreateStatic
+*
+* Description: Creates an arena on top of a caller supplied buffer, such as a
+*  static array. The buffer must outlive the arena.
+*
+* param arena: The arena to initialize.
+* param buffer: Memory the arena allocates from.
+* param size: Size of buffer in bytes.
+*******************************************************************************/
+void vArenaCreateStatic(xArena *arena, void *buffer, size_t size) {
+	arena->pucBase = (uint8_t *)buffer;
+	arena->xSize = size;
+	arena->xUsed = 0;
+	arena->ucOwned = 0;
+}
+
+/*******************************************************************************
+* Function: pvArenaAlloc
+*
+* Description: Returns the next size bytes of the arena, rounded up to the port
+*  byte alignment. This only moves a pointer, so it takes the same time for
+*  every call. The arena is not thread safe; callers sharing an arena must
+*  serialize access themselves.
+*
+* param arena: The arena to allocate from.
+* param size: Number of bytes wanted.
+* return: A pointer to the memory, or NULL if the arena is full.
+*******************************************************************************/
+void *pvArenaAlloc(xArena *arena, size_t size) {
+	void *pvReturn;
+
+	if (size & portBYTE_ALIGNMENT_MASK)
+		size += portBYTE_ALIGNMENT - (size & portBYTE_ALIGNMENT_MASK);
+
+	if (size == 0 || size > arena->xSize - arena->xUsed)
+		return NULL;
+
+	pvReturn = arena->pucBase + arena->xUsed;
+	arena->xUsed += size;
+
+	return pvReturn;
+}
+
+/*******************************************************************************
+* Function: vArenaReset
+*
+* Description: Releases every allocation made from the arena at once. Pointers
+*  previously returned by pvArenaAlloc must not be used afterwards.
+*
+* param arena: The arena to reset.
+*******************************************************************************/
+void vArenaReset(xArena *arena) {
+	arena->xUsed = 0;
+}
+
+/*******************************************************************************
+* Function: vArenaDelete
+*
+* Description: Returns the arena's memory to the FreeRTOS heap if it came from
+*  xArenaCreate. The arena is left empty.
+*
+* param arena: The arena to delete.
+*******************************************************************************/
+void vArenaDelete(xArena *arena) {
+	if (arena->ucOwned)
+		vPortFree(arena->pucBase);
+
+	arena->pucBase = NULL;
+	arena->xSize = 0;
+	arena->xUsed = 0;
+	arena->ucOwned = 0;
+}
+
+/*******************************************************************************
+* Function: xArenaGetFreeSize
+*
+* Description: Reports how many bytes are left in the arena.
+*
+* param arena: The arena to query.
+* return: The number of bytes that can still be allocated.
+*******************************************************************************/
+size_t xArenaGetFreeSize(const xArena *arena) {
+	return arena->xSize - arena->xUsed;
+}
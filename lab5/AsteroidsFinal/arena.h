@@ -0,0 +1,20 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "FreeRTOS.h"
+
+typedef struct {
+	uint8_t *pucBase;	/* Start of the arena's memory */
+	size_t xSize;		/* Bytes available from pucBase */
+	size_t xUsed;		/* Bytes handed out since the last reset */
+	uint8_t ucOwned;	/* pucBase came from pvPortMalloc */
+} xArena;
+
+portBASE_TYPE xArenaCreate(xArena *arena, size_t size);
+void vArenaCreateStatic(xArena *arena, void *buffer, size_t size);
+void *pvArenaAlloc(xArena *arena, size_t size);
+void vArenaReset(xArena *arena);
+void vArenaDelete(xArena *arena);
+size_t xArenaGetFreeSize(const xArena *arena);
+
+#endif /* ARENA_H_ */
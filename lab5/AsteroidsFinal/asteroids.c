@@ -10,8 +10,9 @@
 *  the player destroys all of the asteroids, they win the game. If the player
 *  collides with an asteroid, they lose the game. In both the winning and losing
 *  conditions, the game pauses for three seconds and displays an appropriate
-*  message. It is recommended to compile the FreeRTOS portion of this project
-*  with heap_2.c instead of heap_1.c since pvPortMalloc and vPortFree are used.
+*  message. Bullets and asteroids are kept in entity stores (see entity.h)
+*  whose arrays are carved once out of an arena from the FreeRTOS heap, and a
+*  round is reset by emptying the stores.
 *
 * Author(s): Doug Gallatin & Andrew Lehmer
 *
@@ -21,14 +22,20 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
 #include "semphr.h"
 
 #include "graphics.h"
 #include "usart.h"
+#include "arena.h"
+#include "entity.h"
+#include "fixed.h"
+#include "seqlock.h"
+#include "button.h"
 
 const char *astImages[] = {
    "a1.png",
@@ -36,26 +43,31 @@ const char *astImages[] = {
    "a3.png"
 };
 
+// Positions are in pixels and velocities in pixels per frame, see fixed.h
 typedef struct {
-   float x;
-   float y;
+   q16_16 x;
+   q16_16 y;
 } point;
 
-typedef struct object_s {
+typedef struct {
+   q8_8 x;
+   q8_8 y;
+} vector;
+
+// The player's ship. Bullets and asteroids are kept in entity stores.
+typedef struct {
    xSpriteHandle handle;
    point pos;
-   point vel;
-   float accel;
+   vector vel;
+   q8_8 accel;
    int16_t angle;
    int8_t a_vel;
-   uint8_t size;
-   uint16_t life;
-   struct object_s *next;
 } object;
 
-#define DEG_TO_RAD M_PI / 180.0
-
 #define INITIAL_ASTEROIDS 5
+#define MAX_ASTEROIDS 48
+#define MAX_BULLETS 16
+#define HIT_QUEUE_LEN 8
 #define SCREEN_W 800
 #define SCREEN_H 600
 
@@ -86,10 +98,30 @@ typedef struct object_s {
 #define AST_MAX_AVEL_2 6.0
 #define AST_MAX_AVEL_1 9.0
 
+// What drawTask needs to draw one frame, in window coordinates. updateTask
+// publishes these through stateLock.
+typedef struct {
+   int16_t shipX, shipY, shipAngle;
+   uint8_t asteroidCount;
+   uint8_t bulletCount;
+   xSpriteHandle astHandle[MAX_ASTEROIDS];
+   int16_t astX[MAX_ASTEROIDS], astY[MAX_ASTEROIDS], astAngle[MAX_ASTEROIDS];
+   xSpriteHandle bulletHandle[MAX_BULLETS];
+   int16_t bulletX[MAX_BULLETS], bulletY[MAX_BULLETS];
+} frameState;
+
+// A bullet that drawTask saw overlapping an asteroid, for updateTask to act on
+typedef struct {
+   xSpriteHandle bullet;
+   xSpriteHandle asteroid;
+} hitEvent;
+
 #define LEFT_BUTTON  _BV(PB7)
 #define RIGHT_BUTTON _BV(PB6)
 #define ACCEL_BUTTON _BV(PB1)
 #define SHOOT_BUTTON _BV(PB0)
+#define BUTTONS (LEFT_BUTTON | RIGHT_BUTTON | ACCEL_BUTTON | SHOOT_BUTTON)
+#define BUTTON_QUEUE_LEN 4
 
 static xTaskHandle inputTaskHandle;
 static xTaskHandle bulletTaskHandle;
@@ -97,11 +129,25 @@ static xTaskHandle updateTaskHandle;
 
 static xSemaphoreHandle usartMutex;
 static xSemaphoreHandle bulletMutex;
-static xSemaphoreHandle asteroidMutex;
+static xSemaphoreHandle shootSem;
+static xQueueHandle hitQueue;
 
 static object ship;
-static object *bullets = NULL;
-static object *asteroids = NULL;
+
+// The entity store arrays live in objArena for the life of the program. Only
+// updateTask changes the stores while the game runs; bullets is guarded by
+// bulletMutex because bulletTask adds to it.
+static xArena objArena;
+static xEntityStore bullets;
+static xEntityStore asteroids;
+
+// Double-buffered frames for drawTask, also in objArena, and drawTask's own
+// copy of the one it is drawing. Sprites are only deleted with usartMutex
+// held, and a frame without them is published before it is given back, so
+// drawTask never draws a deleted sprite.
+static frameState *states[2];
+static frameState *drawState;
+static xSeqLock stateLock;
 
 static xGroupHandle astGroup;
 static xSpriteHandle background;
@@ -109,70 +155,79 @@ static xSpriteHandle background;
 void init(void);
 void reset(void);
 int16_t getRandStartPosVal(int16_t dimOver2);
-object *createAsteroid(float x, float y, float velx, float vely, int16_t angle,
-                                    int8_t avel, int8_t size, object *nxt);
+uint8_t createAsteroid(q16_16 x, q16_16 y, q8_8 velx, q8_8 vely,
+                           int16_t angle, int8_t avel, int8_t size);
 uint16_t sizeToPix(int8_t size);
-object *createBullet(float x, float y, float velx, float vely, object *nxt);
-void spawnAsteroid(point *pos, uint8_t size);
+uint8_t createBullet(q16_16 x, q16_16 y, q8_8 velx, q8_8 vely);
+q8_8 randVel(q8_8 max);
+void wrapPoint(q16_16 *x, q16_16 *y);
+void spawnAsteroid(q16_16 x, q16_16 y, uint8_t size);
+void publishState(void);
+void handleHit(const hitEvent *hit);
 
 /*------------------------------------------------------------------------------
  * Function: inputTask
  *
- * Description: This task polls PINB for the current button state to determine
- *  if the player should turn, accelerate, or both. This task never blocks, so
- *  it should run at the lowest priority above the idle task priority.
+ * Description: This task sleeps until the pin change interrupt reports a
+ *  debounced button event, then sets whether the player should turn,
+ *  accelerate, or both from the buttons held. A press of the fire button wakes
+ *  bulletTask.
  *
  * param vParam: This parameter is not used.
  *----------------------------------------------------------------------------*/
 void inputTask(void *vParam) {
+   xButtonEvent event;
+   uint8_t held;
+
    while (1) {
+      xButtonReceive(&event, portMAX_DELAY);
+      held = uButtonState();
 
-      if((PINB & LEFT_BUTTON) == 0)
+      if(held & LEFT_BUTTON)
          ship.a_vel = SHIP_AVEL; 
-      else if((PINB & RIGHT_BUTTON) == 0)
+      else if(held & RIGHT_BUTTON)
          ship.a_vel = -SHIP_AVEL;
       else
          ship.a_vel = 0;
 
-      if((PINB & ACCEL_BUTTON) == 0)
-         ship.accel = SHIP_ACCEL;
+      if(held & ACCEL_BUTTON)
+         ship.accel = Q8_8(SHIP_ACCEL);
       else
          ship.accel = 0;  
 
-      // Allow the task to yeild
-      vTaskDelay(0);
+      if(event.pressed & SHOOT_BUTTON)
+         xSemaphoreGive(shootSem);
    }
 }
 
 /*------------------------------------------------------------------------------
  * Function: bulletTask
  *
- * Description: This task polls the state of the button that fires a bullet
- *  every 10 milliseconds. If a bullet is fired, this task blocks for half a
- *  second to regulate the fire rate.  If a bullet is not fired, the task
- *  blocks for a frame delay (FRAME_DELAY_MS)
+ * Description: This task sleeps until inputTask reports a press of the fire
+ *  button, then fires a bullet every 10 milliseconds for as long as the button
+ *  is held.
  *
  * param vParam: This parameter is not used.
  *----------------------------------------------------------------------------*/
 void bulletTask(void *vParam) {
-
    while (1) {
-      if((PINB & SHOOT_BUTTON) == 0) {
-
-         // Create a new bullet
-         xSemaphoreTake(bulletMutex, portMAX_DELAY);
-         bullets = createBullet(ship.pos.x,
-                                   ship.pos.y,
-                                   BULLET_VEL * -sin(ship.angle * DEG_TO_RAD),
-                                   BULLET_VEL * -cos(ship.angle * DEG_TO_RAD),
-                                   bullets);
-         xSemaphoreGive(bulletMutex);
-
-         //if bullet shot, delay this task 10 ms
-         vTaskDelay(10 / portTICK_RATE_MS);
-      } else
-         vTaskDelay(FRAME_DELAY_MS/portTICK_RATE_MS);
-    }
+      if(!(uButtonState() & SHOOT_BUTTON))
+         xSemaphoreTake(shootSem, portMAX_DELAY);
+
+      // Create a new bullet, unless the store is full. The create
+      // command must not land in the middle of another task's command.
+      xSemaphoreTake(bulletMutex, portMAX_DELAY);
+      xSemaphoreTake(usartMutex, portMAX_DELAY);
+      createBullet(ship.pos.x,
+                   ship.pos.y,
+                   -sFixMul(Q8_8(BULLET_VEL), sFixSin(ship.angle)),
+                   -sFixMul(Q8_8(BULLET_VEL), sFixCos(ship.angle)));
+      xSemaphoreGive(usartMutex);
+      xSemaphoreGive(bulletMutex);
+
+      //if bullet shot, delay this task 10 ms
+      vTaskDelay(10 / portTICK_RATE_MS);
+   }
 }
 
 /*------------------------------------------------------------------------------
@@ -181,14 +236,19 @@ void bulletTask(void *vParam) {
  * Description: This task observes the currently stored velocities for every
  *  game object and updates their position and rotation accordingly. It also
  *  updates the ship's velocities based on its current acceleration and angle.
- *  If a bullet has been in flight for too long, this task will delete it. This
- *  task runs every 10 milliseconds.
+ *  If a bullet has been in flight for too long, this task will delete it, and
+ *  it destroys the bullets and asteroids that drawTask reports as hits. Each
+ *  step ends by publishing a frame for drawTask. This task runs every 10
+ *  milliseconds.
  *
  * param vParam: This parameter is not used.
  *----------------------------------------------------------------------------*/
 void updateTask(void *vParam) {
-   float vel;
-   object *objIter, *objPrev;
+   int32_t vel;
+   uint8_t i;
+   portBASE_TYPE haveUsart;
+   hitEvent hit;
+
    for (;;) {
 
       // spin ship
@@ -199,98 +259,67 @@ void updateTask(void *vParam) {
           ship.angle += 360;
       
       // move ship
-      ship.vel.x += ship.accel * -sin(ship.angle * DEG_TO_RAD);
-      ship.vel.y += ship.accel * -cos(ship.angle * DEG_TO_RAD);
-      vel = ship.vel.x * ship.vel.x + ship.vel.y * ship.vel.y;
-      if (vel > SHIP_MAX_VEL) {
-         ship.vel.x *= SHIP_MAX_VEL / vel;
-         ship.vel.y *= SHIP_MAX_VEL / vel;
+      if (ship.accel) {
+         ship.vel.x -= sFixMul(ship.accel, sFixSin(ship.angle));
+         ship.vel.y -= sFixMul(ship.accel, sFixCos(ship.angle));
       }
 
-      ship.pos.x += ship.vel.x;
-      ship.pos.y += ship.vel.y;
-      
-      if (ship.pos.x < 0.0) {
-         ship.pos.x += SCREEN_W;
-      } else if (ship.pos.x > SCREEN_W) {
-         ship.pos.x -= SCREEN_W;
+      // vel is the squared speed in Q8.8, kept in 32 bits so it cannot wrap
+      vel = ((int32_t)ship.vel.x * ship.vel.x +
+             (int32_t)ship.vel.y * ship.vel.y) >> 8;
+      if (vel > Q8_8(SHIP_MAX_VEL)) {
+         ship.vel.x = (int32_t)ship.vel.x * Q8_8(SHIP_MAX_VEL) / vel;
+         ship.vel.y = (int32_t)ship.vel.y * Q8_8(SHIP_MAX_VEL) / vel;
       }
-      
-      if (ship.pos.y < 0.0) {
-         ship.pos.y += SCREEN_H;
-      } else if (ship.pos.y > SCREEN_H) {
-         ship.pos.y -= SCREEN_H;
+
+      ship.pos.x += Q8_8_TO_Q16_16(ship.vel.x);
+      ship.pos.y += Q8_8_TO_Q16_16(ship.vel.y);
+      wrapPoint(&ship.pos.x, &ship.pos.y);
+
+      // move asteroids
+      for (i = 0; i < asteroids.count; i++) {
+         asteroids.x[i] += Q8_8_TO_Q16_16(asteroids.velX[i]);
+         asteroids.y[i] += Q8_8_TO_Q16_16(asteroids.velY[i]);
+         asteroids.angle[i] += asteroids.aVel[i];
+
+         // wrap asteroid movement across screen
+         wrapPoint(&asteroids.x[i], &asteroids.y[i]);
       }
       
-      // move bullets
+      // The usart is only needed when a sprite has to be deleted, and is then
+      // held until the frame without it is published. Take it before changing
+      // anything, since drawTask may reset the round while this task waits.
       xSemaphoreTake(bulletMutex, portMAX_DELAY);
-      objPrev = NULL;
-      objIter = bullets;
-      while (objIter != NULL) {
+      haveUsart = uxQueueMessagesWaiting(hitQueue) > 0;
+      for (i = 0; i < bullets.count && !haveUsart; i++)
+         haveUsart = bullets.life[i] + FRAME_DELAY_MS >= BULLET_LIFE_MS;
+      if (haveUsart)
+         xSemaphoreTake(usartMutex, portMAX_DELAY);
+
+      // move bullets, from the end so that removal cannot skip one
+      for (i = bullets.count; i-- > 0; ) {
 
          // Kill bullet after a while
-         objIter->life += FRAME_DELAY_MS;
-         if (objIter->life >= BULLET_LIFE_MS) {
-            
-            xSemaphoreTake(usartMutex, portMAX_DELAY);
-            vSpriteDelete(objIter->handle);
-            
-            if (objPrev != NULL) {
-               objPrev->next = objIter->next;
-               vPortFree(objIter);
-               objIter = objPrev->next;
-            } else {
-               bullets = objIter->next;
-               vPortFree(objIter);
-               objIter = bullets;
-            }
-            xSemaphoreGive(usartMutex);
+         bullets.life[i] += FRAME_DELAY_MS;
+         if (bullets.life[i] >= BULLET_LIFE_MS) {
+            vSpriteDelete(bullets.handle[i]);
+            vEntityRemove(&bullets, i);
          } else {
-
-             objIter->pos.x += objIter->vel.x;
-             objIter->pos.y += objIter->vel.y;
-         
-             if (objIter->pos.x < 0.0) {
-                objIter->pos.x += SCREEN_W;
-             } else if (objIter->pos.x > SCREEN_W) {
-                objIter->pos.x -= SCREEN_W;
-             }
-         
-             if (objIter->pos.y < 0.0) {
-                objIter->pos.y += SCREEN_H;
-             } else if (objIter->pos.y > SCREEN_H) {
-                objIter->pos.y -= SCREEN_H;
-             }
-         
-             objPrev = objIter;
-             objIter = objIter->next;
-         }         
+            bullets.x[i] += Q8_8_TO_Q16_16(bullets.velX[i]);
+            bullets.y[i] += Q8_8_TO_Q16_16(bullets.velY[i]);
+            wrapPoint(&bullets.x[i], &bullets.y[i]);
+         }
       }
-      xSemaphoreGive(bulletMutex);
 
-      // move asteroids
-//      xSemaphoreTake(asteroidMutex, portMAX_DELAY); XXX
-      objIter = asteroids;
-      while (objIter != NULL) {
-         objIter->pos.x += objIter->vel.x;
-         objIter->pos.y += objIter->vel.y;
-         objIter->angle += objIter->a_vel;
-
-         // wrap asteroid movement across screen (xdir)
-         if (objIter->pos.x >= SCREEN_W)
-            objIter->pos.x -= SCREEN_W;
-         else if (objIter->pos.x <= 0)
-            objIter->pos.x += SCREEN_W;
-
-         // wrap asteroid movement across screen (ydir)
-         if (objIter->pos.y >= SCREEN_H)
-            objIter->pos.y -= SCREEN_H;
-         else if (objIter->pos.y <= 0)
-            objIter->pos.y += SCREEN_H;
-         
-         objIter = objIter->next;
-      }
-//      xSemaphoreGive(asteroidMutex); XXX
+      // destroy what drawTask saw collide
+      while (haveUsart && xQueueReceive(hitQueue, &hit, 0) == pdTRUE)
+         handleHit(&hit);
+
+      publishState();
+
+      if (haveUsart)
+         xSemaphoreGive(usartMutex);
+      xSemaphoreGive(bulletMutex);
 
       vTaskDelay(FRAME_DELAY_MS / portTICK_RATE_MS);
    }
@@ -300,17 +329,19 @@ void updateTask(void *vParam) {
  * Function: drawTask
  *
  * Description: This task sends the appropriate commands to update the game
- *  graphics every 10 milliseconds for a target frame rate of 100 FPS. It also
- *  checks collisions and performs the proper action based on the types of the
- *  colliding objects.
+ *  graphics at most every 10 milliseconds, for a frame rate of up to 100 FPS,
+ *  and otherwise as fast as the graphics link takes them. It draws the latest
+ *  frame published by updateTask without waiting for it, then checks
+ *  collisions. Bullet hits are passed back to updateTask; a ship hit, or the
+ *  last asteroid gone, ends the round.
  *
  * param vParam: This parameter is not used.
  *----------------------------------------------------------------------------*/
 void drawTask(void *vParam) {
-   object *objIter, *objPrev, *astIter, *astPrev;
-   xSpriteHandle hit, handle;
-   point pos;
-   uint8_t size;
+   xSpriteHandle handle;
+   const frameState *state = drawState;
+   hitEvent hit;
+   uint8_t i, seq;
    
    vTaskSuspend(updateTaskHandle);
    vTaskSuspend(bulletTaskHandle);
@@ -321,84 +352,48 @@ void drawTask(void *vParam) {
    vTaskResume(inputTaskHandle);
    
    for (;;) {
-      xSemaphoreTake(bulletMutex, portMAX_DELAY);
       xSemaphoreTake(usartMutex, portMAX_DELAY);
-      
-      vSpriteSetRotation(ship.handle, (uint16_t)ship.angle);
-      vSpriteSetPosition(ship.handle,
-                            (uint16_t)ship.pos.x,
-                            (uint16_t)ship.pos.y);
-
-      objPrev = NULL;
-      objIter = bullets;
-      while (objIter != NULL) {
-         vSpriteSetPosition(objIter->handle,
-                               (uint16_t)objIter->pos.x,
-                               (uint16_t)objIter->pos.y);
-         if (uCollide(objIter->handle, astGroup, &hit, 1) > 0) {
-            vSpriteDelete(objIter->handle);
-            
-            if (objPrev != NULL) {
-               objPrev->next = objIter->next;
-               vPortFree(objIter);
-               objIter = objPrev->next;
-            } else {
-               bullets = objIter->next;
-               vPortFree(objIter);
-               objIter = bullets;
-            }
-
-//            xSemaphoreTake(asteroidMutex, portMAX_DELAY); XXX
-            astPrev = NULL;
-            astIter = asteroids;
-            while (astIter != NULL) {
-               if (astIter->handle == hit) {
-                  pos = astIter->pos;
-                  size = astIter->size;
-                  vSpriteDelete(astIter->handle);
-                  if (astPrev != NULL) {
-                       astPrev->next = astIter->next;
-                       vPortFree(astIter);
-                       astIter = astPrev->next;
-                    } else {
-                       asteroids = astIter->next;
-                       vPortFree(astIter);
-                    }
-                  spawnAsteroid(&pos, size);
-                  break;
-
-               } else {
-                  astPrev = astIter;
-                  astIter = astIter->next;
-               }
-            }
-//            xSemaphoreGive(asteroidMutex); XXX
-            
 
-         } else {
-            objPrev = objIter;
-            objIter = objIter->next;
-         }
+      // Copy out the latest frame, again if updateTask got to it meanwhile
+      do {
+         seq = uSeqReadBegin(&stateLock);
+         memcpy(drawState, states[uSeqReadIndex(seq)], sizeof(frameState));
+      } while (xSeqReadRetry(&stateLock, seq));
+
+      // Every sprite moves in one FRAME command, so the host draws them all
+      // at once and collision checks below see the whole frame in place
+      vFrameBegin();
+      vSpriteSetRotation(ship.handle, state->shipAngle);
+      vSpriteSetPosition(ship.handle, state->shipX, state->shipY);
+
+      for (i = 0; i < state->bulletCount; i++)
+         vSpriteSetPosition(state->bulletHandle[i],
+                               state->bulletX[i],
+                               state->bulletY[i]);
+
+      for (i = 0; i < state->asteroidCount; i++) {
+         vSpriteSetPosition(state->astHandle[i],
+                               state->astX[i],
+                               state->astY[i]);
+         vSpriteSetRotation(state->astHandle[i], state->astAngle[i]);
       }
-      xSemaphoreGive(bulletMutex);
+      vFrameEnd();
 
-//      xSemaphoreTake(asteroidMutex, portMAX_DELAY); XXX
-      objIter = asteroids;
-      while (objIter != NULL) {
-         vSpriteSetPosition(objIter->handle,
-                               (uint16_t)objIter->pos.x,
-                               (uint16_t)objIter->pos.y);
-         vSpriteSetRotation(objIter->handle, objIter->angle);
-         objIter = objIter->next;
+      // A hit that does not fit in the queue is seen again next frame
+      for (i = 0; i < state->bulletCount; i++) {
+         hit.bullet = state->bulletHandle[i];
+         if (uCollideLocal(hit.bullet, astGroup, &hit.asteroid, 1) > 0)
+            xQueueSend(hitQueue, &hit, 0);
       }
-            
-      if (uCollide(ship.handle, astGroup, &hit, 1) > 0 || asteroids == NULL) {
+
+      if (uCollideLocal(ship.handle, astGroup, &handle, 1) > 0 ||
+          state->asteroidCount == 0) {
 
          vTaskSuspend(updateTaskHandle);
          vTaskSuspend(bulletTaskHandle);
          vTaskSuspend(inputTaskHandle);
 
-         if (asteroids == NULL)
+         if (state->asteroidCount == 0)
              handle = xSpriteCreate("win.png",
                                        SCREEN_W>>1,
                                        SCREEN_H>>1,
@@ -425,28 +420,42 @@ void drawTask(void *vParam) {
          vTaskResume(bulletTaskHandle);
          vTaskResume(inputTaskHandle);
       }      
-//      xSemaphoreGive(asteroidMutex); XXX
       xSemaphoreGive(usartMutex);
       
-      vTaskDelay(FRAME_DELAY_MS / portTICK_RATE_MS);
+      vFramePace(FRAME_DELAY_MS / portTICK_RATE_MS);
    }
 }
 
 int main(void) {
-   DDRB = 0x00;
+   xButtonInit(BUTTONS, BUTTON_QUEUE_LEN);
    TCCR2A = _BV(CS00); 
 DDRA = 0xFF; // XXX
 PORTA = 0x00; // XXX
    usartMutex = xSemaphoreCreateMutex();
    bulletMutex = xSemaphoreCreateMutex();
-   asteroidMutex = xSemaphoreCreateMutex();
+   vSemaphoreCreateBinary(shootSem);
+   xSemaphoreTake(shootSem, 0);
+   hitQueue = xQueueCreate(HIT_QUEUE_LEN, sizeof(hitEvent));
+   vSeqLockInit(&stateLock);
+
+   // The tasks use the stores and frames without checking them, so if the
+   // heap cannot supply the arena, stop here rather than start the scheduler
+   if (xArenaCreate(&objArena, (MAX_ASTEROIDS + MAX_BULLETS) * ENTITY_BYTES +
+                                  3 * sizeof(frameState)) != pdPASS
+       || xEntityStoreCreate(&asteroids, &objArena, MAX_ASTEROIDS) != pdPASS
+       || xEntityStoreCreate(&bullets, &objArena, MAX_BULLETS) != pdPASS
+       || !(states[0] = pvArenaAlloc(&objArena, sizeof(frameState)))
+       || !(states[1] = pvArenaAlloc(&objArena, sizeof(frameState)))
+       || !(drawState = pvArenaAlloc(&objArena, sizeof(frameState))))
+      for (;;)
+         ;
 
    vWindowCreate(SCREEN_W, SCREEN_H);
    sei();
    
-   xTaskCreate(inputTask, (signed char*) "i", 80, NULL, 1, &inputTaskHandle);
+   xTaskCreate(inputTask, (signed char*) "i", 120, NULL, 1, &inputTaskHandle);
    xTaskCreate(bulletTask, (signed char*) "b", 130, NULL, 2, &bulletTaskHandle);
-   xTaskCreate(updateTask, (signed char*) "u", 200, NULL, 4, &updateTaskHandle);
+   xTaskCreate(updateTask, (signed char*) "u", 230, NULL, 4, &updateTaskHandle);
    xTaskCreate(drawTask, (signed char*) "d", 230, NULL, 3, NULL);
    
    vTaskStartScheduler();
@@ -465,8 +474,8 @@ PORTA = 0x00; // XXX
 void init(void) {
    int i;
 
-   bullets = NULL;
-   asteroids = NULL;
+   vEntityClear(&bullets);
+   vEntityClear(&asteroids);
    astGroup = ERROR_HANDLE;
    
    background = xSpriteCreate("stars.png",
@@ -482,14 +491,13 @@ void init(void) {
    astGroup = xGroupCreate();
 
    for (i = 0; i < INITIAL_ASTEROIDS; i++) {
-      asteroids = createAsteroid(getRandStartPosVal(SCREEN_W >> 1),
-               getRandStartPosVal(SCREEN_H >> 1),
-               (rand() % (int8_t)(AST_MAX_VEL_3 * 10)) / 5.0 - AST_MAX_VEL_3,
-               (rand() % (int8_t)(AST_MAX_VEL_3 * 10)) / 5.0 - AST_MAX_VEL_3,
+      createAsteroid(Q16_16(getRandStartPosVal(SCREEN_W >> 1)),
+               Q16_16(getRandStartPosVal(SCREEN_H >> 1)),
+               randVel(Q8_8(AST_MAX_VEL_3)),
+               randVel(Q8_8(AST_MAX_VEL_3)),
                rand() % 360,
-               (rand() % (int8_t)(AST_MAX_AVEL_3 * 10)) / 5.0 - AST_MAX_AVEL_3,
-               3,
-               asteroids);
+               randVel(Q8_8(AST_MAX_AVEL_3)) >> 8,
+               3);
    }
 
    ship.handle = xSpriteCreate("ship.png",
@@ -499,45 +507,38 @@ void init(void) {
                                   SHIP_SIZE,
                                   SHIP_SIZE,
                                   1);
-   ship.pos.x = SCREEN_W >> 1;
-   ship.pos.y = SCREEN_H >> 1;
+   ship.pos.x = Q16_16(SCREEN_W >> 1);
+   ship.pos.y = Q16_16(SCREEN_H >> 1);
    ship.vel.x = 0;
    ship.vel.y = 0;
    ship.accel = 0;
    ship.angle = 0;
    ship.a_vel = 0;
+
+   // The other tasks are suspended, so this task may stand in as the writer
+   xQueueReset(hitQueue);
+   publishState();
 }
 
 /*------------------------------------------------------------------------------
  * Function: reset
  *
- * Description: This function destroys all game objects in the heap and clears
- *  their respective sprites from the window.
+ * Description: This function destroys all game objects and clears their
+ *  respective sprites from the window. The objects themselves are released
+ *  together by emptying their entity stores.
  *----------------------------------------------------------------------------*/
 void reset(void) {   
-   object *iter, *prev;
-
-   // Free asteroids
-   iter = asteroids;
-   prev = NULL;
-   while (iter) {
-      vSpriteDelete(iter->handle);
-      prev = iter;
-      iter = iter->next;
-      vPortFree(prev);
-   }
-   asteroids = NULL;
-
-   // Free bullets
-   iter = bullets;
-   prev = NULL;
-   while (iter) {
-      vSpriteDelete(iter->handle);
-      prev = iter;
-      iter = iter->next;
-      vPortFree(prev);
-   }
-   bullets = NULL;
+   uint8_t i;
+
+   // Delete asteroid and bullet sprites
+   for (i = 0; i < asteroids.count; i++)
+      vSpriteDelete(asteroids.handle[i]);
+   for (i = 0; i < bullets.count; i++)
+      vSpriteDelete(bullets.handle[i]);
+
+   // Free every object at once
+   vEntityClear(&asteroids);
+   vEntityClear(&bullets);
 
    // Delete other sprites
    vSpriteDelete(ship.handle);
@@ -573,41 +574,39 @@ int16_t getRandStartPosVal(int16_t dimOver2) {
  * param avel: The starting angular velocity of the asteroid in degrees per
  *  frame.
  * param size: The starting size of the asteroid. Must be in the range [1,3].
- * param nxt: A pointer to the next asteroid object in a linked list.
- * return: A pointer to a malloc'd asteroid object. Must be freed by the calling
- *  process.
+ * return: The index of the new asteroid in the asteroid store, or ENTITY_NONE
+ *  if the store is full.
  *----------------------------------------------------------------------------*/
-object *createAsteroid(float x, float y, float velx, float vely, int16_t angle,
-                           int8_t avel, int8_t size, object *nxt) {
+uint8_t createAsteroid(q16_16 x, q16_16 y, q8_8 velx, q8_8 vely,
+                           int16_t angle, int8_t avel, int8_t size) {
 
-   // Allocate space for new asteroid
-   object *newAsteroid = (object *) pvPortMalloc(sizeof(object));
-   if (!newAsteroid)
-      return NULL;
+   // Take the next free asteroid
+   uint8_t i = uEntityAdd(&asteroids);
+   if (i == ENTITY_NONE)
+      return ENTITY_NONE;
 
    // Initialize asteroid variables
-   newAsteroid->pos.x = x;
-   newAsteroid->pos.y = y;
-   newAsteroid->vel.y = vely;
-   newAsteroid->vel.y = vely;
-   newAsteroid->angle = angle;
-   newAsteroid->a_vel = avel;
-   newAsteroid->size = size;
-   newAsteroid->next = nxt;
+   asteroids.x[i] = x;
+   asteroids.y[i] = y;
+   asteroids.velX[i] = velx;
+   asteroids.velY[i] = vely;
+   asteroids.angle[i] = angle;
+   asteroids.aVel[i] = avel;
+   asteroids.size[i] = size;
 
    // Create a random asteroid sprite for this asteroid
-   newAsteroid->handle = xSpriteCreate(astImages[rand()%3],
-                                          newAsteroid->pos.x,
-                                          newAsteroid->pos.y,
-                                          newAsteroid->angle,
+   asteroids.handle[i] = xSpriteCreate(astImages[rand()%3],
+                                          Q16_16_TO_INT(x),
+                                          Q16_16_TO_INT(y),
+                                          angle,
                                           sizeToPix(size),
                                           sizeToPix(size),
                                           rand()%10);
 
    // Add the new sprite to asteroid group
-   vGroupAddSprite(astGroup, newAsteroid->handle);
+   vGroupAddSprite(astGroup, asteroids.handle[i]);
 
-   return newAsteroid;
+   return i;
 }
 
 /*------------------------------------------------------------------------------
@@ -643,60 +642,49 @@ uint16_t sizeToPix(int8_t size) {
  * param y: The starting y position of the new bullet sprite.
  * param velx: The new bullet's x velocity.
  * param vely: The new bullet's y velocity.
- * param nxt: A pointer to the next bullet object in a linked list of bullets.
- * return: A pointer to a malloc'd bullet object. This pointer must be freed by
- *  the caller.
+ * return: The index of the new bullet in the bullet store, or ENTITY_NONE if
+ *  the store is full. The caller must hold bulletMutex.
  *----------------------------------------------------------------------------*/
-object *createBullet(float x, float y, float velx, float vely, object *nxt) {
+uint8_t createBullet(q16_16 x, q16_16 y, q8_8 velx, q8_8 vely) {
    char *filename = "bullet.png";
 
-   // Allocate space for new bullet
-   object *newBullet = (object *) pvPortMalloc(sizeof(object));
-   if (!newBullet)
-      return NULL;
+   // Take the next free bullet
+   uint8_t i = uEntityAdd(&bullets);
+   if (i == ENTITY_NONE)
+      return ENTITY_NONE;
 
-   newBullet->pos.x = x;
-   newBullet->pos.y = y;
-   newBullet->vel.x = velx;
-   newBullet->vel.y = vely;
-   newBullet->life = 0;
-   newBullet->next = nxt;
+   bullets.x[i] = x;
+   bullets.y[i] = y;
+   bullets.velX[i] = velx;
+   bullets.velY[i] = vely;
 
    // Create a bullet sprite for this bullet
-   newBullet->handle = xSpriteCreate(filename,
-                                          newBullet->pos.x,
-                                          newBullet->pos.y,
-                                          newBullet->angle,
+   bullets.handle[i] = xSpriteCreate(filename,
+                                          Q16_16_TO_INT(x),
+                                          Q16_16_TO_INT(y),
+                                          0,
                                           BULLET_SIZE,
                                           BULLET_SIZE,
                                           1);
 
-   // Insert into bullet list
-   newBullet->next = nxt;
-
-   return newBullet;
+   return i;
 }
 
 /*------------------------------------------------------------------------------
  * Function: spawnAsteroid
  *
  * Description: This function decomposes a larger asteroid into three smaller
- *  ones with random velocities and appends them to the global list of
- *  asteroids.
+ *  ones with random velocities and adds them to the asteroid store.
  *
- * param pos: A pointer to the position at which the new asteroids will be
- *  created.
+ * param x: The x position at which the new asteroids will be created.
+ * param y: The y position at which the new asteroids will be created.
  * param size: The size of the asteroid being destroyed.
  *----------------------------------------------------------------------------*/
-void spawnAsteroid(point *pos, uint8_t size) {
+void spawnAsteroid(q16_16 x, q16_16 y, uint8_t size) {
 
-   float velx;
-   float vely;
-   uint16_t angle;
-   uint8_t avel;
    uint8_t asteroid;
-   float maxVel;
-   uint8_t maxavel;
+   q8_8 maxVel;
+   q8_8 maxavel;
 
    switch (size) {
 
@@ -705,31 +693,121 @@ void spawnAsteroid(point *pos, uint8_t size) {
          return;
 
       case 2:
-         maxVel = AST_MAX_VEL_1;
-         maxavel = AST_MAX_AVEL_1;
+         maxVel = Q8_8(AST_MAX_VEL_1);
+         maxavel = Q8_8(AST_MAX_AVEL_1);
          break;
 
       case 3:
-         maxVel = AST_MAX_VEL_2;
-         maxavel = AST_MAX_AVEL_2;
+         maxVel = Q8_8(AST_MAX_VEL_2);
+         maxavel = Q8_8(AST_MAX_AVEL_2);
          break;
    }
 
-   xSemaphoreTake(asteroidMutex, portMAX_DELAY);
    for (asteroid = 0; asteroid < 3; asteroid++) {
-      velx = (((rand() % 100) * maxVel/2) / 100.0) - maxVel/2;
-      vely = (((rand() % 100) * maxVel/2) / 100.0) - maxVel/2;
-      angle = rand() % 360;
-      avel = (((rand() % 100) * maxavel/2) / 100.0) - maxavel/2;
-
-      asteroids = createAsteroid(pos->x,
-                              pos->y,
-                              (rand() % (int8_t)(maxVel * 10)) / 5.0 - maxVel,
-                              (rand() % (int8_t)(maxVel * 10)) / 5.0 - maxVel,
-                              rand() % 360,
-                              (rand() % (int8_t)(maxavel * 10)) / 5.0 - maxavel,
-                              size - 1,
-                              asteroids);
+      createAsteroid(x,
+                     y,
+                     randVel(maxVel),
+                     randVel(maxVel),
+                     rand() % 360,
+                     randVel(maxavel) >> 8,
+                     size - 1);
+   }
+}
+
+/*------------------------------------------------------------------------------
+ * Function: randVel
+ *
+ * Description: This function picks a random velocity for a new asteroid.
+ *
+ * param max: The largest speed in either direction, in Q8.8.
+ * return: A velocity in the range [-max, max), in Q8.8.
+ *----------------------------------------------------------------------------*/
+q8_8 randVel(q8_8 max) {
+   return (q8_8)(rand() % (2 * max)) - max;
+}
+
+/*------------------------------------------------------------------------------
+ * Function: wrapPoint
+ *
+ * Description: This function wraps a position that has left the screen around
+ *  to the opposite edge.
+ *
+ * param x: A pointer to the x position to wrap.
+ * param y: A pointer to the y position to wrap.
+ *----------------------------------------------------------------------------*/
+void wrapPoint(q16_16 *x, q16_16 *y) {
+   if (*x < 0)
+      *x += Q16_16(SCREEN_W);
+   else if (*x >= Q16_16(SCREEN_W))
+      *x -= Q16_16(SCREEN_W);
+
+   if (*y < 0)
+      *y += Q16_16(SCREEN_H);
+   else if (*y >= Q16_16(SCREEN_H))
+      *y -= Q16_16(SCREEN_H);
+}
+
+/*------------------------------------------------------------------------------
+ * Function: publishState
+ *
+ * Description: This function copies the ship and the entity stores into the
+ *  frame buffer drawTask is not reading, then makes it the latest frame. Only
+ *  updateTask may call it while the game runs, holding bulletMutex.
+ *----------------------------------------------------------------------------*/
+void publishState(void) {
+   frameState *state = states[uSeqWriteBegin(&stateLock)];
+   uint8_t i;
+
+   state->shipX = Q16_16_TO_INT(ship.pos.x);
+   state->shipY = Q16_16_TO_INT(ship.pos.y);
+   state->shipAngle = ship.angle;
+
+   state->asteroidCount = asteroids.count;
+   for (i = 0; i < asteroids.count; i++) {
+      state->astHandle[i] = asteroids.handle[i];
+      state->astX[i] = Q16_16_TO_INT(asteroids.x[i]);
+      state->astY[i] = Q16_16_TO_INT(asteroids.y[i]);
+      state->astAngle[i] = asteroids.angle[i];
+   }
+
+   state->bulletCount = bullets.count;
+   for (i = 0; i < bullets.count; i++) {
+      state->bulletHandle[i] = bullets.handle[i];
+      state->bulletX[i] = Q16_16_TO_INT(bullets.x[i]);
+      state->bulletY[i] = Q16_16_TO_INT(bullets.y[i]);
+   }
+
+   vSeqWriteEnd(&stateLock);
+}
+
+/*------------------------------------------------------------------------------
+ * Function: handleHit
+ *
+ * Description: This function destroys a bullet and the asteroid it hit, and
+ *  breaks the asteroid up. Either may already be gone, since drawTask can
+ *  report a hit more than once before it is handled. The caller must hold
+ *  bulletMutex and usartMutex.
+ *
+ * param hit: The bullet and asteroid sprites that collided.
+ *----------------------------------------------------------------------------*/
+void handleHit(const hitEvent *hit) {
+   uint8_t b = uEntityFind(&bullets, hit->bullet);
+   uint8_t a;
+
+   if (b == ENTITY_NONE)
+      return;
+
+   vSpriteDelete(bullets.handle[b]);
+   vEntityRemove(&bullets, b);
+
+   a = uEntityFind(&asteroids, hit->asteroid);
+   if (a != ENTITY_NONE) {
+      q16_16 x = asteroids.x[a];
+      q16_16 y = asteroids.y[a];
+      uint8_t size = asteroids.size[a];
+
+      vSpriteDelete(asteroids.handle[a]);
+      vEntityRemove(&asteroids, a);
+      spawnAsteroid(x, y, size);
    }
-   xSemaphoreGive(asteroidMutex);
 }
@@ -0,0 +1,185 @@
+/***************************
+*
+* Filename: button.c
+*
+* Description: Debounced push buttons on port B.
+*  The STK500 switches pull their pins low when
+*  pressed. Any edge raises PCINT0; the interrupt
+*  timestamps it with the tick count and accepts it
+*  only if the button has been quiet for
+*  BUTTON_DEBOUNCE_MS, so a bouncing contact yields
+*  one event. Because the first edge is the one
+*  accepted, a press shorter than the debounce time
+*  could otherwise be left looking held, so the
+*  receiver checks the pins again once things have
+*  been quiet for that long.
+*
+***************************/
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "button.h"
+
+#define DEBOUNCE_TICKS \
+	((BUTTON_DEBOUNCE_MS + portTICK_RATE_MS - 1) / portTICK_RATE_MS)
+
+static xQueueHandle buttonQueue;
+static uint8_t buttonMask;
+
+static volatile uint8_t buttonState;	/* Debounced, 1 = pressed */
+static volatile uint8_t unsettled;		/* An edge arrived inside the lockout */
+static portTickType lastEdge[8];		/* Last accepted edge of each pin */
+
+/************************************
+* Procedure: PCINT0_vect
+*
+* Description: Turns the accepted edges on port B
+*  into an event for xButtonReceive.
+************************************/
+ISR(PCINT0_vect) {
+	signed portBASE_TYPE woken = pdFALSE;
+	portTickType now = xTaskGetTickCountFromISR();
+	uint8_t changed = (~PINB & buttonMask) ^ buttonState;
+	uint8_t accepted = 0, bit;
+	xButtonEvent event;
+
+	for (bit = 0; changed; bit++, changed >>= 1) {
+		if (!(changed & 1))
+			continue;
+		if ((portTickType)(now - lastEdge[bit]) >= DEBOUNCE_TICKS) {
+			accepted |= 1 << bit;
+			lastEdge[bit] = now;
+		}
+		unsettled = 1;
+	}
+
+	if (accepted) {
+		buttonState ^= accepted;
+		event.pressed = accepted & buttonState;
+		event.released = accepted & ~buttonState;
+		event.time = now;
+		xQueueSendFromISR(buttonQueue, &event, &woken);
+	}
+
+	if (woken != pdFALSE)
+		taskYIELD();
+}
+
+/************************************
+* Procedure: xButtonInit
+*
+* Description: Makes the given port B pins inputs
+*  and starts watching them for changes. Call before
+*  the scheduler starts.
+*
+* param mask: The port B pins with buttons
+* param queueLength: Events held for the receiver
+* return: pdPASS, or pdFAIL if the queue could not
+*  be created
+************************************/
+portBASE_TYPE xButtonInit(uint8_t mask, unsigned portBASE_TYPE queueLength) {
+	buttonQueue = xQueueCreate(queueLength, sizeof(xButtonEvent));
+	if (buttonQueue == NULL)
+		return pdFAIL;
+
+	buttonMask = mask;
+	DDRB &= ~mask;
+	buttonState = ~PINB & mask;
+	unsettled = 0;
+
+	PCMSK0 |= mask;
+	PCIFR = _BV(PCIF0);
+	PCICR |= _BV(PCIE0);
+
+	return pdPASS;
+}
+
+/************************************
+* Procedure: prvSettle
+*
+* Description: Compares the pins with the debounced
+*  state once they have been quiet for the debounce
+*  time, and turns any difference into an event.
+*
+* param event: Receives the event
+* return: pdTRUE if there was a difference
+************************************/
+static portBASE_TYPE prvSettle(xButtonEvent *event) {
+	portTickType now;
+	uint8_t changed, bit;
+
+	portENTER_CRITICAL();
+	now = xTaskGetTickCount();
+	for (bit = 0; bit < 8; bit++)
+		if ((buttonMask & (1 << bit)) &&
+		 (portTickType)(now - lastEdge[bit]) < DEBOUNCE_TICKS)
+			break;
+	if (bit < 8) {
+		portEXIT_CRITICAL();
+		return pdFALSE;
+	}
+
+	unsettled = 0;
+	changed = (~PINB & buttonMask) ^ buttonState;
+	buttonState ^= changed;
+	portEXIT_CRITICAL();
+
+	if (!changed)
+		return pdFALSE;
+
+	event->pressed = changed & buttonState;
+	event->released = changed & ~buttonState;
+	event->time = now;
+
+	return pdTRUE;
+}
+
+/************************************
+* Procedure: xButtonReceive
+*
+* Description: Blocks until a button is pressed or
+*  released. Only one task may receive.
+*
+* param event: Receives the change
+* param timeout: Ticks to wait, or portMAX_DELAY
+* return: pdTRUE if event was filled in, pdFALSE if
+*  the timeout passed first
+************************************/
+portBASE_TYPE xButtonReceive(xButtonEvent *event, portTickType timeout) {
+	portTickType start = xTaskGetTickCount(), waited, wait;
+
+	for (;;) {
+		wait = timeout;
+		if (unsettled && wait > DEBOUNCE_TICKS)
+			wait = DEBOUNCE_TICKS;
+
+		if (xQueueReceive(buttonQueue, event, wait) == pdTRUE)
+			return pdTRUE;
+
+		if (unsettled && prvSettle(event))
+			return pdTRUE;
+
+		if (timeout != portMAX_DELAY) {
+			waited = xTaskGetTickCount() - start;
+			if (waited >= timeout)
+				return pdFALSE;
+			timeout -= waited;
+			start += waited;
+		}
+	}
+}
+
+/************************************
+* Procedure: uButtonState
+*
+* Description: Returns the debounced state of the
+*  buttons, a set bit for each one held down.
+************************************/
+uint8_t uButtonState(void) {
+	return buttonState;
+}
@@ -0,0 +1,30 @@
+/***************************
+*
+* Filename: button.h
+*
+* Description: Debounced push buttons on port B,
+*  delivered as events from the pin change
+*  interrupt instead of being polled.
+*
+***************************/
+
+#ifndef BUTTON_H_
+#define BUTTON_H_
+
+#include "FreeRTOS.h"
+
+/* Edges on a button closer together than this are bounce. */
+#define BUTTON_DEBOUNCE_MS 20
+
+/* Buttons whose state changed at the same instant. Bits are port B pins. */
+typedef struct {
+	uint8_t pressed;
+	uint8_t released;
+	portTickType time;	/* Tick count of the change */
+} xButtonEvent;
+
+portBASE_TYPE xButtonInit(uint8_t mask, unsigned portBASE_TYPE queueLength);
+portBASE_TYPE xButtonReceive(xButtonEvent *event, portTickType timeout);
+uint8_t uButtonState(void);
+
+#endif /* BUTTON_H_ */
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "entity.h"
+
+/*******************************************************************************
+* Function: xEntityStoreCreate
+*
+* Description: Creates an empty store, carving one array per field out of the
+*  given arena. The arrays are allocated once and reused for the life of the
+*  store, so adding and removing entities never touches a heap.
+*
+* param store: The store to initialize.
+* param arena: The arena the arrays are allocated from.
+* param capacity: The largest number of entities the store can hold, less than
+*  ENTITY_NONE.
+* return: pdPASS, or pdFAIL if the arena could not hold the arrays.
+*******************************************************************************/
+portBASE_TYPE xEntityStoreCreate(xEntityStore *store, xArena *arena,
+ uint8_t capacity) {
+	store->capacity = capacity;
+	store->count = 0;
+
+	store->handle = pvArenaAlloc(arena, capacity * sizeof(xSpriteHandle));
+	store->x = pvArenaAlloc(arena, capacity * sizeof(q16_16));
+	store->y = pvArenaAlloc(arena, capacity * sizeof(q16_16));
+	store->velX = pvArenaAlloc(arena, capacity * sizeof(q8_8));
+	store->velY = pvArenaAlloc(arena, capacity * sizeof(q8_8));
+	store->angle = pvArenaAlloc(arena, capacity * sizeof(int16_t));
+	store->aVel = pvArenaAlloc(arena, capacity * sizeof(int8_t));
+	store->size = pvArenaAlloc(arena, capacity * sizeof(uint8_t));
+	store->life = pvArenaAlloc(arena, capacity * sizeof(uint16_t));
+
+	if (!store->handle || !store->x || !store->y || !store->velX ||
+	 !store->velY || !store->angle || !store->aVel || !store->size ||
+	 !store->life) {
+		store->capacity = 0;
+		return pdFAIL;
+	}
+
+	return pdPASS;
+}
+
+/*******************************************************************************
+* Function: uEntityAdd
+*
+* Description: Appends a new entity with every field zeroed and its sprite
+*  handle set to ERROR_HANDLE.
+*
+* param store: The store to add to.
+* return: The index of the new entity, or ENTITY_NONE if the store is full.
+*******************************************************************************/
+uint8_t uEntityAdd(xEntityStore *store) {
+	uint8_t i = store->count;
+
+	if (i >= store->capacity)
+		return ENTITY_NONE;
+
+	store->handle[i] = ERROR_HANDLE;
+	store->x[i] = 0;
+	store->y[i] = 0;
+	store->velX[i] = 0;
+	store->velY[i] = 0;
+	store->angle[i] = 0;
+	store->aVel[i] = 0;
+	store->size[i] = 0;
+	store->life[i] = 0;
+	store->count++;
+
+	return i;
+}
+
+/*******************************************************************************
+* Function: vEntityRemove
+*
+* Description: Removes an entity by moving the last entity into its slot, so
+*  it takes the same time wherever the entity is. A loop that removes entities
+*  as it goes should walk the store from the end, so that the entity moved in
+*  has already been visited.
+*
+* param store: The store to remove from.
+* param index: The index of the entity to remove.
+*******************************************************************************/
+void vEntityRemove(xEntityStore *store, uint8_t index) {
+	uint8_t last;
+
+	if (index >= store->count)
+		return;
+
+	last = --store->count;
+	if (index == last)
+		return;
+
+	store->handle[index] = store->handle[last];
+	store->x[index] = store->x[last];
+	store->y[index] = store->y[last];
+	store->velX[index] = store->velX[last];
+	store->velY[index] = store->velY[last];
+	store->angle[index] = store->angle[last];
+	store->aVel[index] = store->aVel[last];
+	store->size[index] = store->size[last];
+	store->life[index] = store->life[last];
+}
+
+/*******************************************************************************
+* Function: uEntityFind
+*
+* Description: Finds the entity drawn by the given sprite.
+*
+* param store: The store to search.
+* param handle: The sprite handle to look for.
+* return: The index of the entity, or ENTITY_NONE if no entity has the sprite.
+*******************************************************************************/
+uint8_t uEntityFind(const xEntityStore *store, xSpriteHandle handle) {
+	const xSpriteHandle *p = memchr(store->handle, handle, store->count);
+
+	return p ? (uint8_t)(p - store->handle) : ENTITY_NONE;
+}
@@ -0,0 +1,42 @@
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include "FreeRTOS.h"
+#include "arena.h"
+#include "fixed.h"
+#include "graphics.h"
+
+/* Index returned by uEntityAdd when the store is full */
+#define ENTITY_NONE 0xFF
+
+/* A fixed-capacity set of game objects stored as parallel arrays, one per
+ * field. Live entities always occupy indices [0, count), so a loop over a
+ * field touches consecutive memory only. Removing an entity moves the last
+ * one into its place, so indices are not stable across vEntityRemove. */
+typedef struct {
+	uint8_t capacity;
+	uint8_t count;
+	xSpriteHandle *handle;
+	q16_16 *x, *y;			/* Position in pixels */
+	q8_8 *velX, *velY;		/* Velocity in pixels per frame */
+	int16_t *angle;			/* Rotation in degrees */
+	int8_t *aVel;			/* Angular velocity in degrees per frame */
+	uint8_t *size;
+	uint16_t *life;			/* Time alive in milliseconds */
+} xEntityStore;
+
+/* Bytes of arena that one entity takes, for sizing the arena */
+#define ENTITY_BYTES (sizeof(xSpriteHandle) + 2 * sizeof(q16_16) + \
+ 2 * sizeof(q8_8) + sizeof(int16_t) + sizeof(int8_t) + sizeof(uint8_t) + \
+ sizeof(uint16_t))
+
+portBASE_TYPE xEntityStoreCreate(xEntityStore *store, xArena *arena,
+ uint8_t capacity);
+uint8_t uEntityAdd(xEntityStore *store);
+void vEntityRemove(xEntityStore *store, uint8_t index);
+uint8_t uEntityFind(const xEntityStore *store, xSpriteHandle handle);
+
+/* Removes every entity at once */
+#define vEntityClear(store) ((store)->count = 0)
+
+#endif /* ENTITY_H_ */
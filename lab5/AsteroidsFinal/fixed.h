@@ -0,0 +1,48 @@
+#ifndef FIXED_H_
+#define FIXED_H_
+
+#include <stdint.h>
+
+/* Fixed-point numbers. Q8.8 holds small signed quantities such as velocities
+ * to 1/256 in an int16_t; Q16.16 holds window positions to 1/65536 in an
+ * int32_t. Angles are whole degrees. */
+typedef int16_t q8_8;
+typedef int32_t q16_16;
+
+#define Q8_8_ONE   ((q8_8)1 << 8)
+#define Q16_16_ONE ((q16_16)1 << 16)
+
+/* Conversions of constants and integers. Q8_8() and Q16_16() also accept
+ * floating-point constants, which the compiler folds away. */
+#define Q8_8(v)            ((q8_8)((v) * Q8_8_ONE))
+#define Q16_16(v)          ((q16_16)((v) * Q16_16_ONE))
+#define Q8_8_TO_INT(v)     ((int16_t)((v) >> 8))
+#define Q16_16_TO_INT(v)   ((int16_t)((v) >> 16))
+#define Q8_8_TO_Q16_16(v)  ((q16_16)(v) << 8)
+
+/*******************************************************************************
+* Function: sFixMul
+*
+* Description: Multiplies two Q8.8 numbers. The 16x16 bit product maps onto
+*  the AVR hardware multiplier, so this is a few dozen cycles.
+*******************************************************************************/
+static inline q8_8 sFixMul(q8_8 a, q8_8 b) {
+	return (q8_8)(((int32_t)a * b) >> 8);
+}
+
+/*******************************************************************************
+* Function: sFixDiv
+*
+* Description: Divides two Q8.8 numbers. Division is still done in software,
+*  so keep it out of per-object loops where possible.
+*******************************************************************************/
+static inline q8_8 sFixDiv(q8_8 a, q8_8 b) {
+	return (q8_8)(((int32_t)a << 8) / b);
+}
+
+q8_8 sFixSin(int16_t degrees);
+q8_8 sFixCos(int16_t degrees);
+q16_16 xFixSin(int16_t degrees);
+q16_16 xFixCos(int16_t degrees);
+
+#endif /* FIXED_H_ */
@@ -1,6 +1,17 @@
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "graphics.h"
 #include "usart.h"
 
+/* The link to the host is a plain byte stream, not framed like the wiflyClock
+ * command stream (see final/wiflyClock/Project/frame.h). A FRAME command can
+ * run to a few hundred bytes, and buffers to encode and decode it would not
+ * fit in SRAM next to the heap. A lost or corrupted byte therefore leaves the
+ * host out of step until both ends are reset. */
+
 /* Sprite functions */
 #define CREATE_SPRITE       0x01
 #define SET_POS             0x02
@@ -19,8 +30,258 @@
 #define CREATE_WINDOW       0x0A
 #define PYTHON_PRINT        0x0B
 
+/* Batched sprite updates, see vFrameEnd */
+#define FRAME               0x0E
+
+/* Sent unasked by the host, followed by the handle of a sprite whose image
+ * could not be loaded */
+#define LOAD_ERROR          0xFE
+
+/* Handles given out by prvAllocHandle. 0 is ALL_GROUP, LOAD_ERROR and
+ * ERROR_HANDLE are never handles so they can't be mistaken for replies. */
+#define FIRST_HANDLE        0x01
+#define LAST_HANDLE         0xFD
+
+/* Frame entry flags: how the position and angle of a sprite are encoded */
+#define FRAME_POS_ABS       0x01	/* x, y as 16-bit values */
+#define FRAME_POS_D8        0x02	/* dx, dy as signed bytes */
+#define FRAME_POS_D4        0x03	/* dx, dy as signed nibbles in one byte */
+#define FRAME_POS_MASK      0x03
+#define FRAME_ROT_ABS       0x04	/* angle as a 16-bit value */
+#define FRAME_ROT_D8        0x08	/* angle delta as a signed byte */
+#define FRAME_ROT_MASK      0x0C
+
+/* Slot flags */
+#define SLOT_SET_POS        0x01	/* position set during this frame */
+#define SLOT_SET_ROT        0x02	/* angle set during this frame */
+#define SLOT_KNOWN_POS      0x04	/* sentX and sentY are what the host has */
+#define SLOT_KNOWN_ROT      0x08	/* sentAngle is what the host has */
+
 #define BAUD_RATE			38400
 
+/* What the frame code knows about one sprite. Sprites that do not get a slot
+ * are updated with the single commands instead. */
+typedef struct {
+	xSpriteHandle handle;			/* ERROR_HANDLE when the slot is free */
+	uint8_t flags;					/* SLOT_ flags */
+	uint8_t wire;					/* FRAME_ flags of the entry being sent */
+	uint16_t x, y, angle;			/* values set during this frame */
+	uint16_t sentX, sentY, sentAngle;	/* values last sent to the host */
+} xFrameSlot;
+
+static xFrameSlot frameSlots[FRAME_SPRITES];
+static uint8_t frameOrder[FRAME_SPRITES];	/* slots to send, by handle */
+static uint8_t frameOpen;
+
+/* Frames are queued in chunks through this buffer */
+static uint8_t frameChunk[16];
+static uint8_t frameChunkLen;
+
+/* Frame pacing. The link drains linkRate bytes a second; vFrameEnd holds a
+ * frame back rather than wait for room behind earlier ones, and vFramePace
+ * starts the next frame once the queue has drained. */
+static uint16_t linkRate;
+static uint8_t frameDeferred;		/* frames held back in a row */
+static portTickType paceLast;		/* when the last frame began */
+static portTickType statsStart;		/* start of the counting window */
+static uint16_t statsTx;			/* USART_TxCount at statsStart */
+static uint16_t statsFrames;		/* frames sent since statsStart */
+static xFrameStats frameStats;
+
+/* What the local collision engine knows about one sprite. Sprites that do not
+ * get a body can only be tested with uCollide. */
+typedef struct {
+	xSpriteHandle handle;			/* ERROR_HANDLE when the body is free */
+	uint8_t groups;					/* bit n set for a member of collideGroups[n] */
+	uint8_t next;					/* next body in the same grid cell */
+	uint8_t radius;					/* bounding circle radius in pixels */
+	int16_t x, y;					/* center in window coordinates */
+} xCollideBody;
+
+static xCollideBody collideBodies[COLLIDE_BODIES];
+static xGroupHandle collideGroups[COLLIDE_GROUPS];	/* ERROR_HANDLE when free */
+static uint8_t collidePartial;		/* bit n set once collideGroups[n] has had a
+									   member without a body */
+static uint8_t collideBodiless;		/* live sprites without a body */
+
+/* Uniform grid over the window. Each cell heads a list of the bodies whose
+ * centers lie in it, chained through next and rebuilt whenever a body moved. */
+static uint8_t collideCells[COLLIDE_CELLS];
+static uint8_t collideCols, collideRows, collideShift;
+static uint8_t collideMaxRadius;		/* largest radius of a group member */
+static uint8_t collideMaxRadiusAll;		/* largest radius of any body */
+static uint8_t collideDirty;
+
+#define NO_BODY 0xFF
+
+/* Sprite and group handles in use, one bit per handle. Handles are given out
+ * round robin, so a handle just freed is not reused straight away while a load
+ * error for it may still be on its way. */
+static uint8_t handleMap[(LAST_HANDLE >> 3) + 1];
+static uint8_t handleNext;
+
+/* Load errors reported by the host, queued by the rx hook */
+static volatile xSpriteHandle loadErrors[LOAD_ERRORS];
+static volatile uint8_t loadErrorHead, loadErrorTail;
+static volatile uint8_t loadErrorPending;	/* LOAD_ERROR seen, handle next */
+
+/*******************************************************************************
+* Function: prvAllocHandle
+*
+* Description: Claims a free sprite or group handle.
+*
+* return: The handle, or ERROR_HANDLE if every handle is in use
+*******************************************************************************/
+static uint8_t prvAllocHandle(void) {
+	uint8_t handle = handleNext, i;
+
+	for (i = FIRST_HANDLE; i <= LAST_HANDLE; i++) {
+		if (handle < FIRST_HANDLE || handle > LAST_HANDLE)
+			handle = FIRST_HANDLE;
+		if (!(handleMap[handle >> 3] & (1 << (handle & 7)))) {
+			handleMap[handle >> 3] |= 1 << (handle & 7);
+			handleNext = handle + 1;
+			return handle;
+		}
+		handle++;
+	}
+
+	return ERROR_HANDLE;
+}
+
+static void prvFreeHandle(uint8_t handle) {
+	if (handle >= FIRST_HANDLE && handle <= LAST_HANDLE)
+		handleMap[handle >> 3] &= ~(1 << (handle & 7));
+}
+
+/*******************************************************************************
+* Function: prvRxHook
+*
+* Description: Takes load error reports out of the bytes received from the
+*  host, wherever they fall, leaving only replies for USART_Read. Runs in the
+*  receive interrupt.
+*
+* param data: The byte received
+* return: Nonzero if the byte was part of a load error report
+*******************************************************************************/
+static uint8_t prvRxHook(uint8_t data) {
+	uint8_t head;
+
+	if (loadErrorPending) {
+		loadErrorPending = 0;
+		head = (loadErrorHead + 1) % LOAD_ERRORS;
+		if (head != loadErrorTail) {
+			loadErrors[loadErrorHead] = data;
+			loadErrorHead = head;
+		}
+		return 1;
+	}
+
+	if (data == LOAD_ERROR) {
+		loadErrorPending = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+* Function: prvFindSlot
+*
+* Description: Looks up the frame slot of a sprite.
+*
+* param sprite: The handle to the sprite
+* param create: Nonzero to claim a free slot if the sprite has none
+* return: The slot, or NULL if the sprite has none and none could be claimed
+*******************************************************************************/
+static xFrameSlot *prvFindSlot(xSpriteHandle sprite, uint8_t create) {
+	xFrameSlot *slot, *freeSlot = NULL;
+
+	for (slot = frameSlots; slot < frameSlots + FRAME_SPRITES; slot++) {
+		if (slot->handle == sprite)
+			return slot;
+		if (slot->handle == ERROR_HANDLE && freeSlot == NULL)
+			freeSlot = slot;
+	}
+
+	if (create && freeSlot != NULL && sprite != ERROR_HANDLE) {
+		freeSlot->handle = sprite;
+		freeSlot->flags = 0;
+		return freeSlot;
+	}
+
+	return NULL;
+}
+
+static void prvFramePut(uint8_t byte) {
+	frameChunk[frameChunkLen++] = byte;
+	if (frameChunkLen == sizeof(frameChunk)) {
+		USART_WriteBuffer(frameChunk, frameChunkLen);
+		frameChunkLen = 0;
+	}
+}
+
+static void prvFramePut16(uint16_t value) {
+	prvFramePut(value >> 8);
+	prvFramePut(value & 0x00FF);
+}
+
+/*******************************************************************************
+* Function: prvEncodeSlot
+*
+* Description: Chooses the smallest encoding for the changes made to a sprite
+*  this frame, relative to the values the host already has.
+*
+* param slot: The slot of the sprite
+* return: The size of the frame entry in bytes, or 0 if nothing changed
+*******************************************************************************/
+static uint8_t prvEncodeSlot(xFrameSlot *slot) {
+	int16_t dx, dy, da;
+	uint8_t size = 1;
+
+	slot->wire = 0;
+
+	if (slot->flags & SLOT_SET_POS) {
+		dx = (int16_t)(slot->x - slot->sentX);
+		dy = (int16_t)(slot->y - slot->sentY);
+		if (!(slot->flags & SLOT_KNOWN_POS)) {
+			slot->wire |= FRAME_POS_ABS;
+			size += 4;
+		} else if (dx == 0 && dy == 0) {
+			/* unchanged */
+		} else if (dx >= -8 && dx <= 7 && dy >= -8 && dy <= 7) {
+			slot->wire |= FRAME_POS_D4;
+			size += 1;
+		} else if (dx >= -128 && dx <= 127 && dy >= -128 && dy <= 127) {
+			slot->wire |= FRAME_POS_D8;
+			size += 2;
+		} else {
+			slot->wire |= FRAME_POS_ABS;
+			size += 4;
+		}
+	}
+
+	if (slot->flags & SLOT_SET_ROT) {
+		da = (int16_t)(slot->angle - slot->sentAngle);
+		if (!(slot->flags & SLOT_KNOWN_ROT)) {
+			slot->wire |= FRAME_ROT_ABS;
+			size += 2;
+		} else if (da == 0) {
+			/* unchanged */
+		} else if (da >= -128 && da <= 127) {
+			slot->wire |= FRAME_ROT_D8;
+			size += 1;
+		} else {
+			slot->wire |= FRAME_ROT_ABS;
+			size += 2;
+		}
+	}
+
+	slot->flags &= ~(SLOT_SET_POS | SLOT_SET_ROT);
+
+	return slot->wire ? size : 0;
+}
+
 /*******************************************************************************
 * Function: vPrint
 *
@@ -31,10 +292,164 @@
 *******************************************************************************/
 void vPrint(const char *s) {
 	USART_Write(PYTHON_PRINT);
-	while (*s != '\0') {
-		USART_Write((uint8_t)*s++);
+	/* string is null-terminated */
+	USART_WriteBuffer((const uint8_t *)s, strlen(s) + 1);
+}
+
+/*******************************************************************************
+* Function: prvFindBody
+*
+* Description: Looks up the collision body of a sprite.
+*
+* param sprite: The handle to the sprite
+* return: The index of the body, or NO_BODY if the sprite has none
+*******************************************************************************/
+static uint8_t prvFindBody(xSpriteHandle sprite) {
+	uint8_t i;
+
+	if (sprite == ERROR_HANDLE)
+		return NO_BODY;
+
+	for (i = 0; i < COLLIDE_BODIES; i++)
+		if (collideBodies[i].handle == sprite)
+			return i;
+
+	return NO_BODY;
+}
+
+/*******************************************************************************
+* Function: prvRadius
+*
+* Description: Returns the radius of the circle that fills the longer side of
+*  a sprite of the given size. This fits round sprites such as asteroids at any
+*  rotation; uCollide is there for shapes it does not fit.
+*******************************************************************************/
+static uint8_t prvRadius(uint16_t width, uint16_t height) {
+	uint16_t r = ((width > height ? width : height) + 1) >> 1;
+
+	return r > 0xFF ? 0xFF : r;
+}
+
+/*******************************************************************************
+* Function: prvAddBody
+*
+* Description: Gives a new sprite a collision body, if one is free.
+*
+* param sprite: The handle to the sprite
+* param x: The x-position of the sprite's center
+* param y: The y-position of the sprite's center
+* param width: The width of the sprite
+* param height: The height of the sprite
+*******************************************************************************/
+static void prvAddBody(xSpriteHandle sprite, uint16_t x, uint16_t y,
+ uint16_t width, uint16_t height) {
+	xCollideBody *body;
+
+	for (body = collideBodies; body < collideBodies + COLLIDE_BODIES; body++) {
+		if (body->handle == ERROR_HANDLE) {
+			body->handle = sprite;
+			body->groups = 0;
+			body->x = x;
+			body->y = y;
+			body->radius = prvRadius(width, height);
+			collideDirty = 1;
+			return;
+		}
+	}
+
+	collideBodiless++;
+}
+
+/*******************************************************************************
+* Function: prvGroupBit
+*
+* Description: Maps a group handle to its membership bit in xCollideBody.groups.
+*
+* param group: The handle to the group
+* param create: Nonzero to claim a free bit if the group has none
+* return: The bit, or 0 if the group has none and none could be claimed
+*******************************************************************************/
+static uint8_t prvGroupBit(xGroupHandle group, uint8_t create) {
+	uint8_t i, freeBit = 0;
+
+	for (i = 0; i < COLLIDE_GROUPS; i++) {
+		if (collideGroups[i] == group)
+			return 1 << i;
+		if (collideGroups[i] == ERROR_HANDLE && freeBit == 0)
+			freeBit = 1 << i;
+	}
+
+	if (create && freeBit != 0 && group != ERROR_HANDLE) {
+		for (i = 0; (1 << i) != freeBit; i++)
+			;
+		collideGroups[i] = group;
+		collidePartial &= ~freeBit;
+	}
+
+	return create ? freeBit : 0;
+}
+
+/*******************************************************************************
+* Function: prvBuildGrid
+*
+* Description: Sorts every body into the grid cell holding its center. Bodies
+*  off the window are kept in the nearest edge cell.
+*******************************************************************************/
+static void prvBuildGrid(void) {
+	xCollideBody *body;
+	int16_t col, row;
+	uint8_t i, cell;
+
+	memset(collideCells, NO_BODY, sizeof(collideCells));
+	collideMaxRadius = 0;
+	collideMaxRadiusAll = 0;
+
+	for (i = 0; i < COLLIDE_BODIES; i++) {
+		body = &collideBodies[i];
+		if (body->handle == ERROR_HANDLE)
+			continue;
+
+		col = body->x < 0 ? 0 : body->x >> collideShift;
+		row = body->y < 0 ? 0 : body->y >> collideShift;
+		if (col >= collideCols)
+			col = collideCols - 1;
+		if (row >= collideRows)
+			row = collideRows - 1;
+
+		cell = row * collideCols + col;
+		body->next = collideCells[cell];
+		collideCells[cell] = i;
+
+		/* A backdrop that is in no group does not widen group searches */
+		if (body->groups && body->radius > collideMaxRadius)
+			collideMaxRadius = body->radius;
+		if (body->radius > collideMaxRadiusAll)
+			collideMaxRadiusAll = body->radius;
 	}
-	USART_Write(0x00);  /* string is null-terminated */
+
+	collideDirty = 0;
+}
+
+/*******************************************************************************
+* Function: prvCellRange
+*
+* Description: Finds the first and last grid cell along one axis that can hold
+*  the center of a body within reach of the given span.
+*
+* param lo: Low end of the span in pixels
+* param hi: High end of the span in pixels
+* param cells: The number of cells along the axis
+* param first: Receives the first cell
+* param last: Receives the last cell
+*******************************************************************************/
+static void prvCellRange(int16_t lo, int16_t hi, uint8_t cells,
+ uint8_t *first, uint8_t *last) {
+	*first = lo <= 0 ? 0 : lo >> collideShift;
+	*last = hi <= 0 ? 0 : hi >> collideShift;
+	if (*first >= cells)
+		*first = cells - 1;
+	if (*last >= cells)
+		*last = cells - 1;
 }
 
 /*******************************************************************************
@@ -47,8 +462,43 @@ void vPrint(const char *s) {
 * param height: Desired height of the window in pixels
 *******************************************************************************/
 void vWindowCreate(uint16_t width, uint16_t height) {
+	uint8_t i;
+
+	for (i = 0; i < FRAME_SPRITES; i++)
+		frameSlots[i].handle = ERROR_HANDLE;
+	frameOpen = 0;
+
+	for (i = 0; i < COLLIDE_BODIES; i++)
+		collideBodies[i].handle = ERROR_HANDLE;
+	for (i = 0; i < COLLIDE_GROUPS; i++)
+		collideGroups[i] = ERROR_HANDLE;
+	collidePartial = 0;
+	collideBodiless = 0;
+
+	/* Use the smallest cells that still cover the window with the grid */
+	for (collideShift = 5; ; collideShift++) {
+		collideCols = ((width - 1) >> collideShift) + 1;
+		collideRows = ((height - 1) >> collideShift) + 1;
+		if ((uint16_t)collideCols * collideRows <= COLLIDE_CELLS)
+			break;
+	}
+	collideDirty = 1;
+
+	memset(handleMap, 0, sizeof(handleMap));
+	handleNext = FIRST_HANDLE;
+	loadErrorHead = loadErrorTail = 0;
+	loadErrorPending = 0;
+
 	USART_Init(BAUD_RATE, configCPU_CLOCK_HZ);
 
+	/* 8N1 takes ten bit times a byte */
+	linkRate = USART_GetBaud(NULL) / 10;
+	frameDeferred = 0;
+	paceLast = statsStart = 0;
+	statsTx = USART_TxCount();
+	statsFrames = 0;
+	memset(&frameStats, 0, sizeof(frameStats));
+
 	USART_Read();
 	USART_Write_Unprotected(0xFF);
 	
@@ -57,6 +507,10 @@ void vWindowCreate(uint16_t width, uint16_t height) {
 	USART_Write_Unprotected(width & 0x00FF);
 	USART_Write_Unprotected(height >> 8);
 	USART_Write_Unprotected(height & 0x00FF);
+
+	/* Nothing else is read until the first reply, so collect load errors
+	 * in the background from now on */
+	USART_StartRx(prvRxHook);
 }
 
 /*******************************************************************************
@@ -65,40 +519,52 @@ void vWindowCreate(uint16_t width, uint16_t height) {
 * Description: Instantiates a sprite in the external graphics context using the
 *  contents of the given external file with the given position, angle, size, and
 *  depth in the window. The window origin is in the upper-left corner.
+*  The handle is chosen here and sent with the command, so this does not wait
+*  for the host. If the host cannot load the image it reports the handle
+*  later, see xSpriteGetLoadError; the handle stays valid until deleted.
 *
 * param filename: Null-terminated string containing the name of the sprite image
-*  file in the external graphics context.
+*  file in the external graphics context. Names longer than SPRITE_NAME_MAX
+*  characters are truncated.
 * param xPos: Initial x-position of the center of the sprite in window coords
 * param yPos: Initial y-position of the center of the sprite in window coords
 * param rAngle: Initial CCW rotation of the sprite about its center in degrees
 * param width: Initial, unrotated width of the sprite in pixels
 * param height: Initial, unrotated height of the sprite in pixels
 * param depth: Initial draw depth of the sprite (larger numbers are in front)
-* return: A valid handle to the new sprite on success; ERROR_HANDLE otherwise
+* return: A valid handle to the new sprite, or ERROR_HANDLE if every handle is
+*  in use
 *******************************************************************************/
 xSpriteHandle xSpriteCreate(const char *filename, uint16_t xPos, uint16_t yPos,
  uint16_t rAngle, uint16_t width, uint16_t height, uint8_t depth) {
-	
-	USART_Write(CREATE_SPRITE);
+	uint8_t cmd[SPRITE_NAME_MAX + 14];
+	uint8_t len = 0;
+	xSpriteHandle result = prvAllocHandle();
 
-	while (*filename != '\0') {
-		USART_Write((uint8_t)*filename++);
+	if (result == ERROR_HANDLE)
+		return ERROR_HANDLE;
+
+	cmd[len++] = CREATE_SPRITE;
+	cmd[len++] = result;
+	while (*filename != '\0' && len < SPRITE_NAME_MAX + 2) {
+		cmd[len++] = (uint8_t)*filename++;
 	}
-	USART_Write(0x00);  /* Filename is null-terminated */
-
-	USART_Write(xPos >> 8);
-	USART_Write(xPos & 0x00FF);
-	USART_Write(yPos >> 8);
-	USART_Write(yPos & 0x00FF);
-	USART_Write(rAngle >> 8);
-	USART_Write(rAngle & 0x00FF);
-	USART_Write(width >> 8);
-	USART_Write(width & 0x00FF);
-	USART_Write(height >> 8);
-	USART_Write(height & 0x00FF);
-	USART_Write(depth);
-	
-	xSpriteHandle result = (xSpriteHandle)USART_Read();
+	cmd[len++] = 0x00;  /* Filename is null-terminated */
+
+	cmd[len++] = xPos >> 8;
+	cmd[len++] = xPos & 0x00FF;
+	cmd[len++] = yPos >> 8;
+	cmd[len++] = yPos & 0x00FF;
+	cmd[len++] = rAngle >> 8;
+	cmd[len++] = rAngle & 0x00FF;
+	cmd[len++] = width >> 8;
+	cmd[len++] = width & 0x00FF;
+	cmd[len++] = height >> 8;
+	cmd[len++] = height & 0x00FF;
+	cmd[len++] = depth;
+	USART_WriteBuffer(cmd, len);
+
+	prvAddBody(result, xPos, yPos, width, height);
 	
 	return result;
 }
@@ -107,34 +573,66 @@ xSpriteHandle xSpriteCreate(const char *filename, uint16_t xPos, uint16_t yPos,
 * Function: vSpriteSetPosition
 *
 * Description: Sets the given sprite's position in the window. The window origin
-*  is in the upper-left corner.
+*  is in the upper-left corner. Between vFrameBegin and vFrameEnd the change is
+*  held back and sent with the rest of the frame.
 *
 * param sprite: The handle to the sprite
 * param x: New x-position of the sprite's center in window coordinates
 * param y: New y-position of the sprite's center in window coordinates
 *******************************************************************************/
 void vSpriteSetPosition(xSpriteHandle sprite, uint16_t x, uint16_t y) {
-	USART_Write(SET_POS);
-	USART_Write(sprite);
-	USART_Write(x >> 8);
-	USART_Write(x & 0x00FF);
-	USART_Write(y >> 8);
-	USART_Write(y & 0x00FF);
+	xFrameSlot *slot = prvFindSlot(sprite, frameOpen);
+	uint8_t body = prvFindBody(sprite);
+
+	if (body != NO_BODY) {
+		collideBodies[body].x = x;
+		collideBodies[body].y = y;
+		collideDirty = 1;
+	}
+
+	if (frameOpen && slot != NULL) {
+		slot->x = x;
+		slot->y = y;
+		slot->flags |= SLOT_SET_POS;
+		return;
+	}
+
+	uint8_t cmd[] = {SET_POS, sprite, x >> 8, x & 0x00FF, y >> 8, y & 0x00FF};
+	USART_WriteBuffer(cmd, sizeof(cmd));
+
+	/* This supersedes any value still held back by vFrameEnd */
+	if (slot != NULL) {
+		slot->sentX = x;
+		slot->sentY = y;
+		slot->flags = (slot->flags & ~SLOT_SET_POS) | SLOT_KNOWN_POS;
+	}
 }
 
 /*******************************************************************************
 * Function: vSpriteSetRotation
 *
-* Description: Sets the given sprite's rotation.
+* Description: Sets the given sprite's rotation. Between vFrameBegin and
+*  vFrameEnd the change is held back and sent with the rest of the frame.
 *
 * param sprite: The handle to the sprite
 * param angle: Angle in degrees to rotate the sprite CCW about its center
 *******************************************************************************/
 void vSpriteSetRotation(xSpriteHandle sprite, uint16_t angle) {
-	USART_Write(SET_ROT);
-	USART_Write(sprite);
-	USART_Write(angle >> 8);
-	USART_Write(angle & 0x00FF);
+	xFrameSlot *slot = prvFindSlot(sprite, frameOpen);
+
+	if (frameOpen && slot != NULL) {
+		slot->angle = angle;
+		slot->flags |= SLOT_SET_ROT;
+		return;
+	}
+
+	uint8_t cmd[] = {SET_ROT, sprite, angle >> 8, angle & 0x00FF};
+	USART_WriteBuffer(cmd, sizeof(cmd));
+
+	if (slot != NULL) {
+		slot->sentAngle = angle;
+		slot->flags = (slot->flags & ~SLOT_SET_ROT) | SLOT_KNOWN_ROT;
+	}
 }
 
 /*******************************************************************************
@@ -147,12 +645,15 @@ void vSpriteSetRotation(xSpriteHandle sprite, uint16_t angle) {
 * param height: New height of the sprite in pixels before applying rotation
 *******************************************************************************/
 void vSpriteSetSize(xSpriteHandle sprite, uint16_t width, uint16_t height) {
-	USART_Write(SET_SIZE);
-	USART_Write(sprite);
-	USART_Write(width >> 8);
-	USART_Write(width & 0x00FF);
-	USART_Write(height >> 8);
-	USART_Write(height & 0x00FF);
+	uint8_t body = prvFindBody(sprite);
+
+	if (body != NO_BODY) {
+		collideBodies[body].radius = prvRadius(width, height);
+		collideDirty = 1;
+	}
+
+	uint8_t cmd[] = {SET_SIZE, sprite, width >> 8, width & 0x00FF, height >> 8, height & 0x00FF};
+	USART_WriteBuffer(cmd, sizeof(cmd));
 }
 
 /*******************************************************************************
@@ -164,9 +665,8 @@ void vSpriteSetSize(xSpriteHandle sprite, uint16_t width, uint16_t height) {
 * param depth: New draw depth (larger depths are in front of smaller depths)
 *******************************************************************************/
 void vSpriteSetDepth(xSpriteHandle sprite, uint8_t depth) {
-	USART_Write(SET_ORDER);
-	USART_Write(sprite);
-	USART_Write(depth);
+	uint8_t cmd[] = {SET_ORDER, sprite, depth};
+	USART_WriteBuffer(cmd, sizeof(cmd));
 }
 
 /*******************************************************************************
@@ -178,21 +678,253 @@ void vSpriteSetDepth(xSpriteHandle sprite, uint8_t depth) {
 * param sprite: The handle to the sprite to be deleted
 *******************************************************************************/
 void vSpriteDelete(xSpriteHandle sprite) {
-	USART_Write(DELETE_SPRITE);
-	USART_Write(sprite);
+	xFrameSlot *slot = prvFindSlot(sprite, 0);
+
+	uint8_t body = prvFindBody(sprite);
+
+	/* Forget the sprite, so a new sprite given the same handle starts over */
+	if (slot != NULL)
+		slot->handle = ERROR_HANDLE;
+	if (body != NO_BODY) {
+		collideBodies[body].handle = ERROR_HANDLE;
+		collideDirty = 1;
+	} else if (sprite != ERROR_HANDLE && collideBodiless > 0) {
+		collideBodiless--;
+	}
+
+	uint8_t cmd[] = {DELETE_SPRITE, sprite};
+	USART_WriteBuffer(cmd, sizeof(cmd));
+
+	prvFreeHandle(sprite);
+}
+
+/*******************************************************************************
+* Function: xSpriteGetLoadError
+*
+* Description: Returns the next sprite the host reported it could not load an
+*  image for. Such a sprite is never drawn and never collides on the host, but
+*  its handle stays in use until it is deleted. Reports are only collected
+*  once the window exists, and are dropped if LOAD_ERRORS are left unread.
+*
+* return: The handle of the sprite, or ERROR_HANDLE if there are no more
+*******************************************************************************/
+xSpriteHandle xSpriteGetLoadError(void) {
+	xSpriteHandle sprite;
+
+	if (loadErrorTail == loadErrorHead)
+		return ERROR_HANDLE;
+
+	sprite = loadErrors[loadErrorTail];
+	loadErrorTail = (loadErrorTail + 1) % LOAD_ERRORS;
+
+	return sprite;
+}
+
+/*******************************************************************************
+* Function: vFrameBegin
+*
+* Description: Starts a frame. Until vFrameEnd, sprite position and rotation
+*  changes are only recorded; other calls are sent immediately as usual.
+*******************************************************************************/
+void vFrameBegin(void) {
+	frameOpen = 1;
+}
+
+/*******************************************************************************
+* Function: vFrameEnd
+*
+* Description: Sends every position and rotation change recorded since
+*  vFrameBegin as one FRAME command, which the host applies in one step.
+*  Sprites whose values did not change are left out, and the rest are sent as
+*  small deltas from the values the host already has wherever possible.
+*
+*  FRAME, length (16 bits, of what follows), base handle, mask length, mask,
+*  then one entry per set mask bit. Bit b of mask byte n stands for sprite
+*  base + 8n + b. An entry is a flags byte (FRAME_POS_*, FRAME_ROT_*)
+*  followed by the position and then the angle, in the encodings it names.
+*
+*  If the transmit queue has no room for the frame, the link is still busy
+*  with earlier ones. The frame is then held back, up to FRAME_MAX_DEFER times
+*  in a row, and its changes are merged into the next one, so only the latest
+*  value of each sprite is sent instead of a backlog of stale ones.
+*******************************************************************************/
+void vFrameEnd(void) {
+	xFrameSlot *slot;
+	uint8_t count = 0, i, j, size, maskLen, maskByte, base;
+	uint16_t len = 2;
+	int8_t dx, dy;
+
+	frameOpen = 0;
+
+	/* Collect the changed sprites, sorted by handle */
+	for (i = 0; i < FRAME_SPRITES; i++) {
+		slot = &frameSlots[i];
+		if (slot->handle == ERROR_HANDLE || (size = prvEncodeSlot(slot)) == 0)
+			continue;
+		len += size;
+		for (j = count; j > 0 &&
+		 frameSlots[frameOrder[j - 1]].handle > slot->handle; j--)
+			frameOrder[j] = frameOrder[j - 1];
+		frameOrder[j] = i;
+		count++;
+	}
+
+	if (count != 0) {
+		base = frameSlots[frameOrder[0]].handle;
+		maskLen = (frameSlots[frameOrder[count - 1]].handle - base) / 8 + 1;
+		len += maskLen;
+
+		/* A frame too big for the whole queue has to be sent in pieces */
+		if (len + 3 > USART_TxFree() && len + 3 <= USART_TX_MAX &&
+		 frameDeferred < FRAME_MAX_DEFER) {
+			for (i = 0; i < count; i++) {
+				slot = &frameSlots[frameOrder[i]];
+				if (slot->wire & FRAME_POS_MASK)
+					slot->flags |= SLOT_SET_POS;
+				if (slot->wire & FRAME_ROT_MASK)
+					slot->flags |= SLOT_SET_ROT;
+			}
+			frameDeferred++;
+			frameStats.deferred++;
+			return;
+		}
+	}
+
+	frameDeferred = 0;
+	statsFrames++;
+
+	if (count == 0)
+		return;
+
+	frameChunkLen = 0;
+	prvFramePut(FRAME);
+	prvFramePut16(len);
+	prvFramePut(base);
+	prvFramePut(maskLen);
+
+	for (i = 0, j = 0; i < maskLen; i++) {
+		maskByte = 0;
+		while (j < count && frameSlots[frameOrder[j]].handle - base < 8 * (i + 1))
+			maskByte |= 1 << ((frameSlots[frameOrder[j++]].handle - base) & 7);
+		prvFramePut(maskByte);
+	}
+
+	for (i = 0; i < count; i++) {
+		slot = &frameSlots[frameOrder[i]];
+		prvFramePut(slot->wire);
+
+		dx = slot->x - slot->sentX;
+		dy = slot->y - slot->sentY;
+		switch (slot->wire & FRAME_POS_MASK) {
+			case FRAME_POS_ABS:
+				prvFramePut16(slot->x);
+				prvFramePut16(slot->y);
+				break;
+			case FRAME_POS_D8:
+				prvFramePut(dx);
+				prvFramePut(dy);
+				break;
+			case FRAME_POS_D4:
+				prvFramePut(((uint8_t)dx << 4) | (dy & 0x0F));
+				break;
+		}
+		if (slot->wire & FRAME_POS_MASK) {
+			slot->sentX = slot->x;
+			slot->sentY = slot->y;
+			slot->flags |= SLOT_KNOWN_POS;
+		}
+
+		switch (slot->wire & FRAME_ROT_MASK) {
+			case FRAME_ROT_ABS:
+				prvFramePut16(slot->angle);
+				break;
+			case FRAME_ROT_D8:
+				prvFramePut(slot->angle - slot->sentAngle);
+				break;
+		}
+		if (slot->wire & FRAME_ROT_MASK) {
+			slot->sentAngle = slot->angle;
+			slot->flags |= SLOT_KNOWN_ROT;
+		}
+	}
+
+	if (frameChunkLen)
+		USART_WriteBuffer(frameChunk, frameChunkLen);
+}
+
+/*******************************************************************************
+* Function: vFramePace
+*
+* Description: Blocks the calling task until the next frame should begin: at
+*  least period ticks after the last one began, and not before the commands
+*  already queued have gone out on the link. Drawing then always starts from
+*  the latest state, and the queue holds about a frame, however many sprites
+*  there are. Also updates the counters read by vFrameGetStats. Call once per
+*  frame, without holding anything other tasks need to draw.
+*
+* param period: Shortest time between frames in ticks
+*******************************************************************************/
+void vFramePace(portTickType period) {
+	portTickType now = xTaskGetTickCount(), elapsed, wait = 0, drain;
+	uint16_t tx;
+	uint32_t fps, load;
+
+	elapsed = now - paceLast;
+	if (elapsed < period)
+		wait = period - elapsed;
+
+	drain = (uint32_t)(USART_TX_MAX - USART_TxFree()) * configTICK_RATE_HZ /
+	 linkRate;
+	if (drain > wait)
+		wait = drain;
+
+	if (wait)
+		vTaskDelay(wait);
+	paceLast = now = xTaskGetTickCount();
+
+	elapsed = now - statsStart;
+	if (elapsed >= configTICK_RATE_HZ) {
+		tx = USART_TxCount();
+		fps = (uint32_t)statsFrames * configTICK_RATE_HZ / elapsed;
+		frameStats.fps = fps > 0xFF ? 0xFF : fps;
+		load = (uint32_t)(uint16_t)(tx - statsTx) * 100 * configTICK_RATE_HZ /
+		 ((uint32_t)linkRate * elapsed);
+		frameStats.linkLoad = load > 0xFF ? 0xFF : load;
+
+		statsStart = now;
+		statsTx = tx;
+		statsFrames = 0;
+	}
+}
+
+/*******************************************************************************
+* Function: vFrameGetStats
+*
+* Description: Reports how the link is keeping up. The frame rate and link load
+*  cover the window vFramePace last closed, about a second long.
+*
+* param stats: Receives the counters
+*******************************************************************************/
+void vFrameGetStats(xFrameStats *stats) {
+	*stats = frameStats;
 }
 
 /*******************************************************************************
 * Function: xGroupCreate
 *
 * Description: Instantiates an empty sprite group. Sprite groups are useful for
-*  collision tests (see bCollide).
+*  collision tests (see uCollide and uCollideLocal).
 *
-* return: A valid handle to the new group on success; ERROR_HANDLE otherwise
+* return: A valid handle to the new group, or ERROR_HANDLE if every handle is
+*  in use
 *******************************************************************************/
 xGroupHandle xGroupCreate(void) {
-	USART_Write(CREATE_GROUP);
-	xGroupHandle result = (xGroupHandle)USART_Read();
+	xGroupHandle result = prvAllocHandle();
+
+	if (result != ERROR_HANDLE) {
+		uint8_t cmd[] = {CREATE_GROUP, result};
+		USART_WriteBuffer(cmd, sizeof(cmd));
+	}
 	
 	return result;
 }
@@ -206,9 +938,18 @@ xGroupHandle xGroupCreate(void) {
 * param sprite: The handle to the sprite to add to the group
 *******************************************************************************/
 void vGroupAddSprite(xGroupHandle group, xSpriteHandle sprite) {
-	USART_Write(ADD_TO_GROUP);
-	USART_Write(group);
-	USART_Write(sprite);
+	uint8_t body = prvFindBody(sprite);
+	uint8_t bit = prvGroupBit(group, 1);
+
+	/* A member the local engine cannot see sends the group's collision tests
+	 * back to the host */
+	if (body != NO_BODY)
+		collideBodies[body].groups |= bit;
+	else if (sprite != ERROR_HANDLE)
+		collidePartial |= bit;
+
+	uint8_t cmd[] = {ADD_TO_GROUP, group, sprite};
+	USART_WriteBuffer(cmd, sizeof(cmd));
 }
 
 /*******************************************************************************
@@ -220,9 +961,13 @@ void vGroupAddSprite(xGroupHandle group, xSpriteHandle sprite) {
 * param sprite: The handle to the sprite to remove from the group
 *******************************************************************************/
 void vGroupRemoveSprite(xGroupHandle group, xSpriteHandle sprite) {
-	USART_Write(REMOVE_FROM_GROUP);
-	USART_Write(group);
-	USART_Write(sprite);
+	uint8_t body = prvFindBody(sprite);
+
+	if (body != NO_BODY)
+		collideBodies[body].groups &= ~prvGroupBit(group, 0);
+
+	uint8_t cmd[] = {REMOVE_FROM_GROUP, group, sprite};
+	USART_WriteBuffer(cmd, sizeof(cmd));
 }
 
 /*******************************************************************************
@@ -234,8 +979,21 @@ void vGroupRemoveSprite(xGroupHandle group, xSpriteHandle sprite) {
 * param group: The handle to the group to be deleted
 *******************************************************************************/
 void vGroupDelete(xGroupHandle group) {
-	USART_Write(DELETE_GROUP);
-	USART_Write(group);
+	uint8_t bit = prvGroupBit(group, 0), i;
+
+	if (bit != 0) {
+		for (i = 0; i < COLLIDE_BODIES; i++)
+			collideBodies[i].groups &= ~bit;
+		for (i = 0; (1 << i) != bit; i++)
+			;
+		collideGroups[i] = ERROR_HANDLE;
+		collidePartial &= ~bit;
+	}
+
+	uint8_t cmd[] = {DELETE_GROUP, group};
+	USART_WriteBuffer(cmd, sizeof(cmd));
+
+	prvFreeHandle(group);
 }
 
 /*******************************************************************************
@@ -257,9 +1015,8 @@ uint8_t uCollide(xSpriteHandle sprite, xGroupHandle group,
  xSpriteHandle hits[], uint8_t hitsSize) {
 	uint8_t hitCount = 0;
 	
-	USART_Write(COLLIDE);
-	USART_Write(sprite);
-	USART_Write(group);
+	uint8_t cmd[] = {COLLIDE, sprite, group};
+	USART_WriteBuffer(cmd, sizeof(cmd));
 	
 	while (hitCount < hitsSize) {
 		hits[hitCount] = USART_Read();
@@ -273,4 +1030,72 @@ uint8_t uCollide(xSpriteHandle sprite, xGroupHandle group,
 	    hitCount++;
 		
 	return hitCount;
-}	
+}
+
+/*******************************************************************************
+* Function: uCollideLocal
+*
+* Description: Tests if the given sprite's bounding circle overlaps those of any
+*  members of the given group, without asking the host. Only the grid cells
+*  within reach of the sprite are searched. Falls back to uCollide when the
+*  sprite or group is not known locally, or when the group has had a member
+*  (any sprite, for ALL_GROUP) that got no body, because the body or group
+*  tables were full when it was created.
+*
+* param sprite: The handle to the sprite to test for collisions
+* param group: The handle to the group of sprites to test for collisions
+*  against sprite, or ALL_GROUP for every sprite
+* param hits: An array in which to store the sprite handles from group that
+*  sprite collided with
+* param hitsSize: The size of the hits array
+* return: The number of hits, as with uCollide; only the first hitsSize are
+*  stored
+*******************************************************************************/
+uint8_t uCollideLocal(xSpriteHandle sprite, xGroupHandle group,
+ xSpriteHandle hits[], uint8_t hitsSize) {
+	xCollideBody *self, *other;
+	uint8_t index, bit, col, row, firstCol, lastCol, firstRow, lastRow;
+	uint8_t hitCount = 0;
+	int16_t dx, dy, sum, reach;
+
+	index = prvFindBody(sprite);
+	bit = group == ALL_GROUP ? 0xFF : prvGroupBit(group, 0);
+	if (index == NO_BODY || bit == 0 ||
+	 (group == ALL_GROUP ? collideBodiless != 0 : (collidePartial & bit)))
+		return uCollide(sprite, group, hits, hitsSize);
+
+	if (collideDirty)
+		prvBuildGrid();
+
+	self = &collideBodies[index];
+	reach = self->radius +
+	 (group == ALL_GROUP ? collideMaxRadiusAll : collideMaxRadius);
+	prvCellRange(self->x - reach, self->x + reach, collideCols,
+	 &firstCol, &lastCol);
+	prvCellRange(self->y - reach, self->y + reach, collideRows,
+	 &firstRow, &lastRow);
+
+	for (row = firstRow; row <= lastRow; row++) {
+		for (col = firstCol; col <= lastCol; col++) {
+			index = collideCells[row * collideCols + col];
+			for (; index != NO_BODY; index = other->next) {
+				other = &collideBodies[index];
+				if (other == self ||
+				 (group != ALL_GROUP && !(other->groups & bit)))
+					continue;
+
+				dx = other->x - self->x;
+				dy = other->y - self->y;
+				sum = other->radius + self->radius;
+				if ((int32_t)dx * dx + (int32_t)dy * dy > (int32_t)sum * sum)
+					continue;
+
+				if (hitCount < hitsSize)
+					hits[hitCount] = other->handle;
+				hitCount++;
+			}
+		}
+	}
+
+	return hitCount;
+}
@@ -6,6 +6,34 @@
 #define ERROR_HANDLE 0xFF
 #define ALL_GROUP 0x00
 
+/* Longest sprite file name sent by xSpriteCreate */
+#define SPRITE_NAME_MAX 32
+
+/* Sprites whose updates can be batched by vFrameEnd; any others are sent
+ * one command at a time even inside a frame */
+#define FRAME_SPRITES 32
+
+/* Sprites and groups known to uCollideLocal, and the most grid cells it may
+ * divide the window into. Asteroids has up to 48 asteroids, 16 bullets, the
+ * ship, the background and a win or lose banner at once. */
+#define COLLIDE_BODIES 72
+#define COLLIDE_GROUPS 8
+#define COLLIDE_CELLS 64
+
+/* Image load failures held for xSpriteGetLoadError */
+#define LOAD_ERRORS 8
+
+/* Frames in a row vFrameEnd may hold back while the link is busy, before it
+ * sends one anyway */
+#define FRAME_MAX_DEFER 4
+
+/* Frame pacing counters, see vFrameGetStats */
+typedef struct {
+	uint8_t fps;			/* frames sent over the last second or so */
+	uint8_t linkLoad;		/* percent of the link's capacity queued then */
+	uint16_t deferred;		/* frames merged into a later one, in total */
+} xFrameStats;
+
 typedef uint8_t xSpriteHandle;
 typedef uint8_t xGroupHandle;
 
@@ -19,6 +47,12 @@ void vSpriteSetRotation(xSpriteHandle sprite, uint16_t angle);
 void vSpriteSetSize(xSpriteHandle sprite, uint16_t width, uint16_t height);
 void vSpriteSetDepth(xSpriteHandle sprite, uint8_t depth);
 void vSpriteDelete(xSpriteHandle sprite);
+xSpriteHandle xSpriteGetLoadError(void);
+
+void vFrameBegin(void);
+void vFrameEnd(void);
+void vFramePace(portTickType period);
+void vFrameGetStats(xFrameStats *stats);
 
 xGroupHandle xGroupCreate(void);
 void vGroupAddSprite(xGroupHandle group, xSpriteHandle sprite);
@@ -27,5 +61,7 @@ void vGroupDelete(xGroupHandle group);
 
 uint8_t uCollide(xSpriteHandle sprite, xGroupHandle group,
  xSpriteHandle hits[], uint8_t hitsSize);
+uint8_t uCollideLocal(xSpriteHandle sprite, xGroupHandle group,
+ xSpriteHandle hits[], uint8_t hitsSize);
 
 #endif /* GRAPHICS_H_ */
\ No newline at end of file
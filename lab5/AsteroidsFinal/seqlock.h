@@ -0,0 +1,88 @@
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include "FreeRTOS.h"
+
+/* A sequence lock over a pair of buffers, for one writer task publishing
+ * whole frames of state to readers that must never block it.
+ *
+ * The sequence is odd while the writer fills a buffer and even once it is
+ * published. Frame k is written into buffer k & 1, so the writer only ever
+ * touches the buffer readers are not being pointed at. A reader copies what it
+ * needs out of the latest complete buffer, then retries only if the writer has
+ * since started on that same buffer again, which takes two more frames. The
+ * sequence is 8 bits so that it is read in one instruction on the AVR. */
+typedef struct {
+	volatile uint8_t seq;
+} xSeqLock;
+
+#define seqMEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#define vSeqLockInit(lock) ((lock)->seq = 0)
+
+/*******************************************************************************
+* Function: uSeqWriteBegin
+*
+* Description: Starts the next frame. Only one task may write.
+*
+* param lock: The lock
+* return: The index of the buffer to fill, 0 or 1
+*******************************************************************************/
+static inline uint8_t uSeqWriteBegin(xSeqLock *lock) {
+	uint8_t seq = lock->seq + 1;
+
+	lock->seq = seq;
+	seqMEMORY_BARRIER();
+
+	return ((seq + 1) >> 1) & 1;
+}
+
+/*******************************************************************************
+* Function: vSeqWriteEnd
+*
+* Description: Publishes the frame started by uSeqWriteBegin.
+*
+* param lock: The lock
+*******************************************************************************/
+static inline void vSeqWriteEnd(xSeqLock *lock) {
+	seqMEMORY_BARRIER();
+	lock->seq++;
+}
+
+/*******************************************************************************
+* Function: uSeqReadBegin
+*
+* Description: Starts reading the latest complete frame. Never blocks.
+*
+* param lock: The lock
+* return: The sequence to pass to uSeqReadIndex and xSeqReadRetry
+*******************************************************************************/
+static inline uint8_t uSeqReadBegin(const xSeqLock *lock) {
+	uint8_t seq = lock->seq;
+
+	seqMEMORY_BARRIER();
+
+	return seq & ~1;
+}
+
+/* The buffer holding the frame a reader started on */
+#define uSeqReadIndex(seq) (((seq) >> 1) & 1)
+
+/*******************************************************************************
+* Function: xSeqReadRetry
+*
+* Description: Checks that the frame read since uSeqReadBegin was not touched
+*  by the writer while it was being read.
+*
+* param lock: The lock
+* param seq: The value returned by uSeqReadBegin
+* return: pdTRUE if the copy may be torn and must be read again
+*******************************************************************************/
+static inline portBASE_TYPE xSeqReadRetry(const xSeqLock *lock, uint8_t seq) {
+	seqMEMORY_BARRIER();
+
+	/* The writer reopens this buffer at seq + 3 */
+	return (uint8_t)(lock->seq - seq) > 2 ? pdTRUE : pdFALSE;
+}
+
+#endif /* SEQLOCK_H_ */
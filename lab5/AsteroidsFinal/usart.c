@@ -11,45 +11,287 @@
 ***************************/
 
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 #include "usart.h"
 
+#if (USART_TXBUFF_SZ & (USART_TXBUFF_SZ - 1)) || USART_TXBUFF_SZ > 256
+#error USART_TXBUFF_SZ must be a power of two no larger than 256
+#endif
+
+#if (USART_RXBUFF_SZ & (USART_RXBUFF_SZ - 1)) || USART_RXBUFF_SZ > 256
+#error USART_RXBUFF_SZ must be a power of two no larger than 256
+#endif
+
+#define TXMASK (USART_TXBUFF_SZ - 1)
+#define RXMASK (USART_RXBUFF_SZ - 1)
+
+/* Transmit queue. The writing tasks fill it and the UDRE interrupt drains it
+ * onto the line, so a command costs the caller a copy instead of ~260us per
+ * byte at 38400 baud. */
+static uint8_t txBuff[USART_TXBUFF_SZ];
+static volatile uint8_t txHead; /* Written by the writing task */
+static volatile uint8_t txTail; /* Written by the udre isr */
+static uint16_t txCount;        /* Bytes ever queued, wrapping */
+
+/* A task short of room sets txWantRoom to the free space it needs and blocks on
+ * txRoomSem. The udre isr gives the semaphore once that much is free. */
+static volatile uint8_t txWantRoom;
+static xSemaphoreHandle txRoomSem;
+
+static uint8_t txFree(void) {
+	return (txTail - txHead - 1) & TXMASK;
+}
+
+/* Receive queue, filled by the rx isr once USART_StartRx has been called.
+ * Until then USART_Read polls the receiver. */
+static uint8_t rxBuff[USART_RXBUFF_SZ];
+static volatile uint8_t rxHead; /* Written by the rx isr */
+static volatile uint8_t rxTail; /* Written by USART_Read */
+static USART_RxHook rxHook;
+
+/************************************
+* Procedure: USART0_RX_vect
+*
+* Description: Offers the received byte to the hook,
+*  and queues it for USART_Read if the hook does not
+*  want it. The byte is dropped if the queue is full.
+************************************/
+ISR(USART0_RX_vect) {
+	uint8_t data = UDR0;
+	uint8_t head;
+
+	if (rxHook != NULL && rxHook(data))
+		return;
+
+	head = (rxHead + 1) & RXMASK;
+	if (head != rxTail) {
+		rxBuff[rxHead] = data;
+		rxHead = head;
+	}
+}
+
+/************************************
+* Procedure: USART0_UDRE_vect
+*
+* Description: Sends the next queued byte, or turns
+*  itself off once the queue is empty.
+************************************/
+ISR(USART0_UDRE_vect) {
+	signed portBASE_TYPE woken = pdFALSE;
+
+	if (txTail != txHead) {
+		UDR0 = txBuff[txTail];
+		txTail = (txTail + 1) & TXMASK;
+	} else {
+		UCSR0B &= ~(1<<UDRIE0);
+	}
+
+	if (txWantRoom && txFree() >= txWantRoom) {
+		txWantRoom = 0;
+		xSemaphoreGiveFromISR(txRoomSem, &woken);
+	}
+
+	if (woken != pdFALSE)
+		taskYIELD();
+}
+
+/* Blocks the calling task until at least room bytes of the queue are free. */
+static void waitForRoom(uint8_t room) {
+	portENTER_CRITICAL();
+	if (txFree() >= room) {
+		portEXIT_CRITICAL();
+		return;
+	}
+	txWantRoom = room;
+	portEXIT_CRITICAL();
+
+	xSemaphoreTake(txRoomSem, portMAX_DELAY);
+}
+
+/* Rate and error achieved by the last USART_Init */
+static uint32_t baudActual;
+static int16_t baudError;
+
 /************************************
 * Procedure: usart_init
 *  
 * Description: Initializes the USART module with 
-*  the specified baud rate and clk speed.
+*  the specified baud rate and clk speed. The divisor
+*  is rounded, and double speed (U2X) is used when it
+*  gets closer to the requested rate; normal speed
+*  wins ties since it samples each bit more often.
 *
 * Param buadin: The desired Baud rate.
 * Param clk_seedin: The clk speed of the ATmega328p
 ************************************/
-void USART_Init(uint16_t baudin, uint32_t clk_speedin) {
-    uint32_t ubrr = clk_speedin/(16UL)/baudin-1;
-    UBRR0H = (unsigned char)(ubrr>>8) ;// & 0x7F;
-    UBRR0L = (unsigned char)ubrr;
+void USART_Init(uint32_t baudin, uint32_t clk_speedin) {
+    uint32_t div, ubrr, rate, diff, bestDiff = 0xFFFFFFFFUL;
+    uint16_t bestUbrr = 0;
+    uint8_t x2, bestX2 = 0;
+
+    for (x2 = 0; x2 <= 1; x2++) {
+        div = (x2 ? 8UL : 16UL) * baudin;
+        ubrr = (clk_speedin + div / 2) / div;
+        ubrr = ubrr ? ubrr - 1 : 0;
+        if (ubrr > 4095)
+            ubrr = 4095;
+
+        rate = clk_speedin / ((x2 ? 8UL : 16UL) * (ubrr + 1));
+        diff = rate > baudin ? rate - baudin : baudin - rate;
+        if (diff < bestDiff) {
+            bestDiff = diff;
+            bestUbrr = ubrr;
+            bestX2 = x2;
+            baudActual = rate;
+        }
+    }
+
+    /* Error in hundredths of a percent, kept to 32 bit arithmetic. bestDiff
+     * times 10000 fits for any rate the USART can run at. */
+    diff = bestDiff <= 0xFFFFFFFFUL / 10000 ? bestDiff * 10000 / baudin : 0x7FFF;
+    if (diff > 0x7FFF)
+        diff = 0x7FFF;
+    baudError = baudActual < baudin ? -(int16_t)diff : (int16_t)diff;
+
+    UBRR0H = (unsigned char)(bestUbrr>>8) ;// & 0x7F;
+    UBRR0L = (unsigned char)bestUbrr;
     /* Enable receiver and transmitter */
     UCSR0B = (1<<RXEN0)|(1<<TXEN0);
     /* Set frame format: 8data, 1stop bit */
     UCSR0C = (1<<UCSZ01)|(1<<UCSZ00);
-    // clear U2X0 for Synchronous operation
-    UCSR0A &= ~(1<<U2X0);
+    // U2X0 as chosen above
+    if (bestX2)
+        UCSR0A |= (1<<U2X0);
+    else
+        UCSR0A &= ~(1<<U2X0);
+
+    txHead = txTail = 0;
+    txWantRoom = 0;
+    if (txRoomSem == NULL) {
+        vSemaphoreCreateBinary(txRoomSem);
+        xSemaphoreTake(txRoomSem, 0); /* created given, start it empty */
+    }
+}
+
+/************************************
+* Procedure: USART_GetBaud
+*
+* Description: Reports the rate the USART actually
+*  runs at after USART_Init.
+*
+* Param error: If not NULL, receives the error from
+*  the requested rate in hundredths of a percent.
+* Return: The achieved baud rate.
+************************************/
+uint32_t USART_GetBaud(int16_t *error) {
+	if (error)
+		*error = baudError;
+	return baudActual;
 }
 
-/*the send function will put 8bits on the trans line. */
+/*the send function queues 8bits for the trans line, waiting
+only if the transmit queue is full. */
 void USART_Write(uint8_t data) {
-		/* Wait for empty transmit buffer */
-		while ( !( UCSR0A & (1<<UDRE0)) )
-		;
-		/* Put data into buffer, sends the data */
-		UDR0 = data;
+	USART_WriteBuffer(&data, 1);
 }
 
-/*the send function will put 8bits on the trans line. */
+/************************************
+* Procedure: USART_Enqueue
+*
+* Description: Queues len bytes for transmission
+*  without blocking. The bytes are queued all together
+*  or not at all, so a command is never split or
+*  interleaved with another task's.
+*
+* Param data: The bytes to send.
+* Param len: Number of bytes, at most USART_TX_MAX.
+* Return: 1 if the bytes were queued, 0 if there was
+*  not enough room.
+************************************/
+uint8_t USART_Enqueue(const uint8_t *data, uint8_t len) {
+	uint8_t head;
+
+	portENTER_CRITICAL();
+	if (txFree() < len) {
+		portEXIT_CRITICAL();
+		return 0;
+	}
+
+	txCount += len;
+	head = txHead;
+	while (len--) {
+		txBuff[head] = *data++;
+		head = (head + 1) & TXMASK;
+	}
+	txHead = head;
+
+	/* (Re)start the udre interrupt to drain the queue */
+	UCSR0B |= (1<<UDRIE0);
+	portEXIT_CRITICAL();
+
+	return 1;
+}
+
+/************************************
+* Procedure: USART_WriteBuffer
+*
+* Description: Queues len bytes for transmission,
+*  blocking the calling task only while the queue is
+*  too full. Writes of up to USART_TX_MAX bytes are
+*  queued in one piece. Must be called from a task.
+*
+* Param data: The bytes to send.
+* Param len: Number of bytes to send.
+************************************/
+void USART_WriteBuffer(const uint8_t *data, uint16_t len) {
+	uint8_t chunk;
+
+	while (len) {
+		chunk = len > USART_TX_MAX ? USART_TX_MAX : len;
+		while (!USART_Enqueue(data, chunk))
+			waitForRoom(chunk);
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+/* Number of bytes that can be queued without blocking. */
+uint8_t USART_TxFree(void) {
+	return txFree();
+}
+
+/* Number of bytes ever queued, wrapping at 16 bits. The difference between two
+ * readings is the traffic queued in between. */
+uint16_t USART_TxCount(void) {
+	uint16_t count;
+
+	portENTER_CRITICAL();
+	count = txCount;
+	portEXIT_CRITICAL();
+
+	return count;
+}
+
+/************************************
+* Procedure: USART_Flush
+*
+* Description: Blocks the calling task until every
+*  queued byte has been handed to the USART.
+************************************/
+void USART_Flush(void) {
+	waitForRoom(USART_TX_MAX);
+}
+
+/*the send function will put 8bits on the trans line. It
+bypasses the transmit queue, so it may only be used before
+any task has queued data, e.g. before the scheduler starts. */
 void USART_Write_Unprotected(uint8_t data) {
 	/* Wait for empty transmit buffer */
 	while ( !( UCSR0A & (1<<UDRE0)) )
@@ -58,6 +300,24 @@ void USART_Write_Unprotected(uint8_t data) {
 	UDR0 = data;
 }
 
+/************************************
+* Procedure: USART_StartRx
+*
+* Description: Switches reception over to the rx
+*  interrupt, so bytes that arrive while no one is
+*  reading are kept instead of overrunning the
+*  receiver. Bytes arrive once interrupts are enabled.
+*
+* Param hook: Sees every received byte first, or NULL
+************************************/
+void USART_StartRx(USART_RxHook hook) {
+	portENTER_CRITICAL();
+	rxHook = hook;
+	rxHead = rxTail = 0;
+	UCSR0B |= (1<<RXCIE0);
+	portEXIT_CRITICAL();
+}
+
 /* the receive data function. Note that this a blocking call
 Therefore you may not get control back after this is called 
 until a much later time. It may be helpful to use the 
@@ -65,6 +325,17 @@ istheredata() function to check before calling this function
         @return 8bit data packet from sender
 */
 uint8_t USART_Read(void) {
+    uint8_t data;
+
+    if (UCSR0B & (1<<RXCIE0)) {
+        /* Wait for the rx isr to queue a byte */
+        while (rxTail == rxHead)
+            ;
+        data = rxBuff[rxTail];
+        rxTail = (rxTail + 1) & RXMASK;
+        return data;
+    }
+
     /* Wait for data to be received */
     while ( !(UCSR0A & (1<<RXC0)) )
         ;
@@ -13,9 +13,32 @@
 #ifndef USART_H_
 #define USART_H_
 
+/* Size of the transmit queue. Must be a power of two no larger than 256. */
+#define USART_TXBUFF_SZ 256
+
+/* Longest write that USART_Enqueue can accept in one piece. */
+#define USART_TX_MAX (USART_TXBUFF_SZ - 1)
+
+/* Size of the receive queue used after USART_StartRx. Must be a power of two
+ * no larger than 256. */
+#define USART_RXBUFF_SZ 32
+
+/* Sees each received byte in the receive interrupt. Returns nonzero if it
+ * consumed the byte, which then never reaches USART_Read. */
+typedef uint8_t (*USART_RxHook)(uint8_t data);
+
 uint8_t USART_Read(void);
 void USART_Write(uint8_t data);
 void USART_Write_Unprotected(uint8_t data);
-void USART_Init(uint16_t baudin, uint32_t clk_speedin);
+void USART_Init(uint32_t baudin, uint32_t clk_speedin);
+uint32_t USART_GetBaud(int16_t *error);
+
+uint8_t USART_Enqueue(const uint8_t *data, uint8_t len);
+void USART_WriteBuffer(const uint8_t *data, uint16_t len);
+uint8_t USART_TxFree(void);
+uint16_t USART_TxCount(void);
+void USART_Flush(void);
+
+void USART_StartRx(USART_RxHook hook);
 
 #endif /* USART_H_ */
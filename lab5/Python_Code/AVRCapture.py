@@ -0,0 +1,87 @@
+############################################
+#
+# AVRCapture.py
+#
+# Records the bytes passed between the AVR and AVRGraphicsModule.py to a
+# capture file, for AVRReplay.py to play back without a board or a window.
+#
+# A capture file is a series of records, each a header (direction, microseconds
+# since the capture started, length) followed by that many bytes. Bytes moving
+# the same way within a millisecond of each other share a record.
+#
+############################################
+
+import struct, time, atexit
+from threading import Lock
+
+HEADER = struct.Struct('<cIH')
+FROM_AVR = 'A'
+TO_AVR = 'H'
+
+COALESCE_US = 1000
+MAX_RECORD = 0xffff
+
+class CaptureSerial(object):
+	#stands in for the Serial it wraps, recording everything read and written
+	def __init__(self, serial, filename):
+		self.serial = serial
+		self.file = open(filename, 'wb')
+		self.start = time.time()
+		self.lock = Lock()
+		self.direction = None
+		self.stamp = 0
+		self.pending = ''
+		atexit.register(self.close)
+	
+	def record(self, direction, data):
+		if len(data) == 0:
+			return
+		stamp = int((time.time() - self.start) * 1e6) & 0xffffffff
+		self.lock.acquire()
+		try:
+			if direction != self.direction or stamp - self.stamp > COALESCE_US or \
+					len(self.pending) + len(data) > MAX_RECORD:
+				self.flush()
+				self.direction, self.stamp = direction, stamp
+			self.pending += data
+		finally:
+			self.lock.release()
+	
+	def flush(self):
+		if self.pending and not self.file.closed:
+			self.file.write(HEADER.pack(self.direction, self.stamp, len(self.pending)) + self.pending)
+			self.file.flush()
+		self.pending = ''
+	
+	def read(self, size=1):
+		data = self.serial.read(size)
+		self.record(FROM_AVR, data)
+		return data
+	
+	def write(self, data):
+		self.record(TO_AVR, data)
+		return self.serial.write(data)
+	
+	def inWaiting(self):
+		return self.serial.inWaiting()
+	
+	def close(self):
+		self.lock.acquire()
+		try:
+			self.flush()
+			self.file.close()
+		finally:
+			self.lock.release()
+
+def readCapture(filename):
+	#yields (direction, microseconds, data) for each record in a capture file
+	f = open(filename, 'rb')
+	try:
+		while True:
+			header = f.read(HEADER.size)
+			if len(header) < HEADER.size:
+				return
+			direction, stamp, length = HEADER.unpack(header)
+			yield direction, stamp, f.read(length)
+	finally:
+		f.close()
@@ -25,6 +25,20 @@ CREATE_WINDOW = 0x0A
 
 PRINT = 0x0B
 
+#sent to the AVR unasked, followed by the handle of a sprite whose image could not be loaded
+LOAD_ERROR = 0xFE
+
+FRAME = 0x0E
+
+#FRAME entry flags, how a sprite's position and angle follow its flags byte
+FRAME_POS_ABS = 0x01	#x, y as INT16
+FRAME_POS_D8 = 0x02		#dx, dy as signed INT8
+FRAME_POS_D4 = 0x03		#dx in the high nibble, dy in the low nibble, signed
+FRAME_POS_MASK = 0x03
+FRAME_ROT_ABS = 0x04	#angle as INT16
+FRAME_ROT_D8 = 0x08		#angle delta as signed INT8
+FRAME_ROT_MASK = 0x0C
+
 INT8 = 0x01
 INT16 = 0x02
 STRING = 0x03
@@ -10,7 +10,7 @@
 
 import pygame
 from pygame import event, display
-import sys, os, imp
+import sys, os, imp, time, struct
 from threading import Thread, Semaphore
 from serial import Serial
 
@@ -18,34 +18,54 @@ import AVRConstants as const
 from AVRConstants import INT8, INT16, STRING
 from AVRSprite import AVRSprite
 from AVRGroup import AVRGroup
+from AVRCapture import CaptureSerial
+
+FRAME_LENGTH = struct.Struct('>H')
+
+#decoded bytes are dropped from the front of the read buffer once there are this many
+BUFFER_COMPACT = 4096
+
+#how long the render loop sleeps when no sprite changed
+IDLE_SLEEP = 0.001
 
 class AVRInterface(object):
 	class exception(Exception):
 		pass
 	
 	def __init__(self):
-		if len(sys.argv) < 2:
-			print "usage: AVRInterface <COM_PORT>"
+		if len(sys.argv) < 2 or (len(sys.argv) > 2 and (len(sys.argv) != 4 or sys.argv[2] != '--record')):
+			print "usage: AVRInterface <COM_PORT> [--record <CAPTURE_FILE>]"
 			return
 	
 		pygame.init()
 		self.displayInit = Semaphore(0)
 		self.windowInit = Semaphore(0)
 		self.running = True					#set to false if window is destroyed; stops sensor polling thread
+		self.failed = set()					#handles of sprites whose image could not be loaded
+		
+		#throughput counters, reported by AVRReplay.py
+		self.commands = 0
+		self.firstCommand = self.lastCommand = None
+		self.frames = 0
+		self.parseTime = self.parseMax = 0.0		#decoding and applying FRAMEs
+		self.renders = 0
+		self.renderTime = self.renderMax = 0.0		#passes of the render loop
 		
 		self.sensor = Serial(port=sys.argv[1], baudrate=const.BAUD_RATE, timeout=1)
+		if len(sys.argv) == 4:
+			self.sensor = CaptureSerial(self.sensor, sys.argv[3])
 		self.sensor.write(chr(0xff))
 		print "Sent initialization 0xff"
 		
 		#function command to the python handle function and the argument types it takes
 		self.mapping = {
-			const.CREATE_SPRITE: [self.onCreateSprite, [STRING, INT16, INT16, INT16, INT16, INT16, INT8]],
+			const.CREATE_SPRITE: [self.onCreateSprite, [INT8, STRING, INT16, INT16, INT16, INT16, INT16, INT8]],
 			const.SET_POS: [self.onSetPos, [INT8, INT16, INT16]],
 			const.SET_ROT: [self.onSetRot, [INT8, INT16]],
 			const.SET_ORDER: [self.onSetOrder, [INT8, INT8]],
 			const.SET_SIZE: [self.onSetSize, [INT8, INT16, INT16]],
 			const.DELETE_SPRITE: [self.onDeleteSprite, [INT8]],
-			const.CREATE_GROUP: [self.onCreateGroup, []],
+			const.CREATE_GROUP: [self.onCreateGroup, [INT8]],
 			const.ADD_TO_GROUP: [self.onAddToGroup, [INT8, INT8]],
 			const.REMOVE_FROM_GROUP: [self.onRemoveFromGroup, [INT8, INT8]],
 			const.DELETE_GROUP: [self.onDeleteGroup, [INT8]],
@@ -53,6 +73,8 @@ class AVRInterface(object):
 			const.CREATE_WINDOW: [self.onCreateWindow, [INT16, INT16]],
 			const.PRINT: [self.onPrint, [STRING]],
 		}
+		for entry in self.mapping.values():
+			entry.append(self.compileArgs(entry[1]))
 		
 		self.run()
 	
@@ -65,6 +87,11 @@ class AVRInterface(object):
 		self.disp = display.set_mode((self.width,self.height))
 		self.back = pygame.Surface((self.width,self.height))
 		self.back.fill((0,0,0), pygame.Rect(0,0,self.width, self.height))
+		self.disp.blit(self.back, (0,0))
+		display.update()
+		
+		#only the areas of sprites that changed are cleared and redrawn
+		AVRSprite.spriteDrawGroup.clear(self.disp, self.back)
 		
 		self.displayInit.release()
 		
@@ -79,95 +106,105 @@ class AVRInterface(object):
 					self.running = False
 					sys.exit()
 					
-			#clear then delete things atomically
 			AVRSprite.deleteLock.acquire()
-			AVRSprite.spriteDrawGroup.clear(self.disp, self.back)
 			AVRSprite.onDelete()
 			AVRSprite.deleteLock.release()
 			
-			AVRSprite.updateGraphics()
-			
+			#a FRAME is applied under spriteLock, so never draw half of one
+			start = time.time()
 			AVRSprite.spriteLock.acquire()
-			display.update(AVRSprite.spriteDrawGroup.draw(self.disp))
-			AVRSprite.spriteLock.release()
+			try:
+				AVRSprite.updateGraphics()
+				rects = AVRSprite.spriteDrawGroup.draw(self.disp)
+			finally:
+				AVRSprite.spriteLock.release()
+			
+			if not rects:
+				time.sleep(IDLE_SLEEP)
+				continue
+			display.update(rects)
 			
-			AVRSprite.update()
+			elapsed = time.time() - start
+			self.renders += 1
+			self.renderTime += elapsed
+			self.renderMax = max(self.renderMax, elapsed)
 	
-	def onCreateSprite(self, file, x, y, angle, w, h, order):
+	def getSprite(self, handle, name):
+		#the sprite with the given handle, or None if its image failed to load
+		if handle in AVRSprite.spriteList:
+			return AVRSprite.spriteList[handle]
+		if handle in self.failed:
+			return None
+		print "%s: Unknown handle %d" % (name, handle)
+		raise AVRInterface.exception(name)
+	
+	def onCreateSprite(self, handle, file, x, y, angle, w, h, order):
+		if handle in AVRSprite.spriteList or handle in self.failed or handle in AVRGroup.groupList:
+			print "createSprite: Handle %d in use" % handle
+			raise AVRInterface.exception('onCreateSprite')
 		try:
-			s = AVRSprite(file, (x,y), angle, (w,h), order)
+			AVRSprite(handle, file, (x,y), angle, (w,h), order)
 		except pygame.error:
-			return const.HANDLE_ERROR
-		if s.handle == -1:
-			return const.HANDLE_ERROR
-		return s.handle		
+			#the AVR does not wait for a reply, so report the failure unasked
+			self.failed.add(handle)
+			self.sensor.write(chr(const.LOAD_ERROR) + chr(handle))
+		return -1
 	
 	def onSetPos(self, handle, x, y):
-		if handle in AVRSprite.spriteList:
-			AVRSprite.spriteList[handle].setPos((x,y))
-		else:
-			print "setPos: Unknown handle %d" % handle
-			raise AVRInterface.exception('onSetPos')
+		s = self.getSprite(handle, 'onSetPos')
+		if s:
+			s.setPos((x,y))
 		return -1
 	
 	def onSetRot(self, handle, angle):
-		if handle in AVRSprite.spriteList:
-			AVRSprite.spriteList[handle].setAngle(angle)
-		else:
-			print "setAngle: Unknown handle %d" % handle
-			raise AVRInterface.exception('onSetRot')
+		s = self.getSprite(handle, 'onSetRot')
+		if s:
+			s.setAngle(angle)
 		return -1
 	
 	def onSetSize(self, handle, x, y):
-		if handle in AVRSprite.spriteList:
-			AVRSprite.spriteList[handle].setSize((x,y))
-		else:
-			print "setSize: Unknown handle %d" % handle
-			raise AVRInterface.exception('onSetSize')
+		s = self.getSprite(handle, 'onSetSize')
+		if s:
+			s.setSize((x,y))
 		return -1
 	
 	def onSetOrder(self, handle, order):
-		if handle in AVRSprite.spriteList:
-			AVRSprite.spriteList[handle].setOrder(order)
-		else:
-			print "setOrder: Unknown handle %d" % handle
-			raise AVRInterface.exception('onSetOrder')
+		s = self.getSprite(handle, 'onSetOrder')
+		if s:
+			s.setOrder(order)
 		return -1
 	
 	def onDeleteSprite(self, handle):
-		if handle in AVRSprite.spriteList:
-			AVRSprite.spriteList[handle].delete()
+		s = self.getSprite(handle, 'deleteSprite')
+		if s:
+			s.delete()
 		else:
-			print "deleteSprite: Unknown handle %d" % handle
-			raise AVRInterface.exception('deleteSprite')
+			self.failed.discard(handle)
 		return -1
 		
-	def onCreateGroup(self):
-		g = AVRGroup()
-		if g.handle == -1:
-			return const.HANDLE_ERROR
-		return g.handle
+	def onCreateGroup(self, handle):
+		if handle in AVRGroup.groupList or handle in AVRSprite.spriteList or handle in self.failed:
+			print "createGroup: Handle %d in use" % handle
+			raise AVRInterface.exception('onCreateGroup')
+		AVRGroup(handle)
+		return -1
 		
 	def onAddToGroup(self, groupHandle, spriteHandle):
 		if groupHandle not in AVRGroup.groupList:
 			print "addToGroup: Unknown group handle %d" % groupHandle
 			raise AVRInterface.exception('onAddToGroup')
-		elif spriteHandle not in AVRSprite.spriteList:
-			print "addToGroup: Unknown sprite handle %d" % spriteHandle
-			raise AVRInterface.exception('onAddToGroup')
-		else:
-			AVRGroup.groupList[groupHandle].addSprite(AVRSprite.spriteList[spriteHandle])
+		s = self.getSprite(spriteHandle, 'onAddToGroup')
+		if s:
+			AVRGroup.groupList[groupHandle].addSprite(s)
 		return -1
 		
 	def onRemoveFromGroup(self, groupHandle, spriteHandle):
 		if groupHandle not in AVRGroup.groupList:
 			print "removeFromGroup: Unknown group handle %d" % groupHandle
 			raise AVRInterface.exception('onRemoveFromGroup')
-		elif spriteHandle not in AVRSprite.spriteList:
-			print "removeFromGroup: Unknown sprite handle %d" % spriteHandle
-			raise AVRInterface.exception('onRemoveFromGroup')
-		else:
-			AVRGroup.groupList[groupHandle].removeSprite(AVRSprite.spriteList[spriteHandle])
+		s = self.getSprite(spriteHandle, 'onRemoveFromGroup')
+		if s:
+			AVRGroup.groupList[groupHandle].removeSprite(s)
 		return -1
 		
 	def onDeleteGroup(self, handle):
@@ -181,11 +218,9 @@ class AVRInterface(object):
 		if groupHandle not in AVRGroup.groupList:
 			print "collide: Unknown group handle %d" % groupHandle
 			raise AVRInterface.exception('onCollide')
-		elif spriteHandle not in AVRSprite.spriteList:
-			print "collide: Unknown sprite handle %d" % spriteHandle
-			raise AVRInterface.exception('onCollide')
-		else:
-			return AVRSprite.spriteList[spriteHandle].collide(AVRGroup.groupList[groupHandle])
+		s = self.getSprite(spriteHandle, 'onCollide')
+		if s:
+			return s.collide(AVRGroup.groupList[groupHandle])
 		return []
 		
 	def onCreateWindow(self, w, h):
@@ -199,49 +234,167 @@ class AVRInterface(object):
 		print s
 		return -1
 	
+	def onFrame(self, body):
+		#body is everything after the length: base handle, mask length, mask,
+		#then one entry per set mask bit, see vFrameEnd in graphics.c
+		data = bytearray(body)
+		base, maskLen = data[0], data[1]
+		mask = data[2:2 + maskLen]
+		ndx = 2 + maskLen
+		
+		def signed8(v):
+			return v - 0x100 if v & 0x80 else v
+		
+		def signed4(v):
+			return v - 0x10 if v & 0x08 else v
+		
+		AVRSprite.spriteLock.acquire()
+		try:
+			for byte, bits in enumerate(mask):
+				for bit in range(8):
+					if not bits & (1 << bit):
+						continue
+					#entries for a sprite that failed to load are read and dropped
+					s = self.getSprite(base + byte * 8 + bit, 'onFrame')
+					
+					flags = data[ndx]
+					ndx += 1
+					
+					pos = flags & const.FRAME_POS_MASK
+					if pos == const.FRAME_POS_ABS:
+						x, y = (data[ndx] << 8) | data[ndx + 1], (data[ndx + 2] << 8) | data[ndx + 3]
+						if s:
+							s.setPos((x, y))
+						ndx += 4
+					elif pos == const.FRAME_POS_D8:
+						dx, dy = signed8(data[ndx]), signed8(data[ndx + 1])
+						if s:
+							s.setPos(((s.pos[0] + dx) & 0xffff, (s.pos[1] + dy) & 0xffff))
+						ndx += 2
+					elif pos == const.FRAME_POS_D4:
+						dx, dy = signed4(data[ndx] >> 4), signed4(data[ndx] & 0x0f)
+						if s:
+							s.setPos(((s.pos[0] + dx) & 0xffff, (s.pos[1] + dy) & 0xffff))
+						ndx += 1
+					
+					rot = flags & const.FRAME_ROT_MASK
+					if rot == const.FRAME_ROT_ABS:
+						angle = (data[ndx] << 8) | data[ndx + 1]
+						if s:
+							s.setAngle(angle)
+						ndx += 2
+					elif rot == const.FRAME_ROT_D8:
+						if s:
+							s.setAngle((s.angle + signed8(data[ndx])) & 0xffff)
+						ndx += 1
+		except IndexError:
+			raise AVRInterface.exception('onFrame: short frame')
+		finally:
+			AVRSprite.spriteLock.release()
+		return -1
+	
+	def need(self, n):
+		#waits until n bytes past pos are buffered, taking whatever else has
+		#arrived in the same read; False if stopped first
+		while len(self.buf) - self.pos < n:
+			if not self.running:
+				return False
+			missing = n - (len(self.buf) - self.pos)
+			self.buf.extend(self.sensor.read(max(missing, self.sensor.inWaiting())))
+		return True
+	
+	def readString(self):
+		#a null-terminated string from the buffer, or None if stopped first
+		while True:
+			end = self.buf.find('\0', self.pos)
+			if end >= 0:
+				s = str(self.buf[self.pos:end])
+				self.pos = end + 1
+				return s
+			if not self.need(len(self.buf) - self.pos + 1):
+				return None
+	
+	def compileArgs(self, types):
+		#splits a command's argument types into struct formats around its strings
+		segments, fmt = [], ''
+		for t in types:
+			if t == STRING:
+				if fmt:
+					segments.append(struct.Struct('>' + fmt))
+					fmt = ''
+				segments.append(STRING)
+			else:
+				fmt += 'B' if t == INT8 else 'H'
+		if fmt:
+			segments.append(struct.Struct('>' + fmt))
+		return segments
+	
 	def pollAVR(self):
-        #read garbage bit from board to sync
-		self.sensor.read(1)
+		#bytes are read in bulk into buf and decoded from pos onwards
+		self.buf = bytearray()
+		self.pos = 0
+		
+		#skip garbage byte from board to sync
+		if not self.need(1):
+			return
+		self.pos += 1
 
-		while (self.running):
-			command = self.sensor.read(1)
-			if len(command) != 1:
+		while self.running:
+			if self.pos > BUFFER_COMPACT:
+				del self.buf[:self.pos]
+				self.pos = 0
+			
+			if not self.need(1):
+				return
+			command = self.buf[self.pos]
+			self.pos += 1
+			
+			self.commands += 1
+			self.lastCommand = time.time()
+			if self.firstCommand is None:
+				self.firstCommand = self.lastCommand
+			
+			if command == const.FRAME:
+				#FRAME carries its own 16 bit length, high byte first, then the body
+				if not self.need(2):
+					return
+				length = FRAME_LENGTH.unpack_from(self.buf, self.pos)[0]
+				self.pos += 2
+				if not self.need(length):
+					return
+				body = self.buf[self.pos:self.pos + length]
+				self.pos += length
+				try:
+					start = time.time()
+					self.onFrame(body)
+					elapsed = time.time() - start
+					self.frames += 1
+					self.parseTime += elapsed
+					self.parseMax = max(self.parseMax, elapsed)
+				except AVRInterface.exception as e:
+					print "Exception:", e
+					self.running = False
+					sys.exit()
 				continue
-			command = ord(command)
-			#print command
-			#print command
+			
 			if command not in self.mapping:
 				print "Command %s not recognized!" % command
 				self.running = False
 				return
 				
 			args = []
-			for arg in self.mapping[command][1]:
-				if arg == const.STRING:
-					data = ''
-					while True:
-						d = self.sensor.read(1)
-						print "got: " + str(d)
-						if len(d) != 1:
-							continue
-						if ord(d[0]) == 0x00:
-							break
-						data += d[0]
+			for segment in self.mapping[command][2]:
+				if segment == STRING:
+					data = self.readString()
+					if data is None:
+						return
 					args.append(data)
 				else:
-					#read in 1 byte at a time and convert to appropriate sized integer
-					data = []
-					while len(data) != arg:
-						d = self.sensor.read(1)
-						print "got: " + str(d)
-						if len(d) == 1:
-							data.extend(d)
-					arg = 0
-					#receive high byte first, process low byte first
-					data.reverse()
-					for i, b in enumerate(data):
-						arg |= (ord(b) << (i*8)) & (0xff << i*8)
-					args.append(arg)	
+					#integers arrive high byte first
+					if not self.need(segment.size):
+						return
+					args.extend(segment.unpack_from(self.buf, self.pos))
+					self.pos += segment.size
 			try:
 				result = self.mapping[command][0](*args)
 			except AVRInterface.exception as e:
@@ -250,9 +403,7 @@ class AVRInterface(object):
 				sys.exit()
 				
 			if isinstance(result, list):
-				for r in result:
-					self.sensor.write(chr(r & 0xff))
-				self.sensor.write(chr(0xff))
+				self.sensor.write(''.join(chr(r & 0xff) for r in result) + chr(0xff))
 			else:
 				if result != -1:
 					self.sensor.write(chr(result & 0xff))
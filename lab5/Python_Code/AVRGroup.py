@@ -13,19 +13,11 @@ import AVRConstants as const
 import AVRSprite
 
 class AVRGroup(object):
-	availableHandles = [i for i in range(0xFE)]
 	groupList = {}
 	
-	def __init__(self, handle=None):
-		if len(AVRGroup.availableHandles) == 0:
-			print "ERROR: No available group handles"
-			self.handle = -1
-			return
-
-		if handle == None:
-			self.handle = AVRSprite.AVRSprite.availableHandles.pop()
-		else:
-			self.handle = const.ALL_GROUP
+	#handle is chosen by the AVR, except for ALL_GROUP
+	def __init__(self, handle):
+		self.handle = handle
 		AVRGroup.groupList[self.handle] = self
 		
 		self.group = sprite.Group()
@@ -49,7 +41,6 @@ class AVRGroup(object):
 	
 	def delete(self):
 		del AVRGroup.groupList[self.handle]
-		AVRGroup.availableHandles.append(self.handle)
 		
 		for sprite in self.sprites:
 			self.removeSprite(sprite)
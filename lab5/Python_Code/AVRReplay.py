@@ -0,0 +1,139 @@
+############################################
+#
+# AVRReplay.py
+#
+# Plays a capture made with AVRGraphicsModule.py --record back into
+# AVRGraphicsModule.py without a board or a window, and reports how fast it
+# kept up. The capture is fed through a pty, so the module reads it through
+# pySerial exactly as it would read the AVR, and SDL's dummy video driver
+# gives it an off-screen surface to draw on.
+#
+# usage: AVRReplay.py <CAPTURE_FILE> [IMAGE_DIR] [--realtime] [--verbose]
+#
+# By default the capture is fed as fast as the module takes it; --realtime
+# keeps the gaps between records as they were captured. Sprite images are
+# loaded from IMAGE_DIR, by default the current directory.
+#
+############################################
+
+import sys, os, tty, time, select
+from threading import Thread
+
+import AVRCapture
+
+#stop once the module has been idle this long after the capture ran out
+IDLE_TIMEOUT = 2.0
+
+def usage():
+	print "usage: AVRReplay.py <CAPTURE_FILE> [IMAGE_DIR] [--realtime] [--verbose]"
+	sys.exit(1)
+
+class Replay(object):
+	def __init__(self, filename, realtime):
+		self.records = list(AVRCapture.readCapture(filename))
+		self.realtime = realtime
+		self.master, self.slave = os.openpty()
+		tty.setraw(self.slave)
+		self.port = os.ttyname(self.slave)
+		self.fed = 0
+		self.replies = ''
+		self.done = False
+	
+	def feed(self, interface):
+		#plays the AVR side of the capture into the pty, then stops the module once it goes idle
+		start = time.time()
+		for direction, stamp, data in self.records:
+			if direction != AVRCapture.FROM_AVR:
+				continue
+			if self.realtime:
+				delay = start + stamp / 1e6 - time.time()
+				if delay > 0:
+					time.sleep(delay)
+			while data:
+				n = os.write(self.master, data)
+				data = data[n:]
+				self.fed += n
+		
+		last = None
+		while interface.running:
+			if interface.lastCommand == last and time.time() - (last or start) > IDLE_TIMEOUT:
+				break
+			last = interface.lastCommand
+			time.sleep(0.1)
+		
+		self.done = True
+		interface.running = False
+	
+	def drain(self):
+		#collects what the module sends back, so the pty never fills up
+		while not self.done:
+			if select.select([self.master], [], [], 0.1)[0]:
+				try:
+					self.replies += os.read(self.master, 4096)
+				except OSError:
+					return
+	
+	def expectedReplies(self):
+		return ''.join(data for direction, stamp, data in self.records
+					   if direction == AVRCapture.TO_AVR)
+
+def report(replay, interface, out):
+	fromAVR = sum(len(data) for direction, stamp, data in replay.records
+				  if direction == AVRCapture.FROM_AVR)
+	span = 0.0
+	if interface.firstCommand is not None:
+		span = interface.lastCommand - interface.firstCommand
+	
+	print >>out, "bytes fed:     %d of %d" % (replay.fed, fromAVR)
+	print >>out, "commands:      %d in %.3f s" % (interface.commands, span)
+	if span > 0:
+		print >>out, "commands/s:    %.1f" % (interface.commands / span)
+		print >>out, "bytes/s:       %.1f" % (replay.fed / span)
+	if interface.frames:
+		print >>out, "frames:        %d, parse %.3f ms mean, %.3f ms max" % (interface.frames,
+			interface.parseTime * 1e3 / interface.frames, interface.parseMax * 1e3)
+	if interface.renders:
+		print >>out, "render passes: %d, %.3f ms mean, %.3f ms max" % (interface.renders,
+			interface.renderTime * 1e3 / interface.renders, interface.renderMax * 1e3)
+	
+	#collide results depend on when the render loop last moved each sprite,
+	#so replies can differ from the capture without anything being wrong
+	expected = replay.expectedReplies()
+	if replay.replies == expected:
+		print >>out, "replies:       %d bytes, same as captured" % len(expected)
+	else:
+		print >>out, "replies:       %d bytes, %d captured, differ" % (len(replay.replies), len(expected))
+
+def main():
+	args = [a for a in sys.argv[1:] if not a.startswith('--')]
+	flags = [a for a in sys.argv[1:] if a.startswith('--')]
+	if len(args) not in (1, 2) or [f for f in flags if f not in ('--realtime', '--verbose')]:
+		usage()
+	
+	replay = Replay(os.path.abspath(args[0]), '--realtime' in flags)
+	if len(args) == 2:
+		os.chdir(args[1])
+	
+	#off-screen drawing; set before pygame is imported
+	os.environ['SDL_VIDEODRIVER'] = 'dummy'
+	os.environ['SDL_AUDIODRIVER'] = 'dummy'
+	import AVRGraphicsModule
+	
+	class ReplayInterface(AVRGraphicsModule.AVRInterface):
+		def run(self):
+			Thread(target=replay.drain).start()
+			Thread(target=replay.feed, args=(self,)).start()
+			AVRGraphicsModule.AVRInterface.run(self)
+	
+	out = sys.stdout
+	if '--verbose' not in flags:
+		sys.stdout = open(os.devnull, 'w')
+	
+	sys.argv = [sys.argv[0], replay.port]
+	interface = ReplayInterface()
+	
+	sys.stdout = out
+	report(replay, interface, out)
+
+if __name__ == '__main__':
+	main()
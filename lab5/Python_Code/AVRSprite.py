@@ -16,14 +16,14 @@ JPG
  '''
 
 class AVRSprite(object):
-	availableHandles = [i for i in range(0xFE)]
 	spriteList = {}
 	deletedSprites = []
 	spriteDrawGroup = sprite.LayeredDirty()
 	deleteLock = Lock()
 	spriteLock = Lock()
 	
-	def __init__(self, filename, pos, angle, size, order):
+	#handle is chosen by the AVR
+	def __init__(self, handle, filename, pos, angle, size, order):
 		self.pos = pos
 		self.angle = angle
 		self.size = size[:]	#copy	
@@ -31,11 +31,6 @@ class AVRSprite(object):
 		self.filename = filename
 		self.groups = []
 		
-		if len(AVRSprite.availableHandles) == 0:
-			print "ERROR: AVRSprite out of handles!"
-			self.handle = -1
-			return
-		
 		try:
 			self.surface = image.load(self.filename).convert_alpha()
 		except error as e:
@@ -59,7 +54,7 @@ class AVRSprite(object):
 		
 		AVRSprite.spriteDrawGroup.add(self.sprite, layer=self.order)
 		AVRGroup.AVRGroup.groupList[const.ALL_GROUP].addSprite(self)
-		self.handle = AVRSprite.availableHandles.pop()
+		self.handle = handle
 		AVRSprite.spriteList[self.handle] = self
 		
 		#print 'sprite %s with handle %s' % (self.filename, self.handle)
@@ -100,7 +95,6 @@ class AVRSprite(object):
 		
 		self.sprite.AVRSprite = None
 		del AVRSprite.spriteList[self.handle]
-		AVRSprite.availableHandles.append(self.handle)
 		AVRSprite.deleteLock.release()
 	
 	def collide(self, group):
@@ -132,33 +126,23 @@ class AVRSprite(object):
 			
 		AVRSprite.deletedSprites = []
 		
-	@staticmethod
-	def update():
-		for s in AVRSprite.spriteList.values():
-			if s.posDirty or s.sizeDirty or s.rotateDirty:
-				s.sprite.dirty = 1
-	
 	@staticmethod
 	def updateGraphics():
+		#applies what changed since the last pass and marks just those sprites
+		#for redrawing. Flags are cleared before the values are read, so a
+		#change made meanwhile by the polling thread is picked up next pass.
 		for s in AVRSprite.spriteList.values():
-			if s.sizeDirty:
+			sizeDirty, rotateDirty, posDirty = s.sizeDirty, s.rotateDirty, s.posDirty
+			if not (sizeDirty or rotateDirty or posDirty):
+				continue
+			s.sizeDirty = s.rotateDirty = s.posDirty = False
+			
+			if sizeDirty:
 				s.scaledSurface = transform.smoothscale(s.surface, s.size)
+			if sizeDirty or rotateDirty:
 				s.transformedSurface = transform.rotate(s.scaledSurface, s.angle)
 				s.sprite.image = s.transformedSurface
 				s.sprite.rect = s.transformedSurface.get_rect()
-				s.sprite.rect.center = s.pos
 				s.sprite.maskDirty = True
-				
-			elif s.rotateDirty:
-				s.transformedSurface = transform.rotate(s.scaledSurface, s.angle)
-				s.sprite.image = s.transformedSurface
-				s.sprite.rect = s.transformedSurface.get_rect()
-				s.sprite.rect.center = s.pos
-				s.sprite.maskDirty = True
-				
-			elif s.posDirty:
-				s.sprite.rect.center = s.pos
-				s.posDirty = False
-			s.posDirty = True
-			s.rotateDirty = True
-			s.sizeDirty = True
+			s.sprite.rect.center = s.pos
+			s.sprite.dirty = 1